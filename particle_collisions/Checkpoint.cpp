@@ -0,0 +1,193 @@
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
+
+#include "Checkpoint.h"
+
+#include "Scene.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "debugOutput.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+static size_t alignCheckpointOffset(size_t offset) noexcept { return (offset + PARTICLE_STORE_ALIGNMENT - 1) / PARTICLE_STORE_ALIGNMENT * PARTICLE_STORE_ALIGNMENT; }
+
+void CheckpointSnapshot::take(const Scene& scene) {
+	width = scene.width;
+	height = scene.height;
+	particles = scene.particles;
+	lastIntersectionPartners.resize(particles.count);
+	lastIntersectionWasWithWall.resize(particles.count);
+	for (size_t i = 0; i < particles.count; i++) {
+		lastIntersectionPartners[i] = i < scene.lastIntersectionPartners.size() ? scene.lastIntersectionPartners[i] : i;
+		lastIntersectionWasWithWall[i] = i < scene.lastIntersectionWasWithWall.size() && scene.lastIntersectionWasWithWall[i];
+	}
+}
+
+// Column table for a scene with the given amount of particles. Offsets start right after the header and the table.
+static void layOutColumns(size_t particleCount, size_t capacity, CheckpointColumn* columns, size_t& headerSize, size_t& fileSize) {
+	static const uint32_t elementSizes[(size_t)CheckpointColumnId::COUNT] = { sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(uint8_t), sizeof(uint64_t), sizeof(uint8_t) };
+	headerSize = sizeof(CheckpointHeader) + (size_t)CheckpointColumnId::COUNT * sizeof(CheckpointColumn);
+	size_t offset = alignCheckpointOffset(headerSize);
+	for (size_t i = 0; i < (size_t)CheckpointColumnId::COUNT; i++) {
+		bool particleArray = i <= (size_t)CheckpointColumnId::FLAGS;
+		columns[i] = { (uint32_t)i, elementSizes[i], offset, (particleArray ? capacity : particleCount) * elementSizes[i] };
+		offset = alignCheckpointOffset(offset + columns[i].size);
+	}
+	fileSize = offset;
+}
+
+static bool writeZeros(FILE* file, size_t count) {
+	static const char zeros[PARTICLE_STORE_ALIGNMENT] = { };
+	while (count != 0) {
+		size_t chunk = count < sizeof(zeros) ? count : sizeof(zeros);
+		if (fwrite(zeros, 1, chunk, file) != chunk) { return false; }
+		count -= chunk;
+	}
+	return true;
+}
+
+// Everything gets written in order, so the file is one sequential stream.
+bool writeCheckpoint(const CheckpointSnapshot& snapshot, FILE* file) {
+	const ParticleStore& particles = snapshot.particles;
+	CheckpointColumn columns[(size_t)CheckpointColumnId::COUNT];
+	size_t headerSize;
+	size_t fileSize;
+	layOutColumns(particles.count, particles.capacity, columns, headerSize, fileSize);
+
+	CheckpointHeader header = { };
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	header.version = CHECKPOINT_VERSION;
+	header.byteOrder = CHECKPOINT_BYTE_ORDER;
+	header.headerSize = (uint32_t)headerSize;
+	header.columnCount = (uint32_t)CheckpointColumnId::COUNT;
+	header.width = snapshot.width;
+	header.height = snapshot.height;
+	header.particleCount = particles.count;
+	header.capacity = particles.capacity;
+	header.fileSize = fileSize;
+	if (fwrite(&header, sizeof(header), 1, file) != 1) { return false; }
+	if (fwrite(columns, sizeof(columns), 1, file) != 1) { return false; }
+
+	const void* data[(size_t)CheckpointColumnId::COUNT] = { particles.x, particles.y, particles.vx, particles.vy, particles.radius, particles.mass, particles.localTime, particles.flags, snapshot.lastIntersectionPartners.data(), snapshot.lastIntersectionWasWithWall.data() };
+	size_t position = headerSize;
+	for (size_t i = 0; i < (size_t)CheckpointColumnId::COUNT; i++) {
+		if (!writeZeros(file, columns[i].offset - position)) { return false; }
+		if (columns[i].size != 0 && fwrite(data[i], 1, columns[i].size, file) != columns[i].size) { return false; }			// The particle arrays get written with their padding, which the store keeps zeroed.
+		position = columns[i].offset + columns[i].size;
+	}
+	return writeZeros(file, fileSize - position);
+}
+
+bool writeCheckpoint(const CheckpointSnapshot& snapshot, const char* path) {
+	std::string temporaryPath = std::string(path) + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to create checkpoint " << temporaryPath << debuglogger::endl; return false; }
+	bool written = writeCheckpoint(snapshot, file);
+	if (fclose(file) != 0) { written = false; }
+	if (!written) { debuglogger::out << debuglogger::error << "failed to write checkpoint " << temporaryPath << debuglogger::endl; remove(temporaryPath.c_str()); return false; }
+
+#ifdef _WIN32
+	bool moved = MoveFileExA(temporaryPath.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;			// rename doesn't replace existing files on Windows.
+#else
+	bool moved = rename(temporaryPath.c_str(), path) == 0;
+#endif
+	if (!moved) { debuglogger::out << debuglogger::error << "failed to move checkpoint to " << path << ", it's still in " << temporaryPath << debuglogger::endl; return false; }
+	return true;
+}
+
+bool saveCheckpoint(Scene& scene, const char* path) {
+	scene.particles.detachMapping();
+	CheckpointSnapshot snapshot;
+	snapshot.take(scene);
+	return writeCheckpoint(snapshot, path);
+}
+
+// Checks everything that loadCheckpoint is going to rely on, so that a truncated or foreign file can't make it read outside of the mapping.
+static bool validateCheckpoint(const uint8_t* memory, size_t size, const char* source) {
+	const char* problem = nullptr;
+	const CheckpointHeader* header = (const CheckpointHeader*)memory;
+	if (size < sizeof(CheckpointHeader) || memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) { problem = "isn't a checkpoint"; }
+	else if (header->byteOrder != CHECKPOINT_BYTE_ORDER) { problem = "was written with a different byte order"; }
+	else if (header->version != CHECKPOINT_VERSION) { problem = "has an unsupported version"; }
+	else if (header->fileSize != size || header->columnCount != (uint32_t)CheckpointColumnId::COUNT) { problem = "is truncated or damaged"; }
+	else {
+		CheckpointColumn expected[(size_t)CheckpointColumnId::COUNT];
+		size_t headerSize;
+		size_t fileSize;
+		if (header->capacity < header->particleCount || header->capacity % PARTICLE_STORE_PADDING != 0 || header->capacity > size) { problem = "is truncated or damaged"; }
+		else {
+			layOutColumns((size_t)header->particleCount, (size_t)header->capacity, expected, headerSize, fileSize);
+			if (header->headerSize != headerSize || fileSize != size || memcmp(memory + sizeof(CheckpointHeader), expected, sizeof(expected)) != 0) { problem = "is truncated or damaged"; }
+		}
+	}
+	if (problem == nullptr) { return true; }
+	debuglogger::out << debuglogger::error << "checkpoint " << source << ' ' << problem << debuglogger::endl;
+	return false;
+}
+
+// Takes over the mapping if mapped is true, and copies the particle arrays out of memory otherwise.
+static void applyCheckpoint(Scene& scene, uint8_t* memory, size_t size, bool mapped) {
+	const CheckpointHeader& header = *(const CheckpointHeader*)memory;
+	const CheckpointColumn* columns = (const CheckpointColumn*)(memory + sizeof(CheckpointHeader));
+	void* data[(size_t)CheckpointColumnId::COUNT];
+	for (size_t i = 0; i < (size_t)CheckpointColumnId::COUNT; i++) { data[i] = memory + columns[i].offset; }
+	size_t particleCount = (size_t)header.particleCount;
+
+	scene.loadSize(header.width, header.height);
+	if (mapped) {
+		scene.particles.useMappedArrays(memory, size, (float*)data[(size_t)CheckpointColumnId::X], (float*)data[(size_t)CheckpointColumnId::Y], (float*)data[(size_t)CheckpointColumnId::VX], (float*)data[(size_t)CheckpointColumnId::VY],
+			(float*)data[(size_t)CheckpointColumnId::RADIUS], (float*)data[(size_t)CheckpointColumnId::MASS], (float*)data[(size_t)CheckpointColumnId::LOCAL_TIME], (uint8_t*)data[(size_t)CheckpointColumnId::FLAGS], particleCount, (size_t)header.capacity);
+	}
+	else {
+		ParticleStore& particles = scene.particles;
+		particles.clear();
+		particles.resize(particleCount);
+		void* arrays[(size_t)CheckpointColumnId::FLAGS + 1] = { particles.x, particles.y, particles.vx, particles.vy, particles.radius, particles.mass, particles.localTime, particles.flags };
+		for (size_t i = 0; i <= (size_t)CheckpointColumnId::FLAGS; i++) { if (particleCount != 0) { memcpy(arrays[i], data[i], particleCount * columns[i].elementSize); } }
+	}
+	scene.particleCount = particleCount;
+	scene.lastParticle = particleCount != 0 ? particleCount - 1 : 0;
+	scene.postLoadInit();
+
+	// These two are std::vectors, so they can't live in the mapping and have to be copied.
+	const uint64_t* partners = (const uint64_t*)data[(size_t)CheckpointColumnId::LAST_INTERSECTION_PARTNERS];
+	const uint8_t* withWall = (const uint8_t*)data[(size_t)CheckpointColumnId::LAST_INTERSECTION_WAS_WITH_WALL];
+	scene.workers.runRanges(particleCount, [&scene, partners](size_t begin, size_t end) { for (size_t i = begin; i < end; i++) { scene.lastIntersectionPartners[i] = (size_t)partners[i]; } });
+	for (size_t i = 0; i < particleCount; i++) { if (withWall[i] != 0) { scene.lastIntersectionWasWithWall[i] = true; } }			// A vector<bool> packs several particles into every word, so this part can't be split up between threads. postLoadInit already cleared it.
+}
+
+bool loadCheckpoint(Scene& scene, const char* path) {
+	size_t size;
+	uint8_t* memory = (uint8_t*)mapFile(path, size);
+	if (memory == nullptr) { return false; }
+	if (!validateCheckpoint(memory, size, path)) { unmapFile(memory, size); return false; }
+	applyCheckpoint(scene, memory, size, true);
+	return true;
+}
+
+bool loadCheckpoint(Scene& scene, const void* data, size_t size) {
+	if (!validateCheckpoint((const uint8_t*)data, size, "in memory")) { return false; }
+	applyCheckpoint(scene, (uint8_t*)data, size, false);
+	return true;
+}
+
+CheckpointWriter::~CheckpointWriter() { finish(); }
+
+void CheckpointWriter::start(Scene& scene, const char* path) {
+	finish();
+	scene.particles.detachMapping();
+	snapshot.take(scene);
+	succeeded = false;
+	thread = std::thread([this, path = std::string(path)]() { succeeded = writeCheckpoint(snapshot, path.c_str()); });
+}
+
+bool CheckpointWriter::finish() {
+	if (thread.joinable()) { thread.join(); }
+	return succeeded;
+}
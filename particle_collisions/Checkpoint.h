@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ParticleStore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+class Scene;
+
+// Binary checkpoint of a Scene that loads by mapping the file instead of parsing it.
+// Layout: a CheckpointHeader, a CheckpointColumn for every array, then the arrays themselves. Every array starts at a multiple of PARTICLE_STORE_ALIGNMENT, and the particle arrays have the same capacity and zeroed padding as a ParticleStore,
+// so loadCheckpoint can point the scene's ParticleStore straight into the (copy-on-write) mapping. Everything is little-endian, which CheckpointHeader::byteOrder checks.
+
+#define CHECKPOINT_MAGIC "PCCHKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+enum class CheckpointColumnId : uint32_t {
+	X,
+	Y,
+	VX,
+	VY,
+	RADIUS,
+	MASS,
+	LOCAL_TIME,
+	FLAGS,
+	LAST_INTERSECTION_PARTNERS,				// uint64_t per particle, whatever size_t is on the machine that wrote it.
+	LAST_INTERSECTION_WAS_WITH_WALL,			// uint8_t per particle.
+	COUNT
+};
+
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t headerSize;						// Including the column table.
+	uint32_t columnCount;
+	uint32_t width;
+	uint32_t height;
+	uint64_t particleCount;
+	uint64_t capacity;							// Elements in each particle array, padding included.
+	uint64_t fileSize;
+};
+
+struct CheckpointColumn
+{
+	uint32_t id;
+	uint32_t elementSize;
+	uint64_t offset;							// From the start of the file.
+	uint64_t size;								// In bytes.
+};
+
+// A copy of everything that goes into a checkpoint. Taking one is a handful of memcpys, so the scene can keep stepping while the snapshot gets written out.
+struct CheckpointSnapshot
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	ParticleStore particles;
+	std::vector<uint64_t> lastIntersectionPartners;
+	std::vector<uint8_t> lastIntersectionWasWithWall;
+
+	void take(const Scene& scene);
+};
+
+// Writes to a temporary file next to path and moves it over path at the end, in one go, so that neither a crash nor a failed move ever leaves a half written checkpoint (or none at all) behind. Returns false (after logging why) if writing failed.
+// On Windows, that fails while a scene still has path mapped (see loadCheckpoint), which saveCheckpoint and CheckpointWriter take care of.
+bool writeCheckpoint(const CheckpointSnapshot& snapshot, const char* path);
+// Writes the checkpoint at the current position of an open file, for formats that embed checkpoints (see InputJournal). Returns false if writing failed.
+bool writeCheckpoint(const CheckpointSnapshot& snapshot, FILE* file);
+// Copies the scene's particles out of a loaded checkpoint's mapping first, in case it's the one getting replaced.
+bool saveCheckpoint(Scene& scene, const char* path);
+
+// Replaces the scene's size and particles with the ones from the checkpoint. The particle arrays stay in the mapping until the store has to grow or the scene gets saved. Returns false (after logging why, leaving the scene alone) if the file isn't a valid checkpoint.
+bool loadCheckpoint(Scene& scene, const char* path);
+// Same, but from a checkpoint that's already in memory. The arrays get copied, so data doesn't have to stay around.
+bool loadCheckpoint(Scene& scene, const void* data, size_t size);
+
+// Saves in the background. start takes the snapshot on the calling thread (so between two steps), the rest happens on a thread of its own.
+class CheckpointWriter
+{
+public:
+	CheckpointSnapshot snapshot;
+	std::thread thread;
+	bool succeeded = false;
+
+	CheckpointWriter() = default;
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+	~CheckpointWriter();
+
+	bool busy() const noexcept { return thread.joinable(); }
+
+	// Waits for the previous save first, if there still is one. Copies the scene's particles out of a loaded checkpoint's mapping, same as saveCheckpoint.
+	void start(Scene& scene, const char* path);
+	// Waits for the current save and returns whether it worked.
+	bool finish();
+};
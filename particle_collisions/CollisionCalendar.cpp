@@ -0,0 +1,40 @@
+#include "CollisionCalendar.h"
+
+#include <algorithm>
+
+// The std heap functions build max-heaps, so this returns true if a should come out of the calendar AFTER b.
+static bool happensLater(const CollisionEvent& a, const CollisionEvent& b) noexcept {
+	if (a.t != b.t) { return a.t > b.t; }
+	if (a.a != b.a) { return a.a > b.a; }
+	if (a.wall != b.wall) { return b.wall; }						// Wall events of a particle come before its pair events, same as in the sub-step engine's search order.
+	return a.b > b.b;
+}
+
+void CollisionCalendar::clear() noexcept { events.clear(); }					// Keeps the capacity around, the calendar fills up to roughly the same size every step.
+
+bool CollisionCalendar::empty() const noexcept { return events.empty(); }
+
+void CollisionCalendar::push(const CollisionEvent& event) {
+	events.push_back(event);
+	std::push_heap(events.begin(), events.end(), happensLater);
+}
+
+void CollisionCalendar::pushAll(const std::vector<CollisionEvent>& newEvents) {
+	if (newEvents.size() * 8 < events.size()) {						// Pushing costs log(n) per event, rebuilding costs n in total, so rebuilding only pays off if there are lots of new events.
+		for (size_t i = 0; i < newEvents.size(); i++) { push(newEvents[i]); }
+		return;
+	}
+	events.insert(events.end(), newEvents.begin(), newEvents.end());
+	std::make_heap(events.begin(), events.end(), happensLater);
+}
+
+CollisionEvent CollisionCalendar::pop() {
+	std::pop_heap(events.begin(), events.end(), happensLater);
+	CollisionEvent event = events.back();
+	events.pop_back();
+	return event;
+}
+
+const CollisionEvent& CollisionCalendar::next() const noexcept { return events.front(); }
+
+bool CollisionCalendar::happensBefore(const CollisionEvent& a, const CollisionEvent& b) noexcept { return happensLater(b, a); }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A predicted collision, as stored in the CollisionCalendar.
+struct CollisionEvent
+{
+	float t;								// Time of the collision inside of the current step (0 is the start of the step, 1 is the end).
+	size_t a;
+	size_t b;								// Partner particle, or for wall events, the axis of the wall (false for x and true for y, same as currentColliderB in the sub-step engine).
+	uint32_t countA;						// Collision counters of both particles at the time of the prediction. If either of the particles has collided since then, the prediction is stale.
+	uint32_t countB;
+	bool wall;
+};
+
+// Priority queue of predicted collisions for the event-driven engine.
+// Stale events aren't searched for and removed when a particle collides, that would be way too expensive. Instead, they stay in the queue and get thrown away when they come up (see CollisionEvent::countA).
+class CollisionCalendar
+{
+public:
+	std::vector<CollisionEvent> events;					// Binary min-heap, ordered by t. Ties are ordered by the particle indices so that the order in which events get processed doesn't depend on the order in which they were predicted.
+
+	void clear() noexcept;
+	bool empty() const noexcept;
+
+	void push(const CollisionEvent& event);
+	void pushAll(const std::vector<CollisionEvent>& newEvents);			// Same as pushing every event one after another, but rebuilds the heap in one go if that's cheaper.
+	CollisionEvent pop();
+	const CollisionEvent& next() const noexcept;						// The event that pop would return. The calendar must not be empty.
+
+	// The order in which events come out of the calendar. It's a strict total order over everything except the collision counters, so the order of the events doesn't depend on the order in which they were pushed.
+	static bool happensBefore(const CollisionEvent& a, const CollisionEvent& b) noexcept;
+};
@@ -0,0 +1,130 @@
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
+
+#include "CollisionLog.h"
+
+#include <cstring>
+#include <new>
+
+#include "debugOutput.h"
+#include "Trace.h"
+
+CollisionLog::~CollisionLog() { close(); }
+
+bool CollisionLog::open(const char* path) {
+	close();
+	file = fopen(path, "wb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to create collision log " << path << debuglogger::endl; return false; }
+
+	if (chunks.empty()) {
+		try { for (size_t i = 0; i < COLLISION_LOG_CHUNK_COUNT; i++) { chunks.emplace_back(new CollisionLogChunk()); } }
+		catch (const std::bad_alloc&) { chunks.clear(); fclose(file); file = nullptr; debuglogger::out << debuglogger::error << "not enough memory for the collision log's chunks" << debuglogger::endl; return false; }
+	}
+	freeChunks.clear();
+	for (size_t i = 1; i < chunks.size(); i++) { freeChunks.push_back(chunks[i].get()); }
+	fullChunks.clear();
+	currentChunk = chunks[0].get();
+	currentChunk->count = 0;
+	recordingWaits = 0;
+	stopping = false;
+
+	fileOffset = 0;
+	eventCount = 0;
+	index.clear();
+	failed = false;
+	CollisionLogFileHeader header = { };
+	memcpy(header.magic, COLLISION_LOG_MAGIC, sizeof(COLLISION_LOG_MAGIC));
+	header.version = COLLISION_LOG_VERSION;
+	header.columnCount = (uint32_t)CollisionLogColumnId::COUNT;
+	header.columnElementSizes[(size_t)CollisionLogColumnId::TIME] = sizeof(double);
+	for (size_t i = (size_t)CollisionLogColumnId::A; i < (size_t)CollisionLogColumnId::COUNT; i++) { header.columnElementSizes[i] = sizeof(float); }			// uint32_t and float are both 4 bytes.
+	writeBytes(&header, sizeof(header));
+
+	thread = std::thread([this]() { writerLoop(); });
+	return true;
+}
+
+void CollisionLog::submitChunk() {
+	TRACE_SCOPE("collision log submit");
+	std::unique_lock<std::mutex> lock(mutex);
+	fullChunks.push_back(currentChunk);
+	condition.notify_all();
+	if (freeChunks.empty()) {
+		recordingWaits++;
+		condition.wait(lock, [this]() { return !freeChunks.empty(); });
+	}
+	currentChunk = freeChunks.back();
+	freeChunks.pop_back();
+	currentChunk->count = 0;
+}
+
+void CollisionLog::writerLoop() {
+	while (true) {
+		CollisionLogChunk* chunk;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return !fullChunks.empty() || stopping; });
+			if (fullChunks.empty()) { return; }							// Only stops once every submitted chunk is written.
+			chunk = fullChunks.front();
+			fullChunks.pop_front();
+		}
+		writeChunk(*chunk);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			freeChunks.push_back(chunk);
+		}
+		condition.notify_all();
+	}
+}
+
+void CollisionLog::writeChunk(const CollisionLogChunk& chunk) {
+	TRACE_SCOPE("collision log write");
+	size_t count = chunk.count;
+	CollisionLogChunkStats stats = { };
+	stats.minTime = count != 0 ? chunk.time[0] : 0;
+	stats.maxTime = stats.minTime;
+	for (size_t i = 0; i < count; i++) {
+		if (chunk.time[i] < stats.minTime) { stats.minTime = chunk.time[i]; }
+		if (chunk.time[i] > stats.maxTime) { stats.maxTime = chunk.time[i]; }
+		if (chunk.b[i] >= COLLISION_LOG_WALL_Y) { stats.wallCollisions++; }
+		if (chunk.impulse[i] > stats.maxImpulse) { stats.maxImpulse = chunk.impulse[i]; }
+		stats.totalImpulse += chunk.impulse[i];
+	}
+
+	CollisionLogChunkHeader header = { COLLISION_LOG_CHUNK_MARKER, (uint32_t)count, stats };
+	index.push_back({ fileOffset, (uint32_t)count, 0, stats });
+	eventCount += count;
+	writeBytes(&header, sizeof(header));
+	writeBytes(chunk.time, count * sizeof(double));
+	writeBytes(chunk.a, count * sizeof(uint32_t));
+	writeBytes(chunk.b, count * sizeof(uint32_t));
+	for (size_t i = 0; i < 8; i++) { writeBytes(chunk.velocities[i], count * sizeof(float)); }
+	writeBytes(chunk.impulse, count * sizeof(float));
+}
+
+void CollisionLog::writeBytes(const void* data, size_t size) {
+	if (failed || size == 0) { return; }
+	if (fwrite(data, 1, size, file) != size) { failed = true; debuglogger::out << debuglogger::error << "failed to write collision log" << debuglogger::endl; return; }			// Chunks keep getting taken off the queue, but nothing gets written anymore.
+	fileOffset += size;
+}
+
+bool CollisionLog::close() {
+	if (!thread.joinable()) { return !failed; }
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (currentChunk->count != 0) { fullChunks.push_back(currentChunk); }
+		else { freeChunks.push_back(currentChunk); }
+		currentChunk = nullptr;
+		stopping = true;
+	}
+	condition.notify_all();
+	thread.join();
+
+	CollisionLogFooter footer = { fileOffset, index.size(), eventCount, { } };
+	memcpy(footer.magic, COLLISION_LOG_MAGIC, sizeof(COLLISION_LOG_MAGIC));
+	writeBytes(index.data(), index.size() * sizeof(CollisionLogIndexEntry));
+	writeBytes(&footer, sizeof(footer));
+	if (fclose(file) != 0) { failed = true; }
+	file = nullptr;
+	if (failed) { debuglogger::out << debuglogger::error << "collision log is incomplete" << debuglogger::endl; }
+	return !failed;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Collision logs: every collision that the scene reflects, for analysis outside of the simulator. Set Scene::collisionLog to an open CollisionLog and reflectCollision records into it.
+// Layout: a CollisionLogFileHeader, the chunks one after the other, then the chunk index (a CollisionLogIndexEntry per chunk) and a CollisionLogFooter that points to it.
+// A chunk is a CollisionLogChunkHeader followed by its columns (see CollisionLogColumnId), each one holding eventCount values of its type back to back. The statistics in the chunk headers are repeated in the index, so a reader can find the chunks it cares about without touching the rest.
+// Collisions are in the order they got reflected, which is time order, except that the tiled engine logs a whole window's collisions tile by tile once the window has worked out.
+
+#define COLLISION_LOG_MAGIC "PCCOLOG"
+#define COLLISION_LOG_VERSION 1
+#define COLLISION_LOG_CHUNK_MARKER 0x4B4E4843u				// "CHNK"
+#define COLLISION_LOG_CHUNK_EVENTS (1 << 16)
+// Chunks that get allocated up front. If all of them are full and waiting for the writer thread, recording waits for it instead of dropping collisions.
+#define COLLISION_LOG_CHUNK_COUNT 8
+// The b of a collision with the left or right bound, and with the top or bottom bound.
+#define COLLISION_LOG_WALL_X 0xFFFFFFFFu
+#define COLLISION_LOG_WALL_Y 0xFFFFFFFEu
+
+enum class CollisionLogColumnId : uint32_t {
+	TIME,								// double, steps since the scene was created (Scene::stepCount) plus the time inside of the step.
+	A,									// uint32_t
+	B,									// uint32_t, or one of the COLLISION_LOG_WALL ids.
+	A_PRE_VX,							// The rest are floats.
+	A_PRE_VY,
+	A_POST_VX,
+	A_POST_VY,
+	B_PRE_VX,							// Zero for walls.
+	B_PRE_VY,
+	B_POST_VX,
+	B_POST_VY,
+	IMPULSE,							// The magnitude of the impulse on a.
+	COUNT
+};
+
+struct CollisionRecord
+{
+	double time;
+	uint32_t a;
+	uint32_t b;
+	float aPreVX;
+	float aPreVY;
+	float aPostVX;
+	float aPostVY;
+	float bPreVX;
+	float bPreVY;
+	float bPostVX;
+	float bPostVY;
+	float impulse;
+};
+
+struct CollisionLogChunkStats
+{
+	double minTime;
+	double maxTime;
+	double totalImpulse;
+	uint64_t wallCollisions;
+	float maxImpulse;
+	uint32_t reserved;
+};
+
+struct CollisionLogFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t columnCount;
+	uint32_t columnElementSizes[(size_t)CollisionLogColumnId::COUNT];
+};
+
+struct CollisionLogChunkHeader
+{
+	uint32_t marker;
+	uint32_t eventCount;
+	CollisionLogChunkStats stats;
+};
+
+struct CollisionLogIndexEntry
+{
+	uint64_t offset;									// Of the chunk's CollisionLogChunkHeader, from the start of the file.
+	uint32_t eventCount;
+	uint32_t reserved;
+	CollisionLogChunkStats stats;
+};
+
+struct CollisionLogFooter
+{
+	uint64_t indexOffset;
+	uint64_t chunkCount;
+	uint64_t eventCount;
+	char magic[8];
+};
+
+// Columns of up to COLLISION_LOG_CHUNK_EVENTS collisions, the same way they end up in the file.
+struct CollisionLogChunk
+{
+	size_t count = 0;
+	double time[COLLISION_LOG_CHUNK_EVENTS];
+	uint32_t a[COLLISION_LOG_CHUNK_EVENTS];
+	uint32_t b[COLLISION_LOG_CHUNK_EVENTS];
+	float velocities[8][COLLISION_LOG_CHUNK_EVENTS];			// A_PRE_VX to B_POST_VY, in column order.
+	float impulse[COLLISION_LOG_CHUNK_EVENTS];
+};
+
+// Writes a collision log in the background. record only fills in the current chunk, full chunks get handed to the writer thread, which works out their statistics and writes them.
+// Only the thread that steps the scene records (the tiled engine's workers hold on to their collisions until the window is over), so the current chunk doesn't need any locking.
+class CollisionLog
+{
+public:
+	std::vector<std::unique_ptr<CollisionLogChunk>> chunks;
+	std::vector<CollisionLogChunk*> freeChunks;
+	std::deque<CollisionLogChunk*> fullChunks;
+	CollisionLogChunk* currentChunk = nullptr;
+	uint64_t recordingWaits = 0;						// How often record had to wait for the writer thread.
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+
+	// Only touched by the writer thread.
+	FILE* file = nullptr;
+	uint64_t fileOffset = 0;
+	uint64_t eventCount = 0;
+	std::vector<CollisionLogIndexEntry> index;
+	bool failed = false;
+
+	CollisionLog() = default;
+	CollisionLog(const CollisionLog&) = delete;
+	CollisionLog& operator=(const CollisionLog&) = delete;
+	~CollisionLog();
+
+	// Returns false (after logging why) if the file couldn't be created.
+	bool open(const char* path);
+	// Writes what's left, the index and closes the file. Returns false if anything went wrong along the way. Clear Scene::collisionLog before calling this.
+	bool close();
+
+	void record(const CollisionRecord& collision) {
+		CollisionLogChunk& chunk = *currentChunk;
+		size_t i = chunk.count;
+		chunk.time[i] = collision.time;
+		chunk.a[i] = collision.a;
+		chunk.b[i] = collision.b;
+		chunk.velocities[0][i] = collision.aPreVX;
+		chunk.velocities[1][i] = collision.aPreVY;
+		chunk.velocities[2][i] = collision.aPostVX;
+		chunk.velocities[3][i] = collision.aPostVY;
+		chunk.velocities[4][i] = collision.bPreVX;
+		chunk.velocities[5][i] = collision.bPreVY;
+		chunk.velocities[6][i] = collision.bPostVX;
+		chunk.velocities[7][i] = collision.bPostVY;
+		chunk.impulse[i] = collision.impulse;
+		chunk.count = i + 1;
+		if (chunk.count == COLLISION_LOG_CHUNK_EVENTS) { submitChunk(); }
+	}
+
+	void submitChunk();
+	void writerLoop();
+	void writeChunk(const CollisionLogChunk& chunk);
+	void writeBytes(const void* data, size_t size);
+};
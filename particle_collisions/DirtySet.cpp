@@ -0,0 +1,29 @@
+#include "DirtySet.h"
+
+#include <algorithm>
+
+void DirtySet::resize(size_t particleCount) {
+	stamps.resize(particleCount, 0);
+	if (members.capacity() < particleCount) { members.reserve(particleCount > members.capacity() * 2 ? particleCount : members.capacity() * 2); }			// Grows like push_back would, so that inserting particles one at a time doesn't reallocate every time.
+}
+
+void DirtySet::clear() noexcept {
+	members.clear();
+	epoch++;
+	if (epoch == 0) {										// Wrapped around after 4 billion clears, so a very old stamp could accidentally match again.
+		std::fill(stamps.begin(), stamps.end(), 0);
+		epoch = 1;
+	}
+}
+
+bool DirtySet::insert(size_t particleIndex) noexcept {
+	if (stamps[particleIndex] == epoch) { return false; }
+	stamps[particleIndex] = epoch;
+	members.push_back(particleIndex);						// Never reallocates, every particle can only be in here once and resize reserved room for all of them.
+	return true;
+}
+
+const std::vector<size_t>& DirtySet::sort() {
+	std::sort(members.begin(), members.end());
+	return members;
+}
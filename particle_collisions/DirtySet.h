@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set of particle indices that can be added to in O(1) without ever storing an index twice.
+// Every particle gets a stamp that holds the epoch in which it was last added. Clearing the set just starts a new epoch, which makes all the old stamps stale at once without touching them.
+// Memory is fixed at one stamp and one member slot per particle, which resize allocates up front, so adding never allocates.
+class DirtySet
+{
+public:
+	std::vector<uint32_t> stamps;
+	uint32_t epoch = 1;
+	std::vector<size_t> members;						// In insertion order until sort is called.
+
+	// Makes room for particleCount particles. Particles that were in the set before stay in it.
+	void resize(size_t particleCount);
+	void clear() noexcept;
+
+	// Returns false if the particle was already in the set.
+	bool insert(size_t particleIndex) noexcept;
+	bool contains(size_t particleIndex) const noexcept { return stamps[particleIndex] == epoch; }
+
+	size_t size() const noexcept { return members.size(); }
+	bool empty() const noexcept { return members.empty(); }
+
+	// Sorts the members in ascending order and returns them. O(k log k) in the amount of members, the size of the scene doesn't matter.
+	const std::vector<size_t>& sort();
+};
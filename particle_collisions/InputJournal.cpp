@@ -0,0 +1,152 @@
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
+
+#include "InputJournal.h"
+
+#include "Scene.h"
+#include "Checkpoint.h"
+
+#include <cstring>
+
+#include "debugOutput.h"
+
+void applyFrameInput(Scene& scene, const JournalFrameInput& input) {
+	for (size_t i = 0; i < scene.particleCount; i++) {
+		Vector2f diff = Vector2f(input.mouseX, input.mouseY) - scene.particles[i].pos;
+		float length = diff.getLength();
+		if (length < 0.001f) { continue; }
+		scene.particles[i].vel += diff / length * MOUSE_ATTRACTION;
+		scene.particles[i].vel *= MOUSE_VELOCITY_DAMPING;
+	}
+
+	if (input.inputs & JOURNAL_INPUT_ADD_PARTICLE) {
+		Particle particle(Vector2f(input.mouseX, input.mouseY), Vector2f(0, 0), ADDED_PARTICLE_RADIUS, 1);
+		particle.lastInteractionWasIntersection = true;				// It can land on top of other particles, this makes the next step push them apart first.
+		scene.insert(particle);
+	}
+
+	if (input.inputs & JOURNAL_INPUT_RESIZE) { scene.loadSize(input.width, input.height); }
+}
+
+static inline uint64_t mixChecksum(uint64_t hash, uint32_t value) noexcept { return (hash ^ value) * 0x100000001B3ull; }
+
+uint64_t sceneChecksum(const Scene& scene) {
+	const ParticleStore& particles = scene.particles;
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = mixChecksum(hash, (uint32_t)scene.particleCount);
+	for (size_t i = 0; i < scene.particleCount; i++) {
+		uint32_t values[4];
+		memcpy(&values[0], &particles.x[i], sizeof(float));
+		memcpy(&values[1], &particles.y[i], sizeof(float));
+		memcpy(&values[2], &particles.vx[i], sizeof(float));
+		memcpy(&values[3], &particles.vy[i], sizeof(float));
+		for (size_t j = 0; j < 4; j++) { hash = mixChecksum(hash, values[j]); }
+		hash = mixChecksum(hash, particles.flags[i]);
+	}
+	return hash;
+}
+
+JournalSceneSettings sceneSettings(const Scene& scene) {
+	return { (uint32_t)scene.engineMode, (uint32_t)scene.broadPhase, (uint32_t)scene.simdLevel, scene.workers.threadCount(), scene.simultaneousEventTolerance, scene.tileWindowReach };
+}
+
+void applySceneSettings(Scene& scene, const JournalSceneSettings& settings, unsigned int threadCount) {
+	scene.engineMode = (EngineMode)settings.engineMode;
+	scene.broadPhase = (BroadPhase)settings.broadPhase;
+	SimdLevel simdLevel = (SimdLevel)settings.simdLevel;
+	scene.simdLevel = simdLevel < detectSimdLevel() ? simdLevel : detectSimdLevel();
+	scene.simultaneousEventTolerance = settings.simultaneousEventTolerance;
+	scene.tileWindowReach = settings.tileWindowReach;
+	if (threadCount == 0) { threadCount = settings.threadCount; }
+	if (threadCount != scene.workers.threadCount()) { scene.setThreadCount(threadCount, false); }
+}
+
+InputJournal::~InputJournal() { close(); }
+
+bool InputJournal::open(const char* path, uint32_t seed, const Scene& scene) {
+	close();
+	file = fopen(path, "wb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to create input journal " << path << debuglogger::endl; return false; }
+	failed = false;
+	frameCount = 0;
+
+	JournalHeader header = { };
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	header.version = JOURNAL_VERSION;
+	header.seed = seed;
+	writeBytes(&header, sizeof(header));
+	recordScene(scene);
+	return !failed;
+}
+
+void InputJournal::recordScene(const Scene& scene) {
+	if (file == nullptr) { return; }
+	JournalRecordType type = JournalRecordType::SCENE;
+	JournalSceneSettings settings = sceneSettings(scene);
+	writeBytes(&type, sizeof(type));
+	writeBytes(&settings, sizeof(settings));
+
+	CheckpointSnapshot snapshot;
+	snapshot.take(scene);
+	if (!failed && !writeCheckpoint(snapshot, file)) { failed = true; debuglogger::out << debuglogger::error << "failed to write input journal" << debuglogger::endl; }
+	fflush(file);
+}
+
+void InputJournal::recordFrame(const JournalFrameInput& input, const Scene& scene) {
+	if (file == nullptr) { return; }
+	JournalRecordType type = JournalRecordType::FRAME;
+	JournalFrameInput frame = input;
+	frame.checksum = checksums ? sceneChecksum(scene) : 0;
+	writeBytes(&type, sizeof(type));
+	writeBytes(&frame, sizeof(frame));
+	if (++frameCount % JOURNAL_FLUSH_INTERVAL == 0) { fflush(file); }
+}
+
+void InputJournal::writeBytes(const void* data, size_t size) {
+	if (failed) { return; }
+	if (fwrite(data, 1, size, file) != size) { failed = true; debuglogger::out << debuglogger::error << "failed to write input journal" << debuglogger::endl; }			// The rest of the run doesn't get recorded, a journal with a gap in it couldn't be replayed anyway.
+}
+
+bool InputJournal::close() {
+	if (file == nullptr) { return !failed; }
+	if (fclose(file) != 0) { failed = true; }
+	file = nullptr;
+	return !failed;
+}
+
+JournalReader::~JournalReader() { close(); }
+
+bool JournalReader::open(const char* path) {
+	close();
+	file = fopen(path, "rb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to open input journal " << path << debuglogger::endl; return false; }
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.version != JOURNAL_VERSION) {
+		debuglogger::out << debuglogger::error << path << " isn't an input journal this version can read" << debuglogger::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void JournalReader::close() {
+	if (file != nullptr) { fclose(file); }
+	file = nullptr;
+}
+
+bool JournalReader::next(Scene& scene, JournalRecordType& type, JournalFrameInput& frame) {
+	if (fread(&type, sizeof(type), 1, file) != 1) { return false; }						// The end, or a record that only got written halfway, which looks the same after a crash.
+	if (type == JournalRecordType::FRAME) { return fread(&frame, sizeof(frame), 1, file) == 1; }
+	if (type != JournalRecordType::SCENE) { debuglogger::out << debuglogger::error << "input journal has a damaged record" << debuglogger::endl; return false; }
+
+	JournalSceneSettings settings;
+	CheckpointHeader checkpointHeader;
+	if (fread(&settings, sizeof(settings), 1, file) != 1 || fread(&checkpointHeader, sizeof(checkpointHeader), 1, file) != 1) { return false; }
+	if (checkpointHeader.fileSize < sizeof(checkpointHeader)) { debuglogger::out << debuglogger::error << "input journal has a damaged scene" << debuglogger::endl; return false; }
+	try { checkpoint.resize((size_t)checkpointHeader.fileSize); }
+	catch (...) { debuglogger::out << debuglogger::error << "input journal has a damaged scene" << debuglogger::endl; return false; }
+	memcpy(checkpoint.data(), &checkpointHeader, sizeof(checkpointHeader));
+	size_t rest = checkpoint.size() - sizeof(checkpointHeader);
+	if (fread(checkpoint.data() + sizeof(checkpointHeader), 1, rest, file) != rest) { return false; }
+	if (!loadCheckpoint(scene, checkpoint.data(), checkpoint.size())) { return false; }
+	applySceneSettings(scene, settings, threadCount);
+	return true;
+}
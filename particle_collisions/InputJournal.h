@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class Scene;
+
+// Input journals: everything from outside that changes a Scene, so that a run can be replayed exactly (see particle_collisions_replay).
+// Layout: a JournalHeader, then records, each a uint32_t JournalRecordType followed by its payload:
+//   SCENE: a JournalSceneSettings and a complete checkpoint (see Checkpoint.h), which replaces the scene. The first record is always one of these, later ones come from loading checkpoints.
+//   FRAME: a JournalFrameInput. A frame is one Scene::step followed by applyFrameInput.
+// Replaying gives bit for bit the same scene as long as the replayer is built with the same compiler and floating point settings, which the checksums in the frames check.
+
+#define JOURNAL_MAGIC "PCJRNL1"
+#define JOURNAL_VERSION 1
+#define JOURNAL_FLUSH_INTERVAL 60						// Frames between flushes, so that a crash loses at most this many frames.
+
+// Bits of JournalFrameInput::inputs.
+#define JOURNAL_INPUT_ADD_PARTICLE 1
+#define JOURNAL_INPUT_RESIZE 2
+
+// What the mouse does to the particles every frame.
+#define MOUSE_ATTRACTION 0.01f
+#define MOUSE_VELOCITY_DAMPING 0.995f
+#define ADDED_PARTICLE_RADIUS 20
+
+enum class JournalRecordType : uint32_t {
+	SCENE,
+	FRAME
+};
+
+struct JournalHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t seed;										// What the initial scene was generated with. Only informational, the scene itself is in the first record.
+};
+
+// Everything that changes what Scene::step does, but isn't part of a checkpoint.
+struct JournalSceneSettings
+{
+	uint32_t engineMode;
+	uint32_t broadPhase;
+	uint32_t simdLevel;
+	uint32_t threadCount;
+	float simultaneousEventTolerance;
+	float tileWindowReach;
+};
+
+struct JournalFrameInput
+{
+	int32_t mouseX;
+	int32_t mouseY;
+	uint32_t inputs;
+	uint32_t width;										// Only used with JOURNAL_INPUT_RESIZE.
+	uint32_t height;
+	uint32_t reserved;
+	uint64_t checksum;									// sceneChecksum after the frame, 0 if the writer didn't compute them.
+};
+
+// Lock-free hand-off of the window's input to the thread that steps the scene. The window's thread writes, the stepping thread takes a JournalFrameInput every frame.
+class FrameInputChannel
+{
+public:
+	std::atomic<uint64_t> mouse { 0 };						// x in the low half, y in the high half, so both always change together.
+	std::atomic<uint32_t> pendingParticles { 0 };
+
+	void moveMouse(int32_t x, int32_t y) noexcept { mouse.store((uint32_t)x | (uint64_t)(uint32_t)y << 32, std::memory_order_relaxed); }
+	void addParticle() noexcept { pendingParticles.fetch_add(1, std::memory_order_relaxed); }
+
+	// Takes at most one of the pending particles, so clicks that come in faster than frames still add one particle each, one frame after the other.
+	JournalFrameInput take() noexcept {
+		uint64_t position = mouse.load(std::memory_order_relaxed);
+		JournalFrameInput input = { (int32_t)(uint32_t)position, (int32_t)(uint32_t)(position >> 32), 0, 0, 0, 0, 0 };
+		if (pendingParticles.load(std::memory_order_relaxed) != 0) {			// Only this thread takes particles away, so the count can't drop to 0 in between.
+			pendingParticles.fetch_sub(1, std::memory_order_relaxed);
+			input.inputs |= JOURNAL_INPUT_ADD_PARTICLE;
+		}
+		return input;
+	}
+};
+
+// Applies everything that the window does to the scene after every step: the pull towards the mouse, adding a particle at the mouse and resizing.
+void applyFrameInput(Scene& scene, const JournalFrameInput& input);
+
+// Hash of the positions, velocities and flags of every particle. Only meant for telling two runs apart.
+uint64_t sceneChecksum(const Scene& scene);
+
+JournalSceneSettings sceneSettings(const Scene& scene);
+// threadCount overrides the recorded thread count unless it's 0. Only the event-driven engines are guaranteed to give the same results with other thread counts, the sub-step engine's parallel search handles intersections differently.
+// The SIMD kernels are bit-identical to the scalar path (see PairKernel.h), so the SIMD level doesn't change the results. The recorded one still gets used so a replay profiles the same kernels, capped to what the machine supports.
+void applySceneSettings(Scene& scene, const JournalSceneSettings& settings, unsigned int threadCount);
+
+class InputJournal
+{
+public:
+	FILE* file = nullptr;
+	bool checksums = true;								// Costs a pass over the particles every frame.
+	uint64_t frameCount = 0;
+	bool failed = false;
+
+	InputJournal() = default;
+	InputJournal(const InputJournal&) = delete;
+	InputJournal& operator=(const InputJournal&) = delete;
+	~InputJournal();
+
+	// Returns false (after logging why) if the file couldn't be created. The scene gets recorded right away, as the initial scene.
+	bool open(const char* path, uint32_t seed, const Scene& scene);
+	void recordScene(const Scene& scene);
+	// Call right after applying the input to the scene.
+	void recordFrame(const JournalFrameInput& input, const Scene& scene);
+	bool close();
+
+	void writeBytes(const void* data, size_t size);
+};
+
+class JournalReader
+{
+public:
+	FILE* file = nullptr;
+	JournalHeader header;
+	unsigned int threadCount = 0;						// Thread count for the scenes, 0 uses the recorded ones.
+	std::vector<uint8_t> checkpoint;
+
+	JournalReader() = default;
+	JournalReader(const JournalReader&) = delete;
+	JournalReader& operator=(const JournalReader&) = delete;
+	~JournalReader();
+
+	// Returns false (after logging why) if the file isn't a journal.
+	bool open(const char* path);
+	void close();
+
+	// Reads the next record. Scene records get applied to scene right away, frame records get returned in frame. Returns false at the end of the journal, or (after logging why) at a damaged record.
+	bool next(Scene& scene, JournalRecordType& type, JournalFrameInput& frame);
+};
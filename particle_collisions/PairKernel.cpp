@@ -0,0 +1,93 @@
+#include "PairKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PAIR_KERNEL_X86
+#endif
+
+#ifdef PAIR_KERNEL_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+static void cpuid(int info[4], int leaf, int subleaf) noexcept { __cpuidex(info, leaf, subleaf); }
+static unsigned long long readEnabledRegisterState() noexcept { return _xgetbv(0); }
+#else
+#include <cpuid.h>
+static void cpuid(int info[4], int leaf, int subleaf) noexcept { __cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]); }
+static unsigned long long readEnabledRegisterState() noexcept { unsigned int low, high; __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0)); return ((unsigned long long)high << 32) | low; }
+#endif
+
+static SimdLevel queryCPU() noexcept {
+	int info[4];
+	cpuid(info, 0, 0);
+	int highestLeaf = info[0];
+
+	cpuid(info, 1, 0);
+	if (!(info[3] & (1 << 26))) { return SimdLevel::SCALAR; }						// SSE2, which every x64 CPU has, but 32-bit builds can still end up on something older.
+	bool osSavesRegisters = (info[2] & (1 << 27)) != 0;								// OSXSAVE, without it xgetbv can't be used.
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+	if (!osSavesRegisters || !hasAVX || highestLeaf < 7) { return SimdLevel::SSE2; }
+
+	unsigned long long registerState = readEnabledRegisterState();
+	if ((registerState & 0x6) != 0x6) { return SimdLevel::SSE2; }					// XMM and YMM state.
+
+	cpuid(info, 7, 0);
+	bool hasAVX2 = (info[1] & (1 << 5)) != 0;
+	bool hasAVX512F = (info[1] & (1 << 16)) != 0;
+	if (hasAVX512F && hasAVX2 && (registerState & 0xE6) == 0xE6) { return SimdLevel::AVX512; }			// Opmask and both halves of the ZMM state on top.
+	if (hasAVX2) { return SimdLevel::AVX2; }
+	return SimdLevel::SSE2;
+}
+#endif
+
+SimdLevel detectSimdLevel() noexcept {
+#ifdef PAIR_KERNEL_X86
+	static const SimdLevel level = queryCPU();
+	return level;
+#else
+	return SimdLevel::SCALAR;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) noexcept {
+	switch (level) {
+	case SimdLevel::SSE2: return "SSE2";
+	case SimdLevel::AVX2: return "AVX2";
+	case SimdLevel::AVX512: return "AVX-512";
+	default: return "scalar";
+	}
+}
+
+void scanPairs(SimdLevel level, const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept {
+	switch (level) {
+#ifdef PAIR_KERNEL_X86
+	case SimdLevel::SSE2: scanPairsSSE2(alpha, betas, lowestT, result, collector); return;
+	case SimdLevel::AVX2: scanPairsAVX2(alpha, betas, lowestT, result, collector); return;
+	case SimdLevel::AVX512: scanPairsAVX512(alpha, betas, lowestT, result, collector); return;
+#endif
+	default: result.found = false; result.forced = false; return;				// Scene never calls this with SCALAR, it does the scalar scan itself.
+	}
+}
+
+void foldPairScanLanes(const float* laneT, const int32_t* laneIndex, const int32_t* laneLastOverlap, unsigned int lanes, float lowestT, PairScanResult& result) noexcept {
+	int32_t lastOverlap = -1;
+	for (unsigned int i = 0; i < lanes; i++) { if (laneLastOverlap[i] > lastOverlap) { lastOverlap = laneLastOverlap[i]; } }
+	if (lastOverlap != -1) {
+		result.found = true;
+		result.forced = true;
+		result.index = (size_t)lastOverlap;
+		result.t = 0;
+		return;
+	}
+
+	result.found = false;
+	result.forced = false;
+	float bestT = lowestT;
+	int32_t bestIndex = -1;
+	for (unsigned int i = 0; i < lanes; i++) {
+		if (laneIndex[i] == -1) { continue; }
+		if (laneT[i] < bestT || (laneT[i] == bestT && laneIndex[i] < bestIndex)) { bestT = laneT[i]; bestIndex = laneIndex[i]; }
+	}
+	if (bestIndex == -1) { return; }
+	result.found = true;
+	result.index = (size_t)bestIndex;
+	result.t = bestT;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Instruction sets that the vectorized pair scan can run on. SCALAR means the scan isn't vectorized at all and Scene uses findCollision one pair at a time, same as before the kernels existed.
+enum class SimdLevel {
+	SCALAR,
+	SSE2,								// 4 pairs per instruction.
+	AVX2,								// 8 pairs per instruction.
+	AVX512								// 16 pairs per instruction.
+};
+
+// The best instruction set that both the CPU and the OS support (the OS has to save the wider registers on context switches). Only checks once, the result is cached.
+SimdLevel detectSimdLevel() noexcept;
+const char* simdLevelName(SimdLevel level) noexcept;
+
+// Everything about the alpha particle that the scan needs.
+struct PairScanAlpha
+{
+	float x;
+	float y;
+	float vx;
+	float vy;
+	float radius;
+	float remainingVx;					// The velocity scaled by the sub-step, same as remainingAlphaVel in Scene::findCollision.
+	float remainingVy;
+	float subStep;
+};
+
+// Structure-of-arrays view of the betas to scan. The arrays have to stay readable for 16 floats past count, because the SSE2 and AVX2 kernels load whole registers and mask the extra lanes off afterwards (ParticleStore pads its arrays for exactly this reason).
+struct PairScanBetas
+{
+	const float* x;
+	const float* y;
+	const float* vx;
+	const float* vy;
+	const float* radius;
+	size_t count;
+};
+
+struct PairScanResult
+{
+	bool found;							// False if none of the betas has a collision that is earlier than lowestT (and none of them are overlapping).
+	bool forced;						// True if the result is an overlapping pair, which has to be handled as a collision at t = 0 no matter what lowestT is.
+	size_t index;						// Index into the betas.
+	float t;
+};
+
+struct PairScanCandidate
+{
+	float t;
+	uint32_t index;						// Index into the betas.
+};
+
+// Optional output of a scan: every collision with a t-value of at most limit gets written into candidates, whether it's the earliest one or not. Scene uses this to find events that happen (almost) at the same time, see Scene::reflectSimultaneousEvents.
+// candidates has to have room for one entry per beta. The kernels only ever append, count is not reset.
+struct PairScanCollector
+{
+	float limit;
+	PairScanCandidate* candidates;
+	size_t count;
+};
+
+// Runs the same math as Scene::predictCollision for alpha against every beta and returns exactly the collision that calling Scene::findCollision on the betas in order would have ended up with, starting from the given lowestT:
+// The last overlapping beta if there is one (every overlap replaces the previous one), otherwise the earliest collision below lowestT, where ties go to the lowest index.
+// NOTE: Every operation is the same IEEE single precision operation the scalar code does, in the same order, so the t-values are bit-identical to the scalar ones. That only holds as long as the compiler doesn't contract the multiplies and adds into FMAs, see the kernel files.
+// collector can be null.
+void scanPairs(SimdLevel level, const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept;
+
+void scanPairsSSE2(const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept;
+void scanPairsAVX2(const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept;
+void scanPairsAVX512(const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept;
+
+// Combines the per-lane results of a kernel into the final result. Every lane holds the earliest collision it has seen (first one on ties, since a lane sees its betas in ascending order) and the last overlap it has seen (-1 if none).
+void foldPairScanLanes(const float* laneT, const int32_t* laneIndex, const int32_t* laneLastOverlap, unsigned int lanes, float lowestT, PairScanResult& result) noexcept;
@@ -0,0 +1,109 @@
+#include "PairKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+// The target is only enabled for this file, the rest of the program has to keep running on CPUs without AVX2. Which kernel runs gets decided at runtime (see detectSimdLevel). In the project file, this file is compiled with /arch:AVX2 for the same reason.
+// NOTE: FMA is deliberately left out of the target, see the note in PairKernelSSE2.cpp.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include <immintrin.h>
+
+#define LANES 8
+
+static inline __m256i select(__m256 mask, __m256i a, __m256i b) noexcept { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), mask)); }
+
+void scanPairsAVX2(const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 alphaX = _mm256_set1_ps(alpha.x);
+	const __m256 alphaY = _mm256_set1_ps(alpha.y);
+	const __m256 alphaVx = _mm256_set1_ps(alpha.vx);
+	const __m256 alphaVy = _mm256_set1_ps(alpha.vy);
+	const __m256 alphaRadius = _mm256_set1_ps(alpha.radius);
+	const __m256 remainingAlphaVx = _mm256_set1_ps(alpha.remainingVx);
+	const __m256 remainingAlphaVy = _mm256_set1_ps(alpha.remainingVy);
+	const __m256 subStep = _mm256_set1_ps(alpha.subStep);
+	const __m256i laneStep = _mm256_set1_epi32(LANES);
+	const __m256i count = _mm256_set1_epi32((int32_t)betas.count);
+
+	const __m256 collectLimit = _mm256_set1_ps(collector != nullptr ? collector->limit : 0);
+	__m256 bestT = _mm256_set1_ps(lowestT);
+	__m256i bestIndex = _mm256_set1_epi32(-1);
+	__m256i lastOverlap = _mm256_set1_epi32(-1);
+	__m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (size_t j = 0; j < betas.count; j += LANES, index = _mm256_add_epi32(index, laneStep)) {
+		__m256 inRange = _mm256_castsi256_ps(_mm256_cmpgt_epi32(count, index));
+
+		// Same steps as Scene::predictCollision, see there for what they mean.
+		__m256 dx = _mm256_sub_ps(alphaX, _mm256_loadu_ps(betas.x + j));
+		__m256 dy = _mm256_sub_ps(alphaY, _mm256_loadu_ps(betas.y + j));
+		__m256 betaVx = _mm256_loadu_ps(betas.vx + j);
+		__m256 betaVy = _mm256_loadu_ps(betas.vy + j);
+		__m256 squaredDistance = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 distance = _mm256_sqrt_ps(squaredDistance);
+		__m256 normalX = _mm256_div_ps(dx, distance);
+		__m256 normalY = _mm256_div_ps(dy, distance);
+		__m256 alphaVelTowardsComp = _mm256_add_ps(_mm256_mul_ps(alphaVx, normalX), _mm256_mul_ps(alphaVy, normalY));
+		__m256 betaVelTowardsComp = _mm256_add_ps(_mm256_mul_ps(betaVx, normalX), _mm256_mul_ps(betaVy, normalY));
+		__m256 valid = _mm256_and_ps(inRange, _mm256_cmp_ps(alphaVelTowardsComp, betaVelTowardsComp, _CMP_NGE_UQ));		// NGE_UQ is true for NaN, same as the scalar early-out not being taken for NaN.
+
+		__m256 velDiffX = _mm256_sub_ps(remainingAlphaVx, _mm256_mul_ps(betaVx, subStep));
+		__m256 velDiffY = _mm256_sub_ps(remainingAlphaVy, _mm256_mul_ps(betaVy, subStep));
+		__m256 a = _mm256_add_ps(_mm256_mul_ps(velDiffX, velDiffX), _mm256_mul_ps(velDiffY, velDiffY));
+		__m256 b = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(velDiffX, dx), _mm256_mul_ps(velDiffY, dy)), a);
+		__m256 minDist = _mm256_add_ps(alphaRadius, _mm256_loadu_ps(betas.radius + j));
+		__m256 c = _mm256_div_ps(_mm256_sub_ps(squaredDistance, _mm256_mul_ps(minDist, minDist)), a);
+		__m256 r = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(r, zero, _CMP_NLT_UQ));
+		if (_mm256_movemask_ps(valid) == 0) { continue; }
+
+		r = _mm256_sqrt_ps(r);
+		b = _mm256_xor_ps(b, signBit);
+		__m256 t1 = _mm256_add_ps(b, r);
+		__m256 t2 = _mm256_sub_ps(b, r);
+		__m256 t1First = _mm256_cmp_ps(t1, t2, _CMP_LT_OQ);
+		__m256 t = _mm256_blendv_ps(t2, t1, t1First);
+		__m256 otherT = _mm256_blendv_ps(t1, t2, t1First);
+		__m256 negative = _mm256_cmp_ps(t, zero, _CMP_LT_OQ);
+
+		__m256 overlapping = _mm256_and_ps(valid, _mm256_and_ps(negative, _mm256_cmp_ps(otherT, zero, _CMP_GT_OQ)));
+		lastOverlap = select(overlapping, index, lastOverlap);
+
+		__m256 collision = _mm256_andnot_ps(negative, valid);
+		if (collector != nullptr) {
+			int collected = _mm256_movemask_ps(_mm256_and_ps(collision, _mm256_cmp_ps(t, collectLimit, _CMP_LE_OQ)));
+			if (collected != 0) {																			// Rare, so the lanes just get picked out one by one.
+				alignas(32) float laneT[LANES];
+				_mm256_store_ps(laneT, t);
+				for (unsigned int lane = 0; lane < LANES; lane++) { if (collected & (1 << lane)) { collector->candidates[collector->count++] = { laneT[lane], (uint32_t)(j + lane) }; } }
+			}
+		}
+
+		__m256 earlier = _mm256_and_ps(collision, _mm256_cmp_ps(t, bestT, _CMP_LT_OQ));
+		bestT = _mm256_blendv_ps(bestT, t, earlier);
+		bestIndex = select(earlier, index, bestIndex);
+	}
+
+	alignas(32) float laneT[LANES];
+	alignas(32) int32_t laneIndex[LANES];
+	alignas(32) int32_t laneLastOverlap[LANES];
+	_mm256_store_ps(laneT, bestT);
+	_mm256_store_si256((__m256i*)laneIndex, bestIndex);
+	_mm256_store_si256((__m256i*)laneLastOverlap, lastOverlap);
+	foldPairScanLanes(laneT, laneIndex, laneLastOverlap, LANES, lowestT, result);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+#include "PairKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+// Same deal as in PairKernelAVX2.cpp, only this file gets the AVX-512 target (/arch:AVX512 in the project file).
+// NOTE: AVX-512F includes 512-bit FMAs, so turning contraction off really matters here, see the note in PairKernelSSE2.cpp.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include <immintrin.h>
+
+#define LANES 16
+
+void scanPairsAVX512(const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512i signBit = _mm512_set1_epi32((int32_t)0x80000000);
+	const __m512 alphaX = _mm512_set1_ps(alpha.x);
+	const __m512 alphaY = _mm512_set1_ps(alpha.y);
+	const __m512 alphaVx = _mm512_set1_ps(alpha.vx);
+	const __m512 alphaVy = _mm512_set1_ps(alpha.vy);
+	const __m512 alphaRadius = _mm512_set1_ps(alpha.radius);
+	const __m512 remainingAlphaVx = _mm512_set1_ps(alpha.remainingVx);
+	const __m512 remainingAlphaVy = _mm512_set1_ps(alpha.remainingVy);
+	const __m512 subStep = _mm512_set1_ps(alpha.subStep);
+	const __m512i laneStep = _mm512_set1_epi32(LANES);
+
+	const __m512 collectLimit = _mm512_set1_ps(collector != nullptr ? collector->limit : 0);
+	__m512 bestT = _mm512_set1_ps(lowestT);
+	__m512i bestIndex = _mm512_set1_epi32(-1);
+	__m512i lastOverlap = _mm512_set1_epi32(-1);
+	__m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+	for (size_t j = 0; j < betas.count; j += LANES, index = _mm512_add_epi32(index, laneStep)) {
+		size_t remaining = betas.count - j;
+		__mmask16 inRange = remaining >= LANES ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1);			// Masked loads, so unlike the other kernels, this one never reads past the end.
+
+		// Same steps as Scene::predictCollision, see there for what they mean.
+		__m512 dx = _mm512_sub_ps(alphaX, _mm512_maskz_loadu_ps(inRange, betas.x + j));
+		__m512 dy = _mm512_sub_ps(alphaY, _mm512_maskz_loadu_ps(inRange, betas.y + j));
+		__m512 betaVx = _mm512_maskz_loadu_ps(inRange, betas.vx + j);
+		__m512 betaVy = _mm512_maskz_loadu_ps(inRange, betas.vy + j);
+		__m512 squaredDistance = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+		__m512 distance = _mm512_sqrt_ps(squaredDistance);
+		__m512 normalX = _mm512_div_ps(dx, distance);
+		__m512 normalY = _mm512_div_ps(dy, distance);
+		__m512 alphaVelTowardsComp = _mm512_add_ps(_mm512_mul_ps(alphaVx, normalX), _mm512_mul_ps(alphaVy, normalY));
+		__m512 betaVelTowardsComp = _mm512_add_ps(_mm512_mul_ps(betaVx, normalX), _mm512_mul_ps(betaVy, normalY));
+		__mmask16 valid = _mm512_mask_cmp_ps_mask(inRange, alphaVelTowardsComp, betaVelTowardsComp, _CMP_NGE_UQ);		// NGE_UQ is true for NaN, same as the scalar early-out not being taken for NaN.
+
+		__m512 velDiffX = _mm512_sub_ps(remainingAlphaVx, _mm512_mul_ps(betaVx, subStep));
+		__m512 velDiffY = _mm512_sub_ps(remainingAlphaVy, _mm512_mul_ps(betaVy, subStep));
+		__m512 a = _mm512_add_ps(_mm512_mul_ps(velDiffX, velDiffX), _mm512_mul_ps(velDiffY, velDiffY));
+		__m512 b = _mm512_div_ps(_mm512_add_ps(_mm512_mul_ps(velDiffX, dx), _mm512_mul_ps(velDiffY, dy)), a);
+		__m512 minDist = _mm512_add_ps(alphaRadius, _mm512_maskz_loadu_ps(inRange, betas.radius + j));
+		__m512 c = _mm512_div_ps(_mm512_sub_ps(squaredDistance, _mm512_mul_ps(minDist, minDist)), a);
+		__m512 r = _mm512_sub_ps(_mm512_mul_ps(b, b), c);
+		valid = _mm512_mask_cmp_ps_mask(valid, r, zero, _CMP_NLT_UQ);
+		if (valid == 0) { continue; }
+
+		r = _mm512_sqrt_ps(r);
+		b = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(b), signBit));			// Flipping the sign bit instead of subtracting from 0 keeps the sign of zeros the same as in the scalar code. (_mm512_xor_ps needs AVX-512DQ.)
+		__m512 t1 = _mm512_add_ps(b, r);
+		__m512 t2 = _mm512_sub_ps(b, r);
+		__mmask16 t1First = _mm512_cmp_ps_mask(t1, t2, _CMP_LT_OQ);
+		__m512 t = _mm512_mask_blend_ps(t1First, t2, t1);
+		__m512 otherT = _mm512_mask_blend_ps(t1First, t1, t2);
+		__mmask16 negative = _mm512_cmp_ps_mask(t, zero, _CMP_LT_OQ);
+
+		__mmask16 overlapping = _mm512_mask_cmp_ps_mask(valid & negative, otherT, zero, _CMP_GT_OQ);
+		lastOverlap = _mm512_mask_blend_epi32(overlapping, lastOverlap, index);
+
+		__mmask16 collision = valid & (__mmask16)~negative;
+		if (collector != nullptr) {
+			__mmask16 collected = _mm512_mask_cmp_ps_mask(collision, t, collectLimit, _CMP_LE_OQ);
+			if (collected != 0) {																			// Rare, so the lanes just get picked out one by one.
+				alignas(64) float laneT[LANES];
+				_mm512_store_ps(laneT, t);
+				for (unsigned int lane = 0; lane < LANES; lane++) { if (collected & (1 << lane)) { collector->candidates[collector->count++] = { laneT[lane], (uint32_t)(j + lane) }; } }
+			}
+		}
+
+		__mmask16 earlier = _mm512_mask_cmp_ps_mask(collision, t, bestT, _CMP_LT_OQ);
+		bestT = _mm512_mask_blend_ps(earlier, bestT, t);
+		bestIndex = _mm512_mask_blend_epi32(earlier, bestIndex, index);
+	}
+
+	alignas(64) float laneT[LANES];
+	alignas(64) int32_t laneIndex[LANES];
+	alignas(64) int32_t laneLastOverlap[LANES];
+	_mm512_store_ps(laneT, bestT);
+	_mm512_store_si512(laneIndex, bestIndex);
+	_mm512_store_si512(laneLastOverlap, lastOverlap);
+	foldPairScanLanes(laneT, laneIndex, laneLastOverlap, LANES, lowestT, result);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
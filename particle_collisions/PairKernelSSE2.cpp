@@ -0,0 +1,101 @@
+#include "PairKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+// NOTE: GCC contracts multiplies and adds into FMAs by default whenever the target has them, and older MSVC versions do the same under /arch:AVX2, which would change the rounding and break the bit-exactness with the scalar code. Every kernel file turns that off explicitly.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include <emmintrin.h>
+
+#define LANES 4
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b) noexcept { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }				// No blendv before SSE4.1.
+static inline __m128i select(__m128 mask, __m128i a, __m128i b) noexcept { __m128i m = _mm_castps_si128(mask); return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+
+void scanPairsSSE2(const PairScanAlpha& alpha, const PairScanBetas& betas, float lowestT, PairScanResult& result, PairScanCollector* collector) noexcept {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 alphaX = _mm_set1_ps(alpha.x);
+	const __m128 alphaY = _mm_set1_ps(alpha.y);
+	const __m128 alphaVx = _mm_set1_ps(alpha.vx);
+	const __m128 alphaVy = _mm_set1_ps(alpha.vy);
+	const __m128 alphaRadius = _mm_set1_ps(alpha.radius);
+	const __m128 remainingAlphaVx = _mm_set1_ps(alpha.remainingVx);
+	const __m128 remainingAlphaVy = _mm_set1_ps(alpha.remainingVy);
+	const __m128 subStep = _mm_set1_ps(alpha.subStep);
+	const __m128i laneStep = _mm_set1_epi32(LANES);
+	const __m128i count = _mm_set1_epi32((int32_t)betas.count);
+
+	const __m128 collectLimit = _mm_set1_ps(collector != nullptr ? collector->limit : 0);
+	__m128 bestT = _mm_set1_ps(lowestT);
+	__m128i bestIndex = _mm_set1_epi32(-1);
+	__m128i lastOverlap = _mm_set1_epi32(-1);
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+
+	for (size_t j = 0; j < betas.count; j += LANES, index = _mm_add_epi32(index, laneStep)) {
+		__m128 inRange = _mm_castsi128_ps(_mm_cmplt_epi32(index, count));
+
+		// Same steps as Scene::predictCollision, see there for what they mean.
+		__m128 dx = _mm_sub_ps(alphaX, _mm_loadu_ps(betas.x + j));
+		__m128 dy = _mm_sub_ps(alphaY, _mm_loadu_ps(betas.y + j));
+		__m128 betaVx = _mm_loadu_ps(betas.vx + j);
+		__m128 betaVy = _mm_loadu_ps(betas.vy + j);
+		__m128 squaredDistance = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128 distance = _mm_sqrt_ps(squaredDistance);
+		__m128 normalX = _mm_div_ps(dx, distance);
+		__m128 normalY = _mm_div_ps(dy, distance);
+		__m128 alphaVelTowardsComp = _mm_add_ps(_mm_mul_ps(alphaVx, normalX), _mm_mul_ps(alphaVy, normalY));
+		__m128 betaVelTowardsComp = _mm_add_ps(_mm_mul_ps(betaVx, normalX), _mm_mul_ps(betaVy, normalY));
+		__m128 valid = _mm_and_ps(inRange, _mm_cmpnge_ps(alphaVelTowardsComp, betaVelTowardsComp));		// cmpnge is true for NaN, same as the scalar early-out not being taken for NaN.
+
+		__m128 velDiffX = _mm_sub_ps(remainingAlphaVx, _mm_mul_ps(betaVx, subStep));
+		__m128 velDiffY = _mm_sub_ps(remainingAlphaVy, _mm_mul_ps(betaVy, subStep));
+		__m128 a = _mm_add_ps(_mm_mul_ps(velDiffX, velDiffX), _mm_mul_ps(velDiffY, velDiffY));
+		__m128 b = _mm_div_ps(_mm_add_ps(_mm_mul_ps(velDiffX, dx), _mm_mul_ps(velDiffY, dy)), a);
+		__m128 minDist = _mm_add_ps(alphaRadius, _mm_loadu_ps(betas.radius + j));
+		__m128 c = _mm_div_ps(_mm_sub_ps(squaredDistance, _mm_mul_ps(minDist, minDist)), a);
+		__m128 r = _mm_sub_ps(_mm_mul_ps(b, b), c);
+		valid = _mm_and_ps(valid, _mm_cmpnlt_ps(r, zero));
+		if (_mm_movemask_ps(valid) == 0) { continue; }
+
+		r = _mm_sqrt_ps(r);
+		b = _mm_xor_ps(b, signBit);
+		__m128 t1 = _mm_add_ps(b, r);
+		__m128 t2 = _mm_sub_ps(b, r);
+		__m128 t1First = _mm_cmplt_ps(t1, t2);
+		__m128 t = select(t1First, t1, t2);
+		__m128 otherT = select(t1First, t2, t1);
+		__m128 negative = _mm_cmplt_ps(t, zero);
+
+		__m128 overlapping = _mm_and_ps(valid, _mm_and_ps(negative, _mm_cmpgt_ps(otherT, zero)));
+		lastOverlap = select(overlapping, index, lastOverlap);
+
+		__m128 collision = _mm_andnot_ps(negative, valid);
+		if (collector != nullptr) {
+			int collected = _mm_movemask_ps(_mm_and_ps(collision, _mm_cmple_ps(t, collectLimit)));
+			if (collected != 0) {																			// Rare, so the lanes just get picked out one by one.
+				alignas(16) float laneT[LANES];
+				_mm_store_ps(laneT, t);
+				for (unsigned int lane = 0; lane < LANES; lane++) { if (collected & (1 << lane)) { collector->candidates[collector->count++] = { laneT[lane], (uint32_t)(j + lane) }; } }
+			}
+		}
+
+		__m128 earlier = _mm_and_ps(collision, _mm_cmplt_ps(t, bestT));
+		bestT = select(earlier, t, bestT);
+		bestIndex = select(earlier, index, bestIndex);
+	}
+
+	alignas(16) float laneT[LANES];
+	alignas(16) int32_t laneIndex[LANES];
+	alignas(16) int32_t laneLastOverlap[LANES];
+	_mm_store_ps(laneT, bestT);
+	_mm_store_si128((__m128i*)laneIndex, bestIndex);
+	_mm_store_si128((__m128i*)laneLastOverlap, lastOverlap);
+	foldPairScanLanes(laneT, laneIndex, laneLastOverlap, LANES, lowestT, result);
+}
+
+#endif
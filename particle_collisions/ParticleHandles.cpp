@@ -0,0 +1,35 @@
+#include "ParticleHandles.h"
+
+void ParticleHandles::reset(size_t particleCount) {
+	uint32_t generation = 0;
+	for (size_t i = 0; i < slots.size(); i++) { if (slots[i].generation >= generation) { generation = slots[i].generation + 1; } }			// Newer than every generation so far, so that no old handle can become valid again.
+	slots.resize(particleCount);
+	slotOfParticle.resize(particleCount);
+	for (size_t i = 0; i < particleCount; i++) { slots[i] = { (uint32_t)i, generation }; slotOfParticle[i] = (uint32_t)i; }
+	firstFreeSlot = PARTICLE_HANDLE_NONE;
+}
+
+ParticleHandle ParticleHandles::add(size_t index) {
+	uint32_t slot = firstFreeSlot;
+	if (slot != PARTICLE_HANDLE_NONE) { firstFreeSlot = slots[slot].index; }
+	else {
+		slot = (uint32_t)slots.size();
+		slots.push_back({ 0, 0 });
+	}
+	slots[slot].index = (uint32_t)index;
+	if (slotOfParticle.size() <= index) { slotOfParticle.resize(index + 1); }
+	slotOfParticle[index] = slot;
+	return { slot, slots[slot].generation };
+}
+
+void ParticleHandles::remove(size_t index, size_t lastIndex) noexcept {
+	uint32_t slot = slotOfParticle[index];
+	uint32_t lastSlot = slotOfParticle[lastIndex];
+	slots[lastSlot].index = (uint32_t)index;
+	slotOfParticle[index] = lastSlot;
+	slotOfParticle.pop_back();
+
+	slots[slot].generation++;
+	slots[slot].index = firstFreeSlot;
+	firstFreeSlot = slot;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define PARTICLE_HANDLE_NONE 0xFFFFFFFFu
+
+// Reference to a particle that stays valid while other particles get inserted and removed, unlike its index (Scene::remove moves the last particle into the gap so that the arrays stay dense for the engines).
+// Once the particle is removed, the handle stays invalid for good, even after its slot gets reused, because the slot's generation doesn't match anymore.
+struct ParticleHandle
+{
+	uint32_t slot = PARTICLE_HANDLE_NONE;
+	uint32_t generation = 0;
+
+	bool operator==(const ParticleHandle& other) const noexcept { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const ParticleHandle& other) const noexcept { return !(*this == other); }
+};
+
+// Maps handles to particle indices and back. Slots of removed particles go onto a free list and get reused by the next insert, so the table only ever grows to the most particles the scene had at once.
+class ParticleHandles
+{
+public:
+	struct Slot
+	{
+		uint32_t index;								// Index of the particle, or the next free slot if the slot is free.
+		uint32_t generation;						// Incremented every time the slot is freed.
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> slotOfParticle;
+	uint32_t firstFreeSlot = PARTICLE_HANDLE_NONE;
+
+	// Starts over with particleCount particles, particle i getting slot i. Every handle from before becomes invalid.
+	void reset(size_t particleCount);
+
+	// Hands out a handle for a particle that was just appended at index.
+	ParticleHandle add(size_t index);
+	// Frees the handle of the particle at index, and gives the handle of the particle at lastIndex (which is moving into index) the new index. index and lastIndex can be the same.
+	void remove(size_t index, size_t lastIndex) noexcept;
+
+	bool isValid(ParticleHandle handle) const noexcept { return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation; }
+	size_t indexOf(ParticleHandle handle) const noexcept { return isValid(handle) ? slots[handle.slot].index : SIZE_MAX; }
+	ParticleHandle handleOf(size_t index) const noexcept { return { slotOfParticle[index], slots[slotOfParticle[index]].generation }; }
+};
@@ -0,0 +1,269 @@
+#include "ParticleStore.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "debugOutput.h"
+
+#ifdef _WIN32
+#include <malloc.h>																		// For _aligned_malloc, MSVC doesn't have std::aligned_alloc.
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void* allocateAligned(size_t size) {
+	if (size == 0) { size = PARTICLE_STORE_ALIGNMENT; }
+	size = (size + PARTICLE_STORE_ALIGNMENT - 1) / PARTICLE_STORE_ALIGNMENT * PARTICLE_STORE_ALIGNMENT;				// aligned_alloc wants the size to be a multiple of the alignment.
+#ifdef _WIN32
+	void* pointer = _aligned_malloc(size, PARTICLE_STORE_ALIGNMENT);
+#else
+	void* pointer = std::aligned_alloc(PARTICLE_STORE_ALIGNMENT, size);
+#endif
+	if (pointer == nullptr) { throw std::bad_alloc(); }												// Same behaviour as std::vector running out of memory.
+	return pointer;
+}
+
+void freeAligned(void* pointer) noexcept {
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+void* mapFile(const char* path, size_t& size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) { debuglogger::out << debuglogger::error << "failed to open " << path << debuglogger::endl; return nullptr; }
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) { debuglogger::out << debuglogger::error << "failed to read size of " << path << debuglogger::endl; CloseHandle(file); return nullptr; }
+	HANDLE mappingHandle = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mappingHandle == nullptr) { debuglogger::out << debuglogger::error << "failed to map " << path << debuglogger::endl; return nullptr; }
+	void* pointer = MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mappingHandle);														// The view keeps the mapping alive.
+	if (pointer == nullptr) { debuglogger::out << debuglogger::error << "failed to map " << path << debuglogger::endl; return nullptr; }
+	size = (size_t)fileSize.QuadPart;
+	return pointer;
+#else
+	int file = open(path, O_RDONLY);
+	if (file == -1) { debuglogger::out << debuglogger::error << "failed to open " << path << debuglogger::endl; return nullptr; }
+	struct stat fileInfo;
+	if (fstat(file, &fileInfo) != 0 || fileInfo.st_size == 0) { debuglogger::out << debuglogger::error << "failed to read size of " << path << debuglogger::endl; close(file); return nullptr; }
+	void* pointer = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);																		// The mapping keeps the file alive.
+	if (pointer == MAP_FAILED) { debuglogger::out << debuglogger::error << "failed to map " << path << debuglogger::endl; return nullptr; }
+	size = (size_t)fileInfo.st_size;
+	return pointer;
+#endif
+}
+
+void unmapFile(void* pointer, size_t size) noexcept {
+	if (pointer == nullptr) { return; }
+#ifdef _WIN32
+	UnmapViewOfFile(pointer);
+#else
+	munmap(pointer, size);
+#endif
+}
+
+ParticleRef::operator Particle() const noexcept {
+	Particle particle(pos, vel, radius, mass);
+	particle.lastInteractionWasIntersection = lastInteractionWasIntersection;
+	return particle;
+}
+
+ParticleRef& ParticleRef::operator=(const Particle& particle) noexcept {
+	pos = particle.pos;
+	vel = particle.vel;
+	radius = particle.radius;
+	mass = particle.mass;
+	lastInteractionWasIntersection = particle.lastInteractionWasIntersection;
+	return *this;
+}
+
+ParticleStore::ParticleStore(const ParticleStore& other) { *this = other; }
+
+ParticleStore::ParticleStore(ParticleStore&& other) noexcept { *this = std::move(other); }
+
+ParticleStore& ParticleStore::operator=(const ParticleStore& other) {
+	if (this == &other) { return *this; }
+	clear();
+	reserve(other.count);
+	count = other.count;
+	memcpy(x, other.x, count * sizeof(float));
+	memcpy(y, other.y, count * sizeof(float));
+	memcpy(vx, other.vx, count * sizeof(float));
+	memcpy(vy, other.vy, count * sizeof(float));
+	memcpy(radius, other.radius, count * sizeof(float));
+	memcpy(mass, other.mass, count * sizeof(float));
+	memcpy(localTime, other.localTime, count * sizeof(float));
+	memcpy(flags, other.flags, count * sizeof(uint8_t));
+	return *this;
+}
+
+ParticleStore& ParticleStore::operator=(ParticleStore&& other) noexcept {
+	if (this == &other) { return *this; }
+	release();
+	x = other.x; y = other.y; vx = other.vx; vy = other.vy;
+	radius = other.radius; mass = other.mass; localTime = other.localTime; flags = other.flags;
+	count = other.count;
+	capacity = other.capacity;
+	mapping = other.mapping;
+	mappingSize = other.mappingSize;
+	other.mapping = nullptr;
+	other.mappingSize = 0;
+	other.x = nullptr; other.y = nullptr; other.vx = nullptr; other.vy = nullptr;
+	other.radius = nullptr; other.mass = nullptr; other.localTime = nullptr; other.flags = nullptr;
+	other.count = 0;
+	other.capacity = 0;
+	return *this;
+}
+
+ParticleStore::~ParticleStore() { release(); }
+
+void ParticleStore::release() noexcept {
+	if (mapping != nullptr) { unmapFile(mapping, mappingSize); mapping = nullptr; mappingSize = 0; }
+	else {
+		freeAligned(x); freeAligned(y); freeAligned(vx); freeAligned(vy);
+		freeAligned(radius); freeAligned(mass); freeAligned(localTime); freeAligned(flags);
+	}
+	x = nullptr; y = nullptr; vx = nullptr; vy = nullptr;
+	radius = nullptr; mass = nullptr; localTime = nullptr; flags = nullptr;
+	count = 0;
+	capacity = 0;
+}
+
+// Allocates a new array with the new capacity, copies the old contents over and zeroes the rest (which includes the padding). Arrays in a mapping don't get freed, the whole mapping goes at once in reserve.
+template <typename T>
+static void growArray(T*& array, size_t count, size_t newCapacity, bool mapped) {
+	T* newArray = (T*)allocateAligned(newCapacity * sizeof(T));
+	if (count != 0) { memcpy(newArray, array, count * sizeof(T)); }
+	memset(newArray + count, 0, (newCapacity - count) * sizeof(T));
+	if (!mapped) { freeAligned(array); }
+	array = newArray;
+}
+
+static size_t paddedCapacity(size_t capacity) noexcept { return (capacity + PARTICLE_STORE_PADDING - 1) / PARTICLE_STORE_PADDING * PARTICLE_STORE_PADDING + PARTICLE_STORE_PADDING; }		// There is always at least one block of padding after the last particle.
+
+void ParticleStore::reserve(size_t newCapacity) {
+	newCapacity = paddedCapacity(newCapacity);
+	if (newCapacity <= capacity) { return; }
+	bool mapped = mapping != nullptr;
+	growArray(x, count, newCapacity, mapped);
+	growArray(y, count, newCapacity, mapped);
+	growArray(vx, count, newCapacity, mapped);
+	growArray(vy, count, newCapacity, mapped);
+	growArray(radius, count, newCapacity, mapped);
+	growArray(mass, count, newCapacity, mapped);
+	growArray(localTime, count, newCapacity, mapped);
+	growArray(flags, count, newCapacity, mapped);
+	capacity = newCapacity;
+	if (mapped) { unmapFile(mapping, mappingSize); mapping = nullptr; mappingSize = 0; }
+}
+
+void ParticleStore::detachMapping() {
+	if (mapping == nullptr) { return; }
+	growArray(x, count, capacity, true);
+	growArray(y, count, capacity, true);
+	growArray(vx, count, capacity, true);
+	growArray(vy, count, capacity, true);
+	growArray(radius, count, capacity, true);
+	growArray(mass, count, capacity, true);
+	growArray(localTime, count, capacity, true);
+	growArray(flags, count, capacity, true);
+	unmapFile(mapping, mappingSize);
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+// Only zeroes the padding, the particles themselves are left for whoever fills them in.
+template <typename T>
+static void allocateUninitializedArray(T*& array, size_t count, size_t capacity) {
+	array = (T*)allocateAligned(capacity * sizeof(T));
+	memset(array + count, 0, (capacity - count) * sizeof(T));
+}
+
+void ParticleStore::resizeUninitialized(size_t newCount) {
+	release();
+	size_t newCapacity = paddedCapacity(newCount);
+	allocateUninitializedArray(x, newCount, newCapacity);						// If one of these throws, the ones before it are freed by the next release, same as with the store's own arrays.
+	allocateUninitializedArray(y, newCount, newCapacity);
+	allocateUninitializedArray(vx, newCount, newCapacity);
+	allocateUninitializedArray(vy, newCount, newCapacity);
+	allocateUninitializedArray(radius, newCount, newCapacity);
+	allocateUninitializedArray(mass, newCount, newCapacity);
+	allocateUninitializedArray(localTime, newCount, newCapacity);
+	allocateUninitializedArray(flags, newCount, newCapacity);
+	count = newCount;
+	capacity = newCapacity;
+}
+
+void ParticleStore::useMappedArrays(void* mapping, size_t mappingSize, float* x, float* y, float* vx, float* vy, float* radius, float* mass, float* localTime, uint8_t* flags, size_t count, size_t capacity) noexcept {
+	release();
+	this->mapping = mapping;
+	this->mappingSize = mappingSize;
+	this->x = x; this->y = y; this->vx = vx; this->vy = vy;
+	this->radius = radius; this->mass = mass; this->localTime = localTime; this->flags = flags;
+	this->count = count;
+	this->capacity = capacity;
+}
+
+void ParticleStore::resize(size_t newCount) {
+	if (newCount > count) { reserve(newCount); }
+	else {																							// Keep the padding zeroed when shrinking.
+		size_t removed = count - newCount;
+		memset(x + newCount, 0, removed * sizeof(float));
+		memset(y + newCount, 0, removed * sizeof(float));
+		memset(vx + newCount, 0, removed * sizeof(float));
+		memset(vy + newCount, 0, removed * sizeof(float));
+		memset(radius + newCount, 0, removed * sizeof(float));
+		memset(mass + newCount, 0, removed * sizeof(float));
+		memset(localTime + newCount, 0, removed * sizeof(float));
+		memset(flags + newCount, 0, removed * sizeof(uint8_t));
+	}
+	count = newCount;
+}
+
+void ParticleStore::clear() noexcept { if (count != 0) { resize(0); } }
+
+void ParticleStore::push_back(const Particle& particle) {
+	if (count + 1 + PARTICLE_STORE_PADDING > capacity) { reserve(capacity * 2 > count + 1 ? capacity * 2 : count + 1); }
+	count++;
+	set(count - 1, particle);
+}
+
+void ParticleStore::swapRemove(size_t index) noexcept {
+	size_t last = count - 1;
+	x[index] = x[last]; y[index] = y[last]; vx[index] = vx[last]; vy[index] = vy[last];
+	radius[index] = radius[last]; mass[index] = mass[last]; localTime[index] = localTime[last]; flags[index] = flags[last];
+	resize(last);																	// Zeroes the slot that's now part of the padding.
+}
+
+void ParticleStore::assign(const std::vector<Particle>& particles, size_t count) {
+	clear();
+	reserve(count);
+	this->count = count;
+	for (size_t i = 0; i < count; i++) { set(i, particles[i]); }
+}
+
+Particle ParticleStore::get(size_t index) const noexcept {
+	Particle particle(position(index), velocity(index), radius[index], mass[index]);
+	particle.lastInteractionWasIntersection = hasFlag(index, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION);
+	return particle;
+}
+
+void ParticleStore::set(size_t index, const Particle& particle) noexcept {
+	setPosition(index, particle.pos);
+	setVelocity(index, particle.vel);
+	radius[index] = particle.radius;
+	mass[index] = particle.mass;
+	localTime[index] = 0;
+	flags[index] = particle.lastInteractionWasIntersection ? PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION : 0;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Particle.h"
+#include "Vector2f.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Alignment of every array in a ParticleStore. 64 bytes is a cache line on pretty much everything and also the width of an AVX-512 register.
+#define PARTICLE_STORE_ALIGNMENT 64
+// Capacities are always rounded up to a multiple of this, so that vectorized code can load whole registers past the last particle without reading outside of the arrays. The padding is kept zeroed.
+#define PARTICLE_STORE_PADDING 16
+
+// Bits of ParticleStore::flags.
+#define PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION 1
+
+// Reference to a float pair inside of a ParticleStore that behaves like a Vector2f for the common operations. Only meant for the compatibility accessor, hot code should use the arrays directly.
+class Vector2fRef
+{
+public:
+	float& x;
+	float& y;
+
+	Vector2fRef(float& x, float& y) noexcept : x(x), y(y) { }
+
+	operator Vector2f() const noexcept { return Vector2f(x, y); }
+
+	Vector2fRef& operator=(const Vector2f& other) noexcept { x = other.x; y = other.y; return *this; }
+	Vector2fRef& operator+=(const Vector2f& other) noexcept { x += other.x; y += other.y; return *this; }
+	Vector2fRef& operator-=(const Vector2f& other) noexcept { x -= other.x; y -= other.y; return *this; }
+	Vector2fRef& operator*=(float factor) noexcept { x *= factor; y *= factor; return *this; }
+};
+
+// Reference to a single bit of ParticleStore::flags that behaves like a bool.
+class ParticleFlagRef
+{
+public:
+	uint8_t& flags;
+	uint8_t flag;
+
+	ParticleFlagRef(uint8_t& flags, uint8_t flag) noexcept : flags(flags), flag(flag) { }
+
+	operator bool() const noexcept { return (flags & flag) != 0; }
+	ParticleFlagRef& operator=(bool value) noexcept { if (value) { flags |= flag; } else { flags &= ~flag; } return *this; }
+};
+
+// Compatibility accessor for code that was written against Particle&. It has the same member names as Particle, so something like scene.particles[i].vel += force still works.
+class ParticleRef
+{
+public:
+	Vector2fRef pos;
+	Vector2fRef vel;
+	float& radius;
+	float& mass;
+	ParticleFlagRef lastInteractionWasIntersection;
+
+	ParticleRef(float& x, float& y, float& vx, float& vy, float& radius, float& mass, uint8_t& flags) noexcept
+		: pos(x, y), vel(vx, vy), radius(radius), mass(mass), lastInteractionWasIntersection(flags, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION) { }
+
+	operator Particle() const noexcept;
+	ParticleRef& operator=(const Particle& particle) noexcept;
+};
+
+// Structure-of-arrays particle storage. Every particle property lives in its own aligned array, so that loops that only need a couple of properties (like the pair search, which mostly needs positions and velocities) only pull those through the cache.
+// The arrays are also laid out exactly the way vectorized code wants them.
+class ParticleStore
+{
+public:
+	float* x = nullptr;
+	float* y = nullptr;
+	float* vx = nullptr;
+	float* vy = nullptr;
+	float* radius = nullptr;
+	float* mass = nullptr;
+	float* localTime = nullptr;									// Time inside of the current step that the position corresponds to. Only used by the event-driven engine, see Scene::syncParticle.
+	uint8_t* flags = nullptr;
+
+	size_t count = 0;
+	size_t capacity = 0;
+
+	void* mapping = nullptr;									// Non-null if the arrays point into a mapped file (see useMappedArrays) instead of being allocated one by one. The first reserve that has to grow copies them out.
+	size_t mappingSize = 0;
+
+	ParticleStore() = default;
+	ParticleStore(const ParticleStore& other);
+	ParticleStore(ParticleStore&& other) noexcept;
+	ParticleStore& operator=(const ParticleStore& other);
+	ParticleStore& operator=(ParticleStore&& other) noexcept;
+	~ParticleStore();
+
+	size_t size() const noexcept { return count; }
+
+	void reserve(size_t newCapacity);
+	void resize(size_t newCount);								// New particles are zeroed.
+	// Throws the particles away and makes room for newCount new ones without touching their memory, only the padding gets zeroed. The caller has to fill in every particle, which is meant to happen in parallel,
+	// so that every page gets touched for the first time by the thread that's going to work on it (see WorkerPool::runRanges).
+	void resizeUninitialized(size_t newCount);
+	void clear() noexcept;
+
+	void push_back(const Particle& particle);
+	// Moves the last particle into index and drops the last slot, so removing doesn't have to shift anything. Changes the index of the last particle.
+	void swapRemove(size_t index) noexcept;
+	void assign(const std::vector<Particle>& particles, size_t count);
+
+	Vector2f position(size_t index) const noexcept { return Vector2f(x[index], y[index]); }
+	Vector2f velocity(size_t index) const noexcept { return Vector2f(vx[index], vy[index]); }
+	void setPosition(size_t index, const Vector2f& pos) noexcept { x[index] = pos.x; y[index] = pos.y; }
+	void setVelocity(size_t index, const Vector2f& vel) noexcept { vx[index] = vel.x; vy[index] = vel.y; }
+
+	bool hasFlag(size_t index, uint8_t flag) const noexcept { return (flags[index] & flag) != 0; }
+	void setFlag(size_t index, uint8_t flag, bool value) noexcept { if (value) { flags[index] |= flag; } else { flags[index] &= ~flag; } }
+
+	Particle get(size_t index) const noexcept;
+	void set(size_t index, const Particle& particle) noexcept;
+
+	ParticleRef operator[](size_t index) noexcept { return ParticleRef(x[index], y[index], vx[index], vy[index], radius[index], mass[index], flags[index]); }
+
+	// Points the arrays into a copy-on-write file mapping, which the store unmaps once it doesn't need it anymore. Every array has to be aligned to PARTICLE_STORE_ALIGNMENT and hold capacity elements with zeroed padding, same as allocated ones.
+	void useMappedArrays(void* mapping, size_t mappingSize, float* x, float* y, float* vx, float* vy, float* radius, float* mass, float* localTime, uint8_t* flags, size_t count, size_t capacity) noexcept;
+	// Copies the arrays out of the mapping (if they are in one) and unmaps it. Windows can't replace a file while it's mapped.
+	void detachMapping();
+
+	void release() noexcept;
+};
+
+void* allocateAligned(size_t size);
+void freeAligned(void* pointer) noexcept;
+
+// Maps the whole file copy-on-write, so that writes to the memory never reach the file. Returns null (after logging why) if that didn't work. The mapping starts at a page boundary.
+void* mapFile(const char* path, size_t& size);
+void unmapFile(void* pointer, size_t size) noexcept;
@@ -0,0 +1,133 @@
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
+
+#include "Rasterizer.h"
+
+#include "Scene.h"
+#include "WorkerPool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "debugOutput.h"
+
+void Rasterizer::resize(uint32_t width, uint32_t height) {
+	this->width = width;
+	this->height = height;
+	pixels.assign((size_t)width * height, backgroundColor);
+	tileColumns = (width + RASTERIZER_TILE_SIZE - 1) / RASTERIZER_TILE_SIZE;
+	tileRows = (height + RASTERIZER_TILE_SIZE - 1) / RASTERIZER_TILE_SIZE;
+	bins.clear();
+}
+
+// ceil and floor are library calls without SSE4.1, these are a conversion and a compare.
+static inline int64_t ceilToInt(float value) noexcept { int64_t truncated = (int64_t)value; return truncated + (truncated < value); }
+static inline int64_t floorToInt(float value) noexcept { int64_t truncated = (int64_t)value; return truncated - (truncated > value); }
+
+// Range of pixels whose centers (at +0.5) can be inside of [low, high], clamped to [0, size). Neither bound can be NaN.
+static inline void pixelRange(float low, float high, uint32_t size, int64_t& first, int64_t& last) noexcept {
+	if (low < -1) { low = -1; }											// Keeps huge circles from overflowing the conversions.
+	if (high > (float)size + 1) { high = (float)size + 1; }
+	first = ceilToInt(low - 0.5f);
+	last = floorToInt(high - 0.5f);
+	if (first < 0) { first = 0; }
+	if (last > (int64_t)size - 1) { last = (int64_t)size - 1; }
+}
+
+void Rasterizer::binCircles(const RasterizerCircles& circles, unsigned int workerIndex, size_t begin, size_t end) {
+	std::vector<std::vector<uint32_t>>& workerBins = bins[workerIndex];
+	for (size_t tile = 0; tile < workerBins.size(); tile++) { workerBins[tile].clear(); }			// Clearing instead of reallocating keeps the capacity from frame to frame.
+	for (size_t i = begin; i < end; i++) {
+		float x = circles.x[i];
+		float y = circles.y[i];
+		float radius = circles.radius[i];
+		if (!(x + radius > 0 && x - radius < width && y + radius > 0 && y - radius < height)) { continue; }			// Completely outside of the framebuffer, or NaN.
+		int64_t firstColumn, lastColumn, firstRow, lastRow;
+		pixelRange(x - radius, x + radius, width, firstColumn, lastColumn);
+		pixelRange(y - radius, y + radius, height, firstRow, lastRow);
+		if (firstColumn > lastColumn || firstRow > lastRow) { continue; }						// Too small to cover any pixel's center.
+		for (int64_t tileRow = firstRow / RASTERIZER_TILE_SIZE; tileRow <= lastRow / RASTERIZER_TILE_SIZE; tileRow++) {
+			for (int64_t tileColumn = firstColumn / RASTERIZER_TILE_SIZE; tileColumn <= lastColumn / RASTERIZER_TILE_SIZE; tileColumn++) {
+				workerBins[(size_t)tileRow * tileColumns + (size_t)tileColumn].push_back((uint32_t)i);
+			}
+		}
+	}
+}
+
+void Rasterizer::drawTile(const RasterizerCircles& circles, size_t tile) {
+	int64_t tileLeft = (int64_t)(tile % tileColumns) * RASTERIZER_TILE_SIZE;
+	int64_t tileTop = (int64_t)(tile / tileColumns) * RASTERIZER_TILE_SIZE;
+	int64_t tileRight = std::min<int64_t>(tileLeft + RASTERIZER_TILE_SIZE, width) - 1;
+	int64_t tileBottom = std::min<int64_t>(tileTop + RASTERIZER_TILE_SIZE, height) - 1;
+	for (int64_t row = tileTop; row <= tileBottom; row++) { std::fill_n(&pixels[(size_t)row * width + tileLeft], tileRight - tileLeft + 1, backgroundColor); }
+
+	for (size_t worker = 0; worker < bins.size(); worker++) {
+		const std::vector<uint32_t>& bin = bins[worker][tile];
+		for (size_t i = 0; i < bin.size(); i++) {
+			float x = circles.x[bin[i]];
+			float y = circles.y[bin[i]];
+			float radius = circles.radius[bin[i]];
+			float squaredRadius = radius * radius;
+			int64_t firstRow, lastRow;
+			pixelRange(y - radius, y + radius, height, firstRow, lastRow);
+			if (firstRow < tileTop) { firstRow = tileTop; }
+			if (lastRow > tileBottom) { lastRow = tileBottom; }
+			for (int64_t row = firstRow; row <= lastRow; row++) {
+				float dy = row + 0.5f - y;
+				float halfWidth = squaredRadius - dy * dy;
+				if (halfWidth < 0) { continue; }
+				halfWidth = sqrt(halfWidth);
+				int64_t first, last;
+				pixelRange(x - halfWidth, x + halfWidth, width, first, last);
+				if (first < tileLeft) { first = tileLeft; }
+				if (last > tileRight) { last = tileRight; }
+				if (first <= last) { std::fill_n(&pixels[(size_t)row * width + first], last - first + 1, particleColor); }
+			}
+		}
+	}
+}
+
+void Rasterizer::render(const RasterizerCircles& circles, WorkerPool& workers) {
+	TRACE_SCOPE("Rasterizer::render");
+	size_t tileCount = tileColumns * tileRows;
+	if (bins.size() != workers.threadCount()) { bins.assign(workers.threadCount(), std::vector<std::vector<uint32_t>>(tileCount)); }
+	{
+		TRACE_SCOPE("bin circles");
+		workers.run([this, &circles](unsigned int workerIndex) {
+			size_t workerCount = bins.size();
+			binCircles(circles, workerIndex, circles.count * workerIndex / workerCount, circles.count * (workerIndex + 1) / workerCount);
+		});
+	}
+	TRACE_SCOPE("draw tiles");
+	std::atomic<size_t> nextTile(0);
+	workers.run([this, &circles, &nextTile, tileCount](unsigned int) {
+		while (true) {
+			size_t tile = nextTile.fetch_add(1, std::memory_order_relaxed);
+			if (tile >= tileCount) { break; }
+			drawTile(circles, tile);
+		}
+	});
+}
+
+void Rasterizer::render(const Scene& scene, WorkerPool& workers) { render({ scene.particles.x, scene.particles.y, scene.particles.radius, scene.particleCount }, workers); }
+
+bool Rasterizer::writePPM(const char* path) const {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to create " << path << debuglogger::endl; return false; }
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	std::vector<uint8_t> row((size_t)width * 3);
+	bool failed = false;
+	for (uint32_t y = 0; y < height && !failed; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t pixel = pixels[(size_t)y * width + x];
+			row[x * 3] = (uint8_t)(pixel >> 16);
+			row[x * 3 + 1] = (uint8_t)(pixel >> 8);
+			row[x * 3 + 2] = (uint8_t)pixel;
+		}
+		failed = fwrite(row.data(), 1, row.size(), file) != row.size();
+	}
+	if (fclose(file) != 0) { failed = true; }
+	if (failed) { debuglogger::out << debuglogger::error << "failed to write " << path << debuglogger::endl; }
+	return !failed;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Scene;
+class WorkerPool;
+
+// Edge length of the square tiles that the framebuffer is split into. A tile's pixels (16 KB) stay in L1 while all of its particles get drawn.
+#define RASTERIZER_TILE_SIZE 64
+
+// Where the circles to draw come from, the particle arrays of a Scene or of a SceneSnapshot.
+struct RasterizerCircles
+{
+	const float* x;
+	const float* y;
+	const float* radius;
+	size_t count;
+};
+
+// Portable replacement for drawing every particle with GDI. Draws the particles as filled circles into a plain framebuffer of 32-bit pixels, 0xAARRGGBB, which is what a 32-bit Windows DIB expects (so the window can hand it to GDI as is).
+// Every frame, the particles get binned into the tiles that their bounding boxes touch, and then every tile gets cleared and has its particles drawn on its own, with the tiles spread over the workers. No two workers ever write to the same pixel, so there is no locking.
+// A pixel is covered if its center is inside of the circle. Every row of a circle is one span, which gets filled with std::fill_n, which the compiler turns into vector stores.
+class Rasterizer
+{
+public:
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint32_t> pixels;							// Rows top to bottom, width pixels each.
+	uint32_t backgroundColor = 0xFF000000;
+	uint32_t particleColor = 0xFF00FF00;
+
+	size_t tileColumns = 0;
+	size_t tileRows = 0;
+	std::vector<std::vector<std::vector<uint32_t>>> bins;	// Per worker and tile, the circles that touch the tile. Every worker bins its own range of circles, so binning doesn't need any locking either.
+
+	void resize(uint32_t width, uint32_t height);
+
+	// Scene coordinates map 1:1 onto pixels, circles outside of the framebuffer get clipped.
+	void render(const RasterizerCircles& circles, WorkerPool& workers);
+	// The scene's particles have to be in sync (see Scene::syncParticles).
+	void render(const Scene& scene, WorkerPool& workers);
+
+	// Writes the framebuffer as a binary PPM (P6). Returns false (after logging why) if that didn't work.
+	bool writePPM(const char* path) const;
+
+	void binCircles(const RasterizerCircles& circles, unsigned int workerIndex, size_t begin, size_t end);
+	void drawTile(const RasterizerCircles& circles, size_t tile);
+};
@@ -1,11 +1,24 @@
 #include "Renderer.h"
 
+#include "Trace.h"
+
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
-void Renderer::render(const Scene& scene) {
-	for (int i = 0; i < scene.particleCount; i++) {
-		const Particle& particle = scene.particles[i];
-		Ellipse(g, particle.pos.x - particle.radius, particle.pos.y - particle.radius, particle.pos.x + particle.radius, particle.pos.y + particle.radius);
-	}
+Renderer::Renderer(const HDC g, uint32_t width, uint32_t height) : g(g), bitmapInfo() {
+	rasterizer.resize(width, height);
+	bitmapInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bitmapInfo.bmiHeader.biWidth = width;
+	bitmapInfo.bmiHeader.biHeight = -(LONG)height;				// Negative for top to bottom rows, like the rasterizer's.
+	bitmapInfo.bmiHeader.biPlanes = 1;
+	bitmapInfo.bmiHeader.biBitCount = 32;
+	bitmapInfo.bmiHeader.biCompression = BI_RGB;
+}
+
+void Renderer::render(const Scene& scene, WorkerPool& workers) { rasterizer.render(scene, workers); }
+
+void Renderer::render(const SceneSnapshot& snapshot, WorkerPool& workers) { rasterizer.render(snapshot.circles(), workers); }
+
+void Renderer::present() {
+	SetDIBitsToDevice(g, 0, 0, rasterizer.width, rasterizer.height, 0, 0, 0, rasterizer.height, rasterizer.pixels.data(), &bitmapInfo, DIB_RGB_COLORS);
 }
@@ -1,17 +1,23 @@
 #pragma once
 
 #include "Scene.h"
+#include "Rasterizer.h"
+#include "SceneSnapshot.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
+// Draws the scene with a Rasterizer and copies its framebuffer to a window, so GDI only gets one call per frame no matter how many particles there are.
 class Renderer
 {
 public:
 	HDC g;
+	Rasterizer rasterizer;
+	BITMAPINFO bitmapInfo;
 
-	Renderer(const HDC g) noexcept : g(g) { }
+	Renderer(const HDC g, uint32_t width, uint32_t height);
 
-	void render(const Scene& scene);
+	void render(const Scene& scene, WorkerPool& workers);			// The scene's particles have to be in sync (see Scene::syncParticles) before rendering.
+	void render(const SceneSnapshot& snapshot, WorkerPool& workers);
+	void present();
 };
-
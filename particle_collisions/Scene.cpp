@@ -1,94 +1,196 @@
 #include "Scene.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 
 #include "debugOutput.h"
+#include "Trace.h"
+#include "Trajectory.h"
+#include "CollisionLog.h"
+
+// State of the collision search in the current sub-step. These used to be members of Scene, but they are just temporaries that never get used outside of a step.
+// They're thread_local so that every thread of the parallel collision search (see findCollisionsInParallel) can keep track of its own earliest collision without any locking.
+thread_local size_t currentColliderA;
+thread_local size_t currentColliderB;
+
+thread_local float currentSubStep;
+thread_local float lowestT;
+thread_local bool noCollisions;
+thread_local bool boundsCollision;
+thread_local bool lowestTWasForced;			// True if the current collision was forced to t = 0 because of overlapping particles or a particle outside of the bounds. Forced collisions replace each other in search order instead of keeping the first one found, which the parallel search has to know about when it combines its results.
+
+// A collision that happens at most simultaneousEventTolerance after the earliest one found so far, see reflectSimultaneousEvents. For wall collisions, b is the axis (same as currentColliderB).
+struct BatchedEvent
+{
+	float t;
+	size_t a;
+	size_t b;
+	bool wall;
+};
+
+thread_local bool collectingEventBatch;
+thread_local float eventBatchToleranceT;				// simultaneousEventTolerance converted into the t-values of the current sub-step.
+thread_local std::vector<BatchedEvent> eventBatchCandidates;
+thread_local std::vector<PairScanCandidate> scanCandidates;
+
+// Counted by whichever thread does the work and added up at the end of the step, so counting never needs atomics. Workers hand theirs over at the end of every task.
+#if SCENE_STATS
+#define COUNT_STAT(statement) statement
+#else
+#define COUNT_STAT(statement)
+#endif
+
+// Costs a single branch per collision while Scene::collisionLog isn't set, and nothing at all with SCENE_COLLISION_LOG set to 0.
+#if SCENE_COLLISION_LOG
+#define LOG_COLLISION(...) if (collisionLog != nullptr) { recordCollision(__VA_ARGS__); }
+#else
+#define LOG_COLLISION(...)
+#endif
+thread_local float reflectionTime;						// Time inside of the step of the collisions that reflectCollision is reflecting. Only the collision log needs it.
+thread_local SceneStats threadStats;
+std::vector<SceneStats> workerStats;
+
+static void addThreadStats(unsigned int workerIndex) noexcept {
+	workerStats[workerIndex] += threadStats;
+	threadStats = SceneStats();
+}
+
+// NOTE: This compares against the current lowestT, which only ever goes down during a search, so every collision that ends up within the tolerance of the final lowestT is guaranteed to be collected. The rest gets filtered out in reflectSimultaneousEvents.
+static inline void collectEventBatchCandidate(float t, size_t a, size_t b, bool wall) {
+	if (collectingEventBatch && t <= lowestT + eventBatchToleranceT) { eventBatchCandidates.push_back({ t < 0 ? 0 : t, a, b, wall }); }
+}
+
+// Hands a collector to the vectorized kernels if events are being collected, returns null otherwise.
+static PairScanCollector* prepareScanCollector(PairScanCollector& collector, size_t betaCount) {
+	if (!collectingEventBatch) { return nullptr; }
+	if (scanCandidates.size() < betaCount) { scanCandidates.resize(betaCount); }
+	collector = { lowestT + eventBatchToleranceT, scanCandidates.data(), 0 };
+	return &collector;
+}
 
 void Scene::loadSize(unsigned int width, unsigned int height) { this->width = width; this->height = height; }
 
-void Scene::loadParticles(const std::vector<Particle>& particles, size_t count) { this->particles = particles; particleCount = count; lastParticle = count - 1; }
-void Scene::loadParticles(const std::vector<Particle>& particles) { this->particles = particles; particleCount = particles.size(); lastParticle = particleCount - 1; }
-void Scene::loadParticles(std::vector<Particle>&& particles, size_t count) { this->particles = std::move(particles); particleCount = count; lastParticle = count - 1; }
-void Scene::loadParticles(std::vector<Particle>&& particles) { particleCount = particles.size(); lastParticle = particleCount - 1; this->particles = std::move(particles); }				// Order is reversed here in case the moving of one vector into another changes the size() member function return value in the temporary.
+void Scene::setThreadCount(unsigned int threadCount, bool pinToCores) { workers.start(threadCount, pinToCores); }
+
+void Scene::loadParticles(const std::vector<Particle>& particles, size_t count) { this->particles.assign(particles, count); particleCount = count; lastParticle = count != 0 ? count - 1 : 0; }
+void Scene::loadParticles(const std::vector<Particle>& particles) { this->particles.assign(particles, particles.size()); particleCount = particles.size(); lastParticle = particleCount != 0 ? particleCount - 1 : 0; }
+void Scene::loadParticles(std::vector<Particle>&& particles, size_t count) { loadParticles((const std::vector<Particle>&)particles, count); }				// NOTE: The particles get converted into the ParticleStore layout anyway, so there is nothing to gain from moving anymore. These are only here so that existing callers keep working.
+void Scene::loadParticles(std::vector<Particle>&& particles) { loadParticles((const std::vector<Particle>&)particles); }
 
 void Scene::postLoadInit() {
 	lastIntersectionPartners.resize(particles.size());					// TODO: We should probably use particleCount here.
-	lastIntersectionWasWithWall.resize(particles.size());
-	for (size_t i = 0; i < lastIntersectionPartners.size(); i++) { lastIntersectionPartners[i] = i; lastIntersectionWasWithWall[i] = false; }
+	lastIntersectionWasWithWall.assign(particles.size(), false);
+	workers.runRanges(lastIntersectionPartners.size(), [this](size_t begin, size_t end) { for (size_t i = begin; i < end; i++) { lastIntersectionPartners[i] = i; } });
+	collisionCounts.resize(particles.size());
+	invalidatedParticles.resize(particles.size());
+	handles.reset(particles.size());
+	sweepAndPrune.changed.clear();						// The scene got replaced, so the old order gets sorted into the new particles (or started over if the count changed) instead of repaired.
+	// lastEvents only gets allocated by the event-driven engines (see beginEventStep). It's the biggest of these by far, and loading a large scene shouldn't have to pay for it if the sub-step engine is going to run it.
 }
 
-std::vector<size_t> intersectionStack;				// TODO: This doesn't have an upper limit though, even with the redundancy check. Rather it does, but that limit is super high. There is nothing to be done about that I guess.
-												// TODO: Calculate that upper limit with respect to the number of particles.
-std::vector<size_t> invalidatedParticles;				// TODO: This can cause crashes because it doesn't have an upper limit. Have every insertion check for previous occurrances to make sure the upper limit is respected. We don't want to consume too much memory.
+ParticleHandle Scene::insert(const Particle& particle) {
+	size_t index = particleCount;
+	bool gridHoldsEveryParticle = grid.particleCells.size() == particleCount && !grid.cells.empty();
+	particles.push_back(particle);
+	particleCount++;
+	lastParticle = index;
+	lastIntersectionPartners.push_back(index);
+	lastIntersectionWasWithWall.push_back(false);
+	collisionCounts.push_back(0);
+	invalidatedParticles.resize(particleCount);
+	if (gridHoldsEveryParticle) { grid.insert(index, particles.position(index)); }
+	sweepAndPrune.markChanged(index);
+	return handles.add(index);
+}
 
-void addParticleToInvalidated(size_t index) {			// TODO: Is there a better way to do this without searching through array everytime you have to add, cuz that could happen a lot. Maybe only sort and remove multiples after it gets bigger than a certain size, that would get you speed plus reduced size.
-	bool thing = false;
-	for (size_t i = 0; i < invalidatedParticles.size(); i++) {
-		if (invalidatedParticles[i] == index) { thing = true; break; }
-	}
-	if (thing) {
-		return;
+template <typename T>
+static void reserveGrowing(std::vector<T>& vector, size_t size) { if (vector.capacity() < size) { vector.reserve(size > vector.capacity() * 2 ? size : vector.capacity() * 2); } }			// Plain reserve allocates exactly, which would make lots of small batches reallocate every time.
+
+void Scene::insert(const std::vector<Particle>& newParticles, std::vector<ParticleHandle>* newHandles) {
+	size_t newCount = particleCount + newParticles.size();
+	if (newCount + PARTICLE_STORE_PADDING > particles.capacity) { particles.reserve(newCount > particles.capacity * 2 ? newCount : particles.capacity * 2); }
+	reserveGrowing(lastIntersectionPartners, newCount);
+	reserveGrowing(collisionCounts, newCount);
+	if (newHandles != nullptr) { reserveGrowing(*newHandles, newHandles->size() + newParticles.size()); }
+	for (size_t i = 0; i < newParticles.size(); i++) {
+		ParticleHandle handle = insert(newParticles[i]);
+		if (newHandles != nullptr) { newHandles->push_back(handle); }
 	}
-	invalidatedParticles.push_back(index);
 }
 
-#define STACK_MAX_SIZE 100
-
-bool addParticleToStack(size_t index) {
-	if (intersectionStack.size() == STACK_MAX_SIZE) {
-		return false;
-	}
-	intersectionStack.push_back(index);
+bool Scene::remove(ParticleHandle handle) {
+	size_t index = handles.indexOf(handle);
+	if (index == SIZE_MAX) { return false; }
+	size_t last = particleCount - 1;
+	if (grid.particleCells.size() == particleCount && !grid.cells.empty()) { grid.remove(index); }
+	sweepAndPrune.markChanged(index);
+	handles.remove(index, last);
+	particles.swapRemove(index);
+	lastIntersectionPartners[index] = index;
+	lastIntersectionWasWithWall[index] = lastIntersectionWasWithWall[last];
+	collisionCounts[index] = collisionCounts[last];
+	lastIntersectionPartners.pop_back();
+	lastIntersectionWasWithWall.pop_back();
+	collisionCounts.pop_back();
+	particleCount--;
+	lastParticle = particleCount != 0 ? particleCount - 1 : 0;
 	return true;
 }
 
-bool Scene::resolveIntersectionWithBounds(size_t particleIndex) {
-	Particle& particle = particles[particleIndex];
+// Extra space that every grid cell gets on top of the required size, so that floating point error in the t-value calculations can't make a pair slip through the cracks between two non-neighboring cells.
+#define GRID_CELL_PADDING 1.0f
 
-	bool thing = false;
+thread_local std::vector<size_t> broadPhaseCandidates;
+thread_local ParticleStore broadPhaseCandidateStore;				// The broad phase candidates' data copied into contiguous arrays, so that the vectorized pair scan can run over them.
 
-	uint32_t paddedWidth = width - particle.radius;
-	if (particle.pos.x > paddedWidth) { particle.pos.x = paddedWidth; thing = true; }
-	else if (particle.pos.x < particle.radius) { particle.pos.x = particle.radius; thing = true; }
+// The particles of the cluster that resolveIntersections is currently working through. It's a ring buffer with room for every particle, and a particle can only be in there once at a time (see intersectionQueued), so it can never overflow.
+std::vector<size_t> intersectionQueue;
+std::vector<bool> intersectionQueued;
+std::vector<size_t> intersectionPushedBy;				// The particle that last pushed each queued particle out of itself. See resolveIntersections for why that matters.
+std::vector<size_t> intersectionNeighbors;
+UniformGrid intersectionGrid;						// Only used to find neighbors if the scene doesn't use the grid as its broad phase anyway.
+bool intersectionGridCurrent = false;				// Whether intersectionGrid matches the particles. Every pass that resolves intersections clears it first, since the particles have moved since the last one.
 
-	uint32_t paddedHeight = height - particle.radius;
-	if (particle.pos.y > paddedHeight) { particle.pos.y = paddedHeight; thing = true; }
-	else if (particle.pos.y < particle.radius) { particle.pos.y = particle.radius; thing = true;}
+// How many times resolveIntersections may take a particle out of the queue on average before it gives up. Particles that get pushed into a corner can push each other back and forth for a long time, this keeps that from stalling the step.
+#define INTERSECTION_RESOLUTION_MAX_VISITS_PER_PARTICLE 16
 
-	if (thing == false) { return false; }
+bool Scene::resolveIntersectionWithBounds(size_t particleIndex) {
+	float& x = particles.x[particleIndex];
+	float& y = particles.y[particleIndex];
+	float radius = particles.radius[particleIndex];
 
+	bool thing = false;
 
-	return true;
+	uint32_t paddedWidth = width - radius;
+	if (x > paddedWidth) { x = paddedWidth; thing = true; }
+	else if (x < radius) { x = radius; thing = true; }
+
+	uint32_t paddedHeight = height - radius;
+	if (y > paddedHeight) { y = paddedHeight; thing = true; }
+	else if (y < radius) { y = radius; thing = true;}
+
+	return thing;
 }
 
 bool Scene::resolveIntersectionWithParticle(size_t aIndex, size_t bIndex) {
+	Vector2f alphaPos = particles.position(aIndex);
+	Vector2f betaPos = particles.position(bIndex);
 
-	//if (intersectionStack.size() != 1 && *(intersectionStack.end() - 2) == bIndex) { return false; }
-	// the goal was to not intersect with your parent, but that doesn't work like that with the current setup. Should we even be avoiding that?
-	Particle& alpha = particles[aIndex];
-	Particle& beta = particles[bIndex];
-
-	float minDistSquared = alpha.radius + beta.radius;
+	float minDistSquared = particles.radius[aIndex] + particles.radius[bIndex];
 	minDistSquared *= minDistSquared;
-	Vector2f toAlphaFromBeta = alpha.pos - beta.pos;
+	Vector2f toAlphaFromBeta = alphaPos - betaPos;
 	float distance = toAlphaFromBeta.getSquareLength();
 	if (distance < minDistSquared) {
-
-
-		if (!addParticleToStack(bIndex)) {				// It's imperative that this is before the following code in this situation.
-														// If it isn't, a particle that would be pushed at the end but not allowed onto the intersection stack wouldn't have it's bound intersection checked, allowing particles to (temporarily) slip outside of the bounds, which would be terrible.
-			return false;
-		}
-
 		distance = sqrt(distance);
 		float adjustment = sqrt(minDistSquared) - distance;						// TODO: You should reflect the particles directly from this code block, that way, you save all the calculation required normally when resolving intersections where the particles are going towards each other.
-		//adjustment /= 2;										// TODO: Stack overflow when resolving intersections is way to common, rework the system so that they don't occur. You might need to switch to loops.
+		//adjustment /= 2;
 		// Divide by two is actually not needed. The way it is now is perfect.
 
-		if (alpha.pos == beta.pos) {
-			beta.pos.y += adjustment;					// TODO: This arbitrary downwards direction should be replaced by a random push direction, to make things more natural should this situation occur. Trust me, it'll look waaaaay better.
+		if (alphaPos == betaPos) {
+			particles.y[bIndex] += adjustment;					// TODO: This arbitrary downwards direction should be replaced by a random push direction, to make things more natural should this situation occur. Trust me, it'll look waaaaay better.
 		} else {
-			beta.pos -= toAlphaFromBeta / distance * adjustment;
+			particles.setPosition(bIndex, betaPos - toAlphaFromBeta / distance * adjustment);
 		}
 
 		/*float multiplier = adjustment / (distance * (alpha.mass + beta.mass));
@@ -99,8 +201,7 @@ bool Scene::resolveIntersectionWithParticle(size_t aIndex, size_t bIndex) {
 
 		//lastIntersectionPartners[aIndex] = bIndex;
 		//lastIntersectionPartners[bIndex] = aIndex;
-		addParticleToInvalidated(bIndex);
-		//invalidatedParticles.push_back(bIndex);							// NOTE: Instead of putting this index in exactly the right spot, so that the list remains sorted (which would be O(n/2 * k) on average), we sort the list at the end (which probably gives us a better time complexity).
+		invalidatedParticles.insert(bIndex);
 		return true;
 	}
 	return false;
@@ -117,14 +218,6 @@ bool Scene::resolveIntersectionWithParticle(size_t aIndex, size_t bIndex) {
 
 
 
-// TODO: Here is the issue at hand:
-// You want to refactor this code to make it look nice and avoid having it be such a mess.
-// The problem is that you can't see a good way to do a depth first search like the one below with loopified version. It'll work best with recursion.
-// The problem with that is that the stack's size is limited and not dynamically allocated, allowing it to have a much smaller maximum size. You'll hit recursion limits much faster than with the loopified and thereby heapified approach.
-// The solution is either to find a way to get a good loopified depth first search or to switch back to recursion, but set the stack size higher in the compiler output settings, which should be fine.
-// Recursion probably doesn't make as efficient use of the memory as loops do, because recursion has to setup stack frames and return pointers and push registers onto stack. Some of that can be optimized away, maybe even most of it, but some parts of that probably remain, which is suboptimal.
-
-
 // NOTE: Maximum stack size is fixed where-as maximum heap size is not (max heap size is pretty much determined by how big the stack allocation is, not by some predetermined number, that's what I mean).
 // The reason for this is that every thread needs it's own stack and if the sizes aren't predetermined, they'll step on each others feet. This sadly means that the stack can't reach the same heights as the heap.
 // This can be changed by changing the predetermined max size of the stack in the compiler settings, but it remains predetermined, and setting it higher will lower heap max size.
@@ -136,107 +229,199 @@ bool Scene::resolveIntersectionWithParticle(size_t aIndex, size_t bIndex) {
 
 
 
+// Pushes every particle that overlaps the given one out of the way, then every particle that those overlap and so on, until the whole cluster is free of overlaps. Pushed particles only move away from the particle that pushed them, so a pushed particle never has to check the one that pushed it, unless the bounds moved it back since then.
+// Neighbors are looked up in the grid (a grid of its own with the other broad phases, built by the first resolve of every pass), so the cost only depends on the size of the cluster and not on the amount of particles in the scene.
+// The cluster is worked through breadth-first with a queue instead of depth-first, a particle that is already waiting in the queue doesn't get added again when something else pushes it.
+// If the cluster doesn't settle within the visit budget, the particles that are still waiting get marked again, so that they get another go the next time around instead of being left overlapping.
 void Scene::resolveIntersections(size_t particleIndex) {
-	intersectionStack.push_back(particleIndex);
-	// Depth first search through all the particles.
-	size_t tempBreadthThing = 0;
-	while (true) {
-	thinglabel:
+	TRACE_SCOPE("overlap resolution");
+	UniformGrid* neighborGrid = &grid;
+	if (broadPhase != BroadPhase::UNIFORM_GRID) {
+		if (!intersectionGridCurrent) {								// Only the first resolve of a pass builds the grid, the rest of the pass keeps it up to date the same way as the scene's own grid.
+			float maxRadius = 0;
+			for (size_t i = 0; i < particleCount; i++) { if (particles.radius[i] > maxRadius) { maxRadius = particles.radius[i]; } }
+			intersectionGrid.rebuild(particles, particleCount, width, height, 2 * maxRadius + GRID_CELL_PADDING);
+			intersectionGridCurrent = true;
+		}
+		neighborGrid = &intersectionGrid;
+	}
 
-		debuglogger::out << (int)intersectionStack.size() << debuglogger::endl;
-		size_t currentIntersectionParticleIndex = intersectionStack.back();
+	if (intersectionQueue.size() < particleCount) {
+		intersectionQueue.resize(particleCount);
+		intersectionQueued.resize(particleCount);
+		intersectionPushedBy.resize(particleCount);
+	}
 
-		if (resolveIntersectionWithBounds(currentIntersectionParticleIndex)) {
-		for (size_t i = tempBreadthThing; i < currentIntersectionParticleIndex; i++) {
-			if (resolveIntersectionWithParticle(currentIntersectionParticleIndex, i)) {
-				tempBreadthThing = 0; goto thinglabel;
-			}
-		}
-		for (size_t i = ((tempBreadthThing < currentIntersectionParticleIndex + 1) ? (currentIntersectionParticleIndex + 1) : tempBreadthThing); i < particleCount; i++) {
-			if (resolveIntersectionWithParticle(currentIntersectionParticleIndex, i)) { tempBreadthThing = 0; goto thinglabel; }
+	particles.setFlag(particleIndex, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION, false);
+	size_t queueFront = 0;
+	size_t queuedCount = 1;
+	intersectionQueue[0] = particleIndex;
+	intersectionQueued[particleIndex] = true;
+	intersectionPushedBy[particleIndex] = particleIndex;
+
+	COUNT_STAT(threadStats.intersectionResolutions++);
+	size_t visitBudget = particleCount * INTERSECTION_RESOLUTION_MAX_VISITS_PER_PARTICLE;
+	size_t visitsLeft = visitBudget;
+	while (queuedCount != 0 && visitsLeft != 0) {
+		visitsLeft--;
+		size_t current = intersectionQueue[queueFront];
+		queueFront = (queueFront + 1) % particleCount;
+		queuedCount--;
+		intersectionQueued[current] = false;
+
+		bool movedByBounds = resolveIntersectionWithBounds(current);
+		if (movedByBounds) { neighborGrid->update(current, particles.position(current)); invalidatedParticles.insert(current); }
+
+		neighborGrid->gatherNeighbors(current, intersectionNeighbors);
+		for (size_t i = 0; i < intersectionNeighbors.size(); i++) {
+			size_t neighbor = intersectionNeighbors[i];
+			if (!movedByBounds && neighbor == intersectionPushedBy[current]) { continue; }
+			if (!resolveIntersectionWithParticle(current, neighbor)) { continue; }
+			neighborGrid->update(neighbor, particles.position(neighbor));
+			intersectionPushedBy[neighbor] = current;
+			if (intersectionQueued[neighbor]) { continue; }
+			intersectionQueue[(queueFront + queuedCount) % particleCount] = neighbor;
+			intersectionQueued[neighbor] = true;
+			queuedCount++;
 		}
-		} else {
+	}
+
+	if (broadPhase == BroadPhase::SWEEP_AND_PRUNE && engineMode == EngineMode::SUB_STEPPING && !invalidatedParticles.empty()) { sweepAndPrune.update(particles, particleCount, currentSubStep, -1); }			// The serial search resolves in the middle of the sub-step, and the particles that it hasn't gotten to yet need up to date partners.
+
+	COUNT_STAT(if (visitBudget - visitsLeft > threadStats.maxIntersectionDepth) { threadStats.maxIntersectionDepth = visitBudget - visitsLeft; });
+	if (queuedCount == 0) { return; }
+	COUNT_STAT(threadStats.intersectionBudgetHits++);
+	debuglogger::out << debuglogger::error << "overlap resolution didn't converge, " << (uint32_t)queuedCount << " particles are left for later" << debuglogger::endl;
+	for (; queuedCount != 0; queuedCount--) {
+		size_t left = intersectionQueue[queueFront];
+		queueFront = (queueFront + 1) % particleCount;
+		intersectionQueued[left] = false;
+		particles.setFlag(left, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION, true);
+	}
+}
 
-		for (size_t i = tempBreadthThing; i < currentIntersectionParticleIndex; i++) {
-			if (intersectionStack.size() >= 2 && *(intersectionStack.end() - 2) == i) { continue; }
-			if (resolveIntersectionWithParticle(currentIntersectionParticleIndex, i)) {
-				tempBreadthThing = 0; goto thinglabel;
+// Redoes the collision search for the particles that resolveIntersections moved, since whatever the search found for them so far is based on where they were before.
+// The search has already gone through every particle below currentLoopIndex, so an invalidated particle below that gets searched against all the others again, including its wall collisions.
+// An invalidated particle at or above currentLoopIndex still gets its own turn later, it only has to be checked against the particles that have already had theirs.
+// A pair of two invalidated particles only gets checked once, by the higher of the two.
+// NOTE: Collisions that the search found with the old positions aren't taken back, same as before. They only make the sub-step end earlier than necessary.
+void Scene::recalculateInvalidatedData(size_t currentLoopIndex) {
+	TRACE_SCOPE("recalculate invalidated");
+	const std::vector<size_t>& invalidated = invalidatedParticles.sort();
+	COUNT_STAT(if (invalidated.size() > threadStats.maxInvalidatedParticles) { threadStats.maxInvalidatedParticles = invalidated.size(); });
+	for (size_t i = 0; i < invalidated.size(); i++) {
+		size_t aIndex = invalidated[i];
+		bool searchedAlready = aIndex < currentLoopIndex;
+		Vector2f remainingAlphaVel = particles.velocity(aIndex) * currentSubStep;
+
+		if (broadPhase == BroadPhase::UNIFORM_GRID) {
+			if (searchedAlready && grid.isBorderCell(grid.particleCells[aIndex])) { findWallCollision(aIndex, remainingAlphaVel); }
+			grid.gatherNeighbors(aIndex, broadPhaseCandidates);
+			for (size_t j = 0; j < broadPhaseCandidates.size(); j++) {
+				size_t bIndex = broadPhaseCandidates[j];
+				if (!searchedAlready && bIndex >= currentLoopIndex) { continue; }
+				if (bIndex < aIndex && invalidatedParticles.contains(bIndex)) { continue; }
+				findCollision(aIndex, bIndex, remainingAlphaVel);
 			}
-		}
-		for (size_t i = ((tempBreadthThing < currentIntersectionParticleIndex + 1) ? (currentIntersectionParticleIndex + 1) : tempBreadthThing); i < particleCount; i++) {
-			if (intersectionStack.size() >= 2 && *(intersectionStack.end() - 2) == i) { continue; }
-			if (resolveIntersectionWithParticle(currentIntersectionParticleIndex, i)) { tempBreadthThing = 0; goto thinglabel; }
+			continue;
 		}
 
+		if (searchedAlready) { findWallCollision(aIndex, remainingAlphaVel); }
+		size_t end = searchedAlready ? particleCount : currentLoopIndex;
+		for (size_t bIndex = 0; bIndex < end; bIndex++) {
+			if (bIndex == aIndex || (bIndex < aIndex && invalidatedParticles.contains(bIndex))) { continue; }
+			findCollision(aIndex, bIndex, remainingAlphaVel);
 		}
+	}
+	invalidatedParticles.clear();											// Everything in there is up to date now, so the next resolution in this sub-step doesn't have to redo these.
+}
+
+float Scene::requiredGridCellSize() const noexcept { return 2 * (gridMaxRadius + gridSpeedBound * currentSubStep) + GRID_CELL_PADDING; }
 
+// Sizes the grid for the coming step. The grid only gets rebuilt if the cell size has become too small (or way too big) or the scene changed shape, otherwise all the particles just get moved to their new cells.
+void Scene::prepareGrid() {
+	gridMaxRadius = 0;
+	float maxSquaredSpeed = 0;
+	for (size_t i = 0; i < particleCount; i++) {
+		if (particles.radius[i] > gridMaxRadius) { gridMaxRadius = particles.radius[i]; }
+		float squaredSpeed = particles.velocity(i).getSquareLength();
+		if (squaredSpeed > maxSquaredSpeed) { maxSquaredSpeed = squaredSpeed; }
+	}
+	gridSpeedBound = sqrt(maxSquaredSpeed);
 
-		tempBreadthThing = intersectionStack.back() + 1;
-		intersectionStack.pop_back();
-		if (intersectionStack.size() == 0) { break; }
+	float cellSize = requiredGridCellSize();
+	bool countDrifted = particleCount > 2 * grid.rebuildParticleCount || particleCount * 2 < grid.rebuildParticleCount;			// Inserted and removed particles keep the grid up to date, but the cell count limit only follows the particle count on a rebuild.
+	if (grid.particleCells.size() != particleCount || grid.width != width || grid.height != height || cellSize > grid.cellSize || cellSize * 2 < grid.requestedCellSize || countDrifted) {
+		grid.rebuild(particles, particleCount, width, height, cellSize);
+		return;
 	}
+	for (size_t i = 0; i < particleCount; i++) { grid.update(i, particles.position(i)); }
 }
 
-// TODO: The below is a modified version of the counting sort algorithm, which works great for things whose integer representations need to be sorted.
-// This is AFAIK the most efficient sorting algorithm to sort integers (at least unsigned ones, haven't thought about signed ones).
-// Write some documentation in the code about what the different steps of this algorithm are and what the original algorithm looks like. Also explain the difference between the standard algorithm and the one shown in that one bookmarked blog-post.
-// Also write documentation for the function as a whole of course.
-void Scene::sortInvalidatedParticlesAndRemoveMultiples(size_t currentLoopIndex) {
-	bool* particleCounts = new bool[particleCount];													// TODO: No reason to keep allocating this over and over, you can cache a global one and just resize that whenever you need to.
-	for (size_t i = 0; i < particleCount; i++) { particleCounts[i] = false; }
-	for (size_t i = 0; i < invalidatedParticles.size(); i++) { particleCounts[invalidatedParticles[i]] = true; }
-	size_t sortedInvalidatedParticlesIndex = 0;
-	for (size_t i = 0; i < particleCount; i++) { if (i >= currentLoopIndex) { break; } if (particleCounts[i]) { invalidatedParticles[sortedInvalidatedParticlesIndex++] = i; } }
-	delete[] particleCounts;
-	invalidatedParticles.resize(sortedInvalidatedParticlesIndex);
+// Collisions can make particles faster than the fastest particle was at the start of the step (the velocity components along the normal get swapped), in which case the cells might not be big enough anymore.
+void Scene::updateGridSpeedBound(size_t particleIndex) {
+	float speed = particles.velocity(particleIndex).getLength();
+	if (speed <= gridSpeedBound) { return; }
+	gridSpeedBound = speed;
+	float cellSize = requiredGridCellSize();
+	if (cellSize > grid.cellSize) { grid.rebuild(particles, particleCount, width, height, cellSize); }
 }
 
-/*void Scene::findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainingAlphaVel) {
-	// TODO: Implement raw collision calculation, that just finds the t value and checks if this is the most relevant collision, same as other one, just without the guard code, because that can't be useful at this stage.
-}*/
+void Scene::findCollisionsInGrid(size_t aIndex, const Vector2f& remainingAlphaVel) {
+	if (grid.isBorderCell(grid.particleCells[aIndex])) { findWallCollision(aIndex, remainingAlphaVel); }
+	grid.gatherCandidates(aIndex, broadPhaseCandidates);
+	findCollisionsInCandidates(aIndex, remainingAlphaVel);
+}
 
-void Scene::recalculateInvalidatedData(size_t currentLoopIndex) {
-	sortInvalidatedParticlesAndRemoveMultiples(currentLoopIndex);
-	Vector2f remainingAlphaVel;
-	size_t previousNormalParticleIndex = 0;
-	for (size_t invalidatedParticleIndex = 0; invalidatedParticleIndex < invalidatedParticles.size(); invalidatedParticleIndex++)
-	{
-		remainingAlphaVel = particles[invalidatedParticles[invalidatedParticleIndex]].vel * currentSubStep;
-		findWallCollision(invalidatedParticleIndex, remainingAlphaVel);
-		for (size_t previousInvalidatedParticleIndex = 0; previousInvalidatedParticleIndex < invalidatedParticleIndex; previousInvalidatedParticleIndex++)
-		{						// TODO: using iterators here might even be more efficient, check those out and see if they're applicable here.
-			for (; previousNormalParticleIndex < invalidatedParticles[previousInvalidatedParticleIndex]; previousNormalParticleIndex++)
-			{
-				findCollision(invalidatedParticles[invalidatedParticleIndex], previousNormalParticleIndex, remainingAlphaVel);
-			}
-			previousNormalParticleIndex++;
-		}
-		for (; previousNormalParticleIndex < invalidatedParticles[invalidatedParticleIndex]; previousNormalParticleIndex++)
-		{
-			findCollision(invalidatedParticles[invalidatedParticleIndex], previousNormalParticleIndex, remainingAlphaVel);
-		}
-		previousNormalParticleIndex++;
-		for (; previousNormalParticleIndex < particleCount; previousNormalParticleIndex++)
-		{
-			findCollision(invalidatedParticles[invalidatedParticleIndex], previousNormalParticleIndex, remainingAlphaVel);
-		}
+void Scene::findCollisionsInSweep(size_t aIndex, const Vector2f& remainingAlphaVel) {
+	findWallCollision(aIndex, remainingAlphaVel);
+	sweepAndPrune.gatherCandidates(aIndex, broadPhaseCandidates);
+	findCollisionsInCandidates(aIndex, remainingAlphaVel);
+}
+
+// Runs the pair search for aIndex against the candidates that the broad phase put into broadPhaseCandidates, which have to be in ascending order.
+void Scene::findCollisionsInCandidates(size_t aIndex, const Vector2f& remainingAlphaVel) {
+	if (simdLevel == SimdLevel::SCALAR || broadPhaseCandidates.empty()) {
+		for (size_t i = 0; i < broadPhaseCandidates.size(); i++) { findCollision(aIndex, broadPhaseCandidates[i], remainingAlphaVel); }
+		return;
 	}
+
+	broadPhaseCandidateStore.resize(broadPhaseCandidates.size());
+	for (size_t i = 0; i < broadPhaseCandidates.size(); i++) {
+		size_t candidate = broadPhaseCandidates[i];
+		broadPhaseCandidateStore.x[i] = particles.x[candidate];
+		broadPhaseCandidateStore.y[i] = particles.y[candidate];
+		broadPhaseCandidateStore.vx[i] = particles.vx[candidate];
+		broadPhaseCandidateStore.vy[i] = particles.vy[candidate];
+		broadPhaseCandidateStore.radius[i] = particles.radius[candidate];
+	}
+	PairScanAlpha alpha = { particles.x[aIndex], particles.y[aIndex], particles.vx[aIndex], particles.vy[aIndex], particles.radius[aIndex], remainingAlphaVel.x, remainingAlphaVel.y, currentSubStep };
+	PairScanBetas betas = { broadPhaseCandidateStore.x, broadPhaseCandidateStore.y, broadPhaseCandidateStore.vx, broadPhaseCandidateStore.vy, broadPhaseCandidateStore.radius, broadPhaseCandidates.size() };
+	PairScanResult result;
+	PairScanCollector collector;
+	PairScanCollector* collectorPointer = prepareScanCollector(collector, broadPhaseCandidates.size());
+	scanPairs(simdLevel, alpha, betas, lowestT, result, collectorPointer);
+	COUNT_STAT(threadStats.pairTests += betas.count; threadStats.vectorizedPairTests += betas.count);
+	if (collectorPointer != nullptr) { for (size_t i = 0; i < collector.count; i++) { eventBatchCandidates.push_back({ collector.candidates[i].t, aIndex, broadPhaseCandidates[collector.candidates[i].index], false }); } }
+	if (result.found) { applyPairScanResult(aIndex, broadPhaseCandidates[result.index], result); }
 }
 
 void Scene::findWallCollision(size_t index, const Vector2f& remainingVel) {
-	Particle& particle = particles[index];
+	float& x = particles.x[index];
+	float& y = particles.y[index];
+	float radius = particles.radius[index];
 
-	float paddedWidth = width - particle.radius;					// TODO: This paddedBound stuff can be easily cached. You should make a very simple system of functions that handle the various caches that you're gonna end up having. To make sure they get updated at the right time.
-	float paddedHeight = height - particle.radius;					// TODO: I'm very sure that storing an array of cached padded bounds for each particle (since they all can be differently sized) would not make this more efficient. The amount of instructions stays the same AFAIK. Can't see how it would help.
+	float paddedWidth = width - radius;					// TODO: This paddedBound stuff can be easily cached. You should make a very simple system of functions that handle the various caches that you're gonna end up having. To make sure they get updated at the right time.
+	float paddedHeight = height - radius;					// TODO: I'm very sure that storing an array of cached padded bounds for each particle (since they all can be differently sized) would not make this more efficient. The amount of instructions stays the same AFAIK. Can't see how it would help.
 
-	Vector2f futurePos = particle.pos + remainingVel;
+	Vector2f futurePos = Vector2f(x, y) + remainingVel;
 
 	// TODO: Find a way to clean up the next bit of code, even if it's just putting it on separate lines.
-	if (futurePos.x > paddedWidth) { float t = (paddedWidth - particle.pos.x) / remainingVel.x; if (t < lowestT) { lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = false; return; } }
-	else if (futurePos.x < particle.radius) { float t = (particle.radius - particle.pos.x) / remainingVel.x; if (t < lowestT) { lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = false; return; } }
+	if (futurePos.x > paddedWidth) { float t = (paddedWidth - x) / remainingVel.x; collectEventBatchCandidate(t, index, false, true); if (t < lowestT) { lowestTWasForced = t < 0; lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = false; return; } }
+	else if (futurePos.x < radius) { float t = (radius - x) / remainingVel.x; collectEventBatchCandidate(t, index, false, true); if (t < lowestT) { lowestTWasForced = t < 0; lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = false; return; } }
 
-	if (futurePos.y > paddedHeight) { float t = (paddedHeight - particle.pos.y) / remainingVel.y; if (t < lowestT) { lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = true; return; } }
-	else if (futurePos.y < particle.radius) { float t = (particle.radius - particle.pos.y) / remainingVel.y; if (t < lowestT) { lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = true; return; } }
+	if (futurePos.y > paddedHeight) { float t = (paddedHeight - y) / remainingVel.y; collectEventBatchCandidate(t, index, true, true); if (t < lowestT) { lowestTWasForced = t < 0; lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = true; return; } }
+	else if (futurePos.y < radius) { float t = (radius - y) / remainingVel.y; collectEventBatchCandidate(t, index, true, true); if (t < lowestT) { lowestTWasForced = t < 0; lowestT = t < 0 ? 0 : t; noCollisions = false; boundsCollision = true; currentColliderA = index; currentColliderB = true; return; } }
 
 	return;
 
@@ -253,8 +438,8 @@ void Scene::findWallCollision(size_t index, const Vector2f& remainingVel) {
 	// BTW, the calculations are unnecessary because once we set lowestT to 0 here, no other calculation will change the value again, they do nothing for us, hence, useless (like I said, theoretically).
 	// TODO: Could we just do the optimization but then start a loop in this function to go through everything and just check the guards? That would be the best of both worlds and be super efficient.
 
-	if (particle.pos.x < particle.radius) {
-		particle.pos.x = particle.radius;
+	if (x < radius) {
+		x = radius;
 		// TODO: When we get a hit in one of these buckets, do the following: go through all the upcoming particles from inside this function and make sure all of their intersection guard code gets a chance to run. Then, set the i and j member variables to a state that almost resembles the start of the main while loop
 		// (your not gonna be able to get the main while loop start simulated perfectly, but you'll get close), then set lowestT to 1 and noCollisions to true, then do the first particles calculations (wall hits and stuff, because the for loop isn't going to reach that even with i and j set to 0).
 		// What this does is this: with no overhead, you've created a situation where, after returning from this function, it'll be as if the next substep has started, which it essentially has. This will forego a bunch of unnecessary processing of all sorts of stuff (unnecessary because of intersection and because lowestT is 0
@@ -262,23 +447,20 @@ void Scene::findWallCollision(size_t index, const Vector2f& remainingVel) {
 		// Just as a reminder, the plan is also the do the reflections directly in this function when the need arises (only when doing out of bounds intersection resolution), and also in the intersection guard in the findCollision function.
 		// This will allow all of the intersections of the substep to be resolved and reflected without having to start new substeps in between because the collision reflector has to run. The collision reflector does one pair at a time, which we don't have to abide by if we forego it in these specific circumstances.
 	}
-	else { unsigned int xBoundary = width - particle.radius; if (particle.pos.x > xBoundary) { particle.pos.x = xBoundary; } }
-	// NOTE: You might consider caching width - particle.radius for every particle to make the above faster, but indexing into the resulting array would be less efficient than the current setup (because the array would be in heap), don't do it.
-	if (particle.pos.y < particle.radius) { particle.pos.y = particle.radius; }
-	else { unsigned int yBoundary = height - particle.radius; if (particle.pos.y > yBoundary) { particle.pos.y = yBoundary; } }
+	else { unsigned int xBoundary = width - radius; if (x > xBoundary) { x = xBoundary; } }
+	// NOTE: You might consider caching width - radius for every particle to make the above faster, but indexing into the resulting array would be less efficient than the current setup (because the array would be in heap), don't do it.
+	if (y < radius) { y = radius; }
+	else { unsigned int yBoundary = height - radius; if (y > yBoundary) { y = yBoundary; } }
 }
 
-void Scene::findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainingAlphaVel) {
-	Particle& alpha = particles[aIndex];
-	Particle& beta = particles[bIndex];
-
-	if (bIndex == lastParticle) {
-		//debuglogger::out << "bruh" << debuglogger::endl;
-	}
+CollisionPrediction Scene::predictCollision(size_t aIndex, size_t bIndex, const Vector2f& betaPos, const Vector2f& remainingAlphaVel, float subStep, float& t) const {
+	Vector2f alphaPos = particles.position(aIndex);
+	Vector2f alphaVel = particles.velocity(aIndex);
+	Vector2f betaVel = particles.velocity(bIndex);
 
 	// If the two particles are inside each other (which shouldn't ever happen unless they are spawned wrong or their positions are changed from outside of the simulation), move them outside of each other using the shortest possible path.
-	float minDist = alpha.radius + beta.radius;				// TODO: This should be moved to the top, two particles can still intersect even though they just hit each other if some weird outside forces are applied, this safety feature needs to be at the top.
-	Vector2f toAlphaFromBeta = alpha.pos - beta.pos;
+	float minDist = particles.radius[aIndex] + particles.radius[bIndex];				// TODO: This should be moved to the top, two particles can still intersect even though they just hit each other if some weird outside forces are applied, this safety feature needs to be at the top.
+	Vector2f toAlphaFromBeta = alphaPos - betaPos;
 	//float distance = toAlphaFromBeta.getLength();
 	/*if (distance < minDist) {						// TODO: See about getting not only one of these intersections reflected per run. Maybe store currentColliders in a two vectors so that you can massively reflect stuff when this happens. But the overhead probably isn't worth it, think through it a couple times.
 		float adjustment = minDist - distance;						// TODO: Instead of doing that, just reflect the particles directly in this code block, that would be an awesome solution, somehow, your going to need to be able to tell the reflector to do nothing though. Too much overhead?
@@ -304,11 +486,12 @@ void Scene::findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainin
 	// This is because we're just looking at the dot product shadows of the vectors on the distDirNorm. As long as the shadows indicate an equivalent value, the particles can move however far they want in a perpendicular direction from the distDirNorm.
 	// This isn't an issue though, because we want to filter out the moving apart particles anyway. The equivalent case also happens when the velocities are the same, so we can still filter that out as well, so everythings fine, it's just a little unexpected.
 	Vector2f distDirNorm = toAlphaFromBeta.normalize();
-	float alphaVelTowardsComp = alpha.vel % distDirNorm;
-	float betaVelTowardsComp = beta.vel % distDirNorm;
-	if (alphaVelTowardsComp >= betaVelTowardsComp) { return; }
+	float alphaVelTowardsComp = alphaVel % distDirNorm;
+	float betaVelTowardsComp = betaVel % distDirNorm;
+	if (alphaVelTowardsComp >= betaVelTowardsComp) { return CollisionPrediction::NONE; }
+	COUNT_STAT(threadStats.quadraticSolves++);
 
-	Vector2f remainingBetaVel = beta.vel * currentSubStep;
+	Vector2f remainingBetaVel = betaVel * subStep;
 
 	// Construct coefficients necessary for solving the quadratic equation the describes particle collisions.
 
@@ -331,7 +514,7 @@ void Scene::findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainin
 	float r = b * b - c;
 
 	// If no collisions (because trajectories are parallel and too far away from each other for a parallel (head on) collision), return. This can also happen when one or both of the particles aren't moving.
-	if (r < 0) { return; }
+	if (r < 0) { return CollisionPrediction::NONE; }
 
 	// The following path gets taken if 1 possible collision (parallel lines that are exactly the right distance away), or 2 possible collisions (all other non-handled collisions).
 	// It's inefficient to have separate branch for 1 collision because it happens so rarely, we just handle it through the math of 2 collision handler.
@@ -368,36 +551,241 @@ void Scene::findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainin
 
 	if (t1 < t2) {
 		if (t1 < 0) {
-			if (t2 > 0) { lowestT = 0; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; return; }			// NOTE: It is not possible for t2 to equal 0 when t1 is less than 0 because the particles have to be moving towards each other at this stage,
-			return;																																				// which is why we don't need to check for it, even though it looks like we should.
+			if (t2 > 0) { return CollisionPrediction::OVERLAPPING; }			// NOTE: It is not possible for t2 to equal 0 when t1 is less than 0 because the particles have to be moving towards each other at this stage,
+			return CollisionPrediction::NONE;									// which is why we don't need to check for it, even though it looks like we should.
 		}
-		if (t1 < lowestT) { lowestT = t1; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; return; }
+		t = t1;
+		return CollisionPrediction::COLLISION;
 	}
-	else {
-		if (t2 < 0) {
-			if (t1 > 0) { lowestT = 0; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; return; }
-			return;
-		}
-		if (t2 < lowestT) { lowestT = t2; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; return; }
+	if (t2 < 0) {
+		if (t1 > 0) { return CollisionPrediction::OVERLAPPING; }
+		return CollisionPrediction::NONE;
 	}
+	t = t2;																			// NOTE: t2 can be NaN here if the two particles are exactly on top of each other. Callers only ever accept t if it's lower than some bound, which a NaN never is, so that's fine.
+	return CollisionPrediction::COLLISION;
+}
+
+// Runs predictCollision for the given pair and makes it the current collision if it happens before every other collision that has been found in this sub-step so far.
+void Scene::findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainingAlphaVel) {
+	if (bIndex == lastParticle) {
+		//debuglogger::out << "bruh" << debuglogger::endl;
+	}
+
+	COUNT_STAT(threadStats.pairTests++);
+	float t;
+	switch (predictCollision(aIndex, bIndex, particles.position(bIndex), remainingAlphaVel, currentSubStep, t)) {
+	case CollisionPrediction::NONE: return;
+	case CollisionPrediction::OVERLAPPING: lowestTWasForced = true; lowestT = 0; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; return;
+	case CollisionPrediction::COLLISION: collectEventBatchCandidate(t, aIndex, bIndex, false); if (t < lowestT) { lowestTWasForced = false; lowestT = t; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; } return;
+	}
+}
+
+// Same as calling findCollision for every particle in [begin, end) in order, but with the vectorized kernel if there is one. The store's arrays are padded, so the kernels can read past end.
+void Scene::findCollisionsInRange(size_t aIndex, size_t begin, size_t end, const Vector2f& remainingAlphaVel) {
+	if (simdLevel == SimdLevel::SCALAR) {
+		for (size_t j = begin; j < end; j++) { findCollision(aIndex, j, remainingAlphaVel); }
+		return;
+	}
+	if (begin >= end) { return; }
+
+	PairScanAlpha alpha = { particles.x[aIndex], particles.y[aIndex], particles.vx[aIndex], particles.vy[aIndex], particles.radius[aIndex], remainingAlphaVel.x, remainingAlphaVel.y, currentSubStep };
+	PairScanBetas betas = { particles.x + begin, particles.y + begin, particles.vx + begin, particles.vy + begin, particles.radius + begin, end - begin };
+	PairScanResult result;
+	PairScanCollector collector;
+	PairScanCollector* collectorPointer = prepareScanCollector(collector, end - begin);
+	scanPairs(simdLevel, alpha, betas, lowestT, result, collectorPointer);
+	COUNT_STAT(threadStats.pairTests += betas.count; threadStats.vectorizedPairTests += betas.count);
+	if (collectorPointer != nullptr) { for (size_t i = 0; i < collector.count; i++) { eventBatchCandidates.push_back({ collector.candidates[i].t, aIndex, begin + collector.candidates[i].index, false }); } }
+	if (result.found) { applyPairScanResult(aIndex, begin + result.index, result); }
+}
+
+// Does what findCollision does with the result of a whole scan. The kernels already made sure that a non-forced result is below lowestT.
+void Scene::applyPairScanResult(size_t aIndex, size_t bIndex, const PairScanResult& result) {
+	if (result.forced) { lowestTWasForced = true; lowestT = 0; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false; return; }
+	lowestTWasForced = false; lowestT = result.t; currentColliderA = aIndex; currentColliderB = bIndex; noCollisions = false; boundsCollision = false;
+}
+
+std::vector<BatchedEvent> eventBatch;
+std::vector<bool> eventBatchTouched;
+std::vector<size_t> eventBatchTouchedParticles;
+std::vector<size_t> reflectedParticles;					// Every particle whose velocity changed in the current sub-step, so that the grid's speed bound can be updated.
+
+// Orders the events by time, and by search order (see comesFirstInSearchOrder) on ties, which puts the collision that the search picked first.
+static bool happensBefore(const BatchedEvent& a, const BatchedEvent& b) noexcept {
+	if (a.t != b.t) { return a.t < b.t; }
+	if (a.a != b.a) { return a.a < b.a; }
+	if (a.wall != b.wall) { return a.wall; }
+	return a.b < b.b;
+}
+
+// Reflects the earliest collision together with every other collision that was found within simultaneousEventTolerance of it, so that symmetric setups (a row of particles hitting a wall, particles spawned in a lattice with the same velocity, ...) don't need a whole sub-step for every single collision.
+// A collision only gets reflected if none of its particles were part of an earlier collision in the batch, reflected or not, because reflecting changes the velocity that the later prediction was based on. Those collisions just get found again in the next sub-step.
+// NOTE: The particles have only been moved up to the earliest collision, so the later ones get reflected a tiny bit before they actually touch. The error is at most the tolerance times the speed of the particles, which can't be seen.
+void Scene::reflectSimultaneousEvents() {
+	float limit = lowestT + eventBatchToleranceT;
+	eventBatch.clear();
+	for (size_t i = 0; i < eventBatchCandidates.size(); i++) { if (eventBatchCandidates[i].t <= limit) { eventBatch.push_back(eventBatchCandidates[i]); } }
+	std::sort(eventBatch.begin(), eventBatch.end(), happensBefore);
+
+	if (eventBatchTouched.size() < particleCount) { eventBatchTouched.resize(particleCount, false); }
+	reflectedParticles.clear();
+	for (size_t i = 0; i < eventBatch.size(); i++) {
+		const BatchedEvent& event = eventBatch[i];
+		bool blocked = eventBatchTouched[event.a] || (!event.wall && eventBatchTouched[event.b]);
+		if (!eventBatchTouched[event.a]) { eventBatchTouched[event.a] = true; eventBatchTouchedParticles.push_back(event.a); }
+		if (!event.wall && !eventBatchTouched[event.b]) { eventBatchTouched[event.b] = true; eventBatchTouchedParticles.push_back(event.b); }
+		if (blocked) { continue; }
+
+		currentColliderA = event.a;
+		currentColliderB = event.b;
+		boundsCollision = event.wall;
+		reflectCollision();
+		reflectedParticles.push_back(event.a);
+		if (!event.wall) { reflectedParticles.push_back(event.b); }
+	}
+	for (size_t i = 0; i < eventBatchTouchedParticles.size(); i++) { eventBatchTouched[eventBatchTouchedParticles[i]] = false; }
+	eventBatchTouchedParticles.clear();
 }
 
 void Scene::reflectCollision() {
-		Particle& alpha = particles[currentColliderA];
+	COUNT_STAT(threadStats.events++);
 	if (boundsCollision) {
+		COUNT_STAT(threadStats.wallEvents++);
+		LOG_COLLISION(particles.velocity(currentColliderA), currentColliderB ? Vector2f(particles.vx[currentColliderA], -particles.vy[currentColliderA]) : Vector2f(-particles.vx[currentColliderA], particles.vy[currentColliderA]), Vector2f(0, 0), Vector2f(0, 0));
 		if (currentColliderB) {
-			alpha.vel.y = -alpha.vel.y;
+			particles.vy[currentColliderA] = -particles.vy[currentColliderA];
 			return;
 		}
-		alpha.vel.x = -alpha.vel.x;
+		particles.vx[currentColliderA] = -particles.vx[currentColliderA];
 		return;
 	}
 
-		Particle& beta = particles[currentColliderB];
-		Vector2f normal = (beta.pos - alpha.pos).normalize();								// TODO: Caches these because you calculate them for every pair anyway in the guard code for findCollision.
-		Vector2f relV = ((alpha.vel % normal) * normal) - ((beta.vel % normal) * normal);			// TODO: This can be algebraically optimized.
-		alpha.vel -= relV;
-		beta.vel += relV;
+		Vector2f alphaVel = particles.velocity(currentColliderA);
+		Vector2f betaVel = particles.velocity(currentColliderB);
+		Vector2f normal = (particles.position(currentColliderB) - particles.position(currentColliderA)).normalize();								// TODO: Caches these because you calculate them for every pair anyway in the guard code for findCollision.
+		Vector2f relV = ((alphaVel % normal) * normal) - ((betaVel % normal) * normal);			// TODO: This can be algebraically optimized.
+		LOG_COLLISION(alphaVel, alphaVel - relV, betaVel, betaVel + relV);
+		particles.setVelocity(currentColliderA, alphaVel - relV);
+		particles.setVelocity(currentColliderB, betaVel + relV);
+}
+
+void Scene::findCollisionsSerially() {
+	intersectionGridCurrent = false;
+	if (particleCount < 2) {											// No pairs, and the pair at the end below would read past the particles. What's left still bounces off of the bounds.
+		for (size_t i = 0; i < particleCount; i++) {
+			if (particles.hasFlag(i, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION)) { resolveIntersections(i); recalculateInvalidatedData(i); }
+			findWallCollision(i, particles.velocity(i) * currentSubStep);
+		}
+		return;
+	}
+	for (int i = 0; i < lastParticle - 1; i++) {
+		if (particles.hasFlag(i, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION)) { resolveIntersections(i); recalculateInvalidatedData(i); }
+		Vector2f remainingAlphaVel = particles.velocity(i) * currentSubStep;
+		if (broadPhase == BroadPhase::UNIFORM_GRID) { findCollisionsInGrid(i, remainingAlphaVel); continue; }
+		if (broadPhase == BroadPhase::SWEEP_AND_PRUNE) { findCollisionsInSweep(i, remainingAlphaVel); continue; }
+		findWallCollision(i, remainingAlphaVel);
+		findCollisionsInRange(i, i + 1, particleCount, remainingAlphaVel);				// NOTE: If a weird intersection happens, then lowestT might be zero before we get to the end of these loops. We could do an if statement to exit prematurely in that case, but the chances of it happening are too low. It would be inefficient to waste time checking that case.
+	}
+
+		if (particles.hasFlag(lastParticle - 1, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION)) { resolveIntersections(lastParticle - 1); recalculateInvalidatedData(lastParticle - 1); }
+		Vector2f remainingAlphaVel = particles.velocity(lastParticle - 1) * currentSubStep;
+		findWallCollision(lastParticle - 1, remainingAlphaVel);
+		if (particles.hasFlag(lastParticle, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION)) { resolveIntersections(lastParticle); recalculateInvalidatedData(lastParticle); }
+		else { findCollision(lastParticle - 1, lastParticle, remainingAlphaVel); }									// NOTE: If a weird intersection happens, then lowestT might be zero before we get to the end of these loops. We could do an if statement to exit prematurely in that case, but the chances of it happening are too low. It would be inefficient to waste time checking that case.
+		findWallCollision(lastParticle, particles.velocity(lastParticle) * currentSubStep);
+}
+
+// Same search as the one findCollisionsSerially does for a single particle, except that intersections aren't handled here (see findCollisionsInParallel).
+void Scene::findCollisionsForParticle(size_t index) {
+	Vector2f remainingAlphaVel = particles.velocity(index) * currentSubStep;
+	if (broadPhase == BroadPhase::UNIFORM_GRID) { findCollisionsInGrid(index, remainingAlphaVel); return; }
+	if (broadPhase == BroadPhase::SWEEP_AND_PRUNE) { findCollisionsInSweep(index, remainingAlphaVel); return; }
+	findWallCollision(index, remainingAlphaVel);
+	findCollisionsInRange(index, index + 1, particleCount, remainingAlphaVel);
+}
+
+// The amount of chunks the particles get split into per thread for the parallel search. The inner loop gets shorter for every particle (it's a triangle), so equally sized chunks per thread would give the first threads way more work.
+// Lots of small chunks that the threads grab one after another even that out.
+#define PARALLEL_SEARCH_CHUNKS_PER_THREAD 32
+
+struct CollisionSearchResult
+{
+	float lowestT;
+	size_t currentColliderA;
+	size_t currentColliderB;
+	bool noCollisions;
+	bool boundsCollision;
+	bool lowestTWasForced;
+};
+
+std::vector<CollisionSearchResult> parallelSearchResults;
+std::vector<std::vector<BatchedEvent>> parallelEventBatches;
+
+// Returns true if the collision in a comes before the collision in b in the order that findCollisionsSerially looks at them (a particle's wall collisions come before its pair collisions).
+static bool comesFirstInSearchOrder(const CollisionSearchResult& a, const CollisionSearchResult& b) noexcept {
+	if (a.currentColliderA != b.currentColliderA) { return a.currentColliderA < b.currentColliderA; }
+	if (a.boundsCollision != b.boundsCollision) { return a.boundsCollision; }
+	return !a.boundsCollision && a.currentColliderB < b.currentColliderB;
+}
+
+// Splits the particles into chunks that the worker threads grab one after another. Every thread keeps its own earliest collision in its thread_local search state, and the results are combined at the end.
+// The threads grab their chunks in ascending order, so every thread sees its own pairs in the same order as findCollisionsSerially would, which is what makes it possible to combine the results into exactly the collision the serial search would have found, ties included:
+// If any thread has a forced (t = 0) collision, the forced collision that comes last in search order wins, otherwise the lowest t wins and ties go to the collision that comes first in search order.
+// NOTE: Particles that are marked for intersection resolution get resolved before the search starts instead of in the middle of it, so sub-steps with intersections can end up different from the serial search. Those only happen after outside changes to the scene.
+void Scene::findCollisionsInParallel() {
+	intersectionGridCurrent = false;
+	for (size_t i = 0; i < particleCount; i++) {
+		if (particles.hasFlag(i, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION)) { resolveIntersections(i); }
+	}
+	invalidatedParticles.clear();											// Every particle gets searched below anyway, so there is nothing to recalculate.
+
+	unsigned int threadCount = workers.threadCount();
+	parallelSearchResults.resize(threadCount);
+	size_t chunkSize = particleCount / (threadCount * PARALLEL_SEARCH_CHUNKS_PER_THREAD) + 1;
+	parallelEventBatches.resize(threadCount);
+	std::atomic<size_t> nextChunk(0);
+	float subStep = currentSubStep;
+	bool collecting = collectingEventBatch;
+	float toleranceT = eventBatchToleranceT;
+
+	workers.run([this, &nextChunk, chunkSize, subStep, collecting, toleranceT](unsigned int workerIndex) {
+		TRACE_SCOPE("search chunks");
+		currentSubStep = subStep;
+		lowestT = 1;
+		noCollisions = true;
+		lowestTWasForced = false;
+		collectingEventBatch = collecting;
+		eventBatchToleranceT = toleranceT;
+		eventBatchCandidates.clear();
+		while (true) {
+			size_t begin = nextChunk.fetch_add(1, std::memory_order_relaxed) * chunkSize;
+			if (begin >= particleCount) { break; }
+			size_t end = begin + chunkSize < particleCount ? begin + chunkSize : particleCount;
+			for (size_t i = begin; i < end; i++) { findCollisionsForParticle(i); }
+		}
+		parallelSearchResults[workerIndex] = { lowestT, currentColliderA, currentColliderB, noCollisions, boundsCollision, lowestTWasForced };
+		parallelEventBatches[workerIndex].swap(eventBatchCandidates);
+		addThreadStats(workerIndex);
+	});
+
+	CollisionSearchResult best = { 1, 0, 0, true, false, false };
+	for (unsigned int i = 0; i < threadCount; i++) {
+		const CollisionSearchResult& result = parallelSearchResults[i];
+		if (result.noCollisions) { continue; }
+		if (best.noCollisions) { best = result; continue; }
+		if (result.lowestTWasForced != best.lowestTWasForced) { if (result.lowestTWasForced) { best = result; } continue; }
+		if (result.lowestTWasForced) { if (comesFirstInSearchOrder(best, result)) { best = result; } continue; }
+		if (result.lowestT < best.lowestT || (result.lowestT == best.lowestT && comesFirstInSearchOrder(result, best))) { best = result; }
+	}
+	lowestT = best.lowestT;
+	currentColliderA = best.currentColliderA;
+	currentColliderB = best.currentColliderB;
+	noCollisions = best.noCollisions;
+	boundsCollision = best.boundsCollision;
+	lowestTWasForced = best.lowestTWasForced;
+
+	eventBatchCandidates.clear();
+	for (unsigned int i = 0; i < threadCount; i++) { eventBatchCandidates.insert(eventBatchCandidates.end(), parallelEventBatches[i].begin(), parallelEventBatches[i].end()); }
 }
 
 // TODO: Currently, we are checking for intersections for every particle pair in every sub-step. It would be way more efficient to check all the intersections in the first sub-step, but not in the rest.
@@ -408,38 +796,517 @@ void Scene::reflectCollision() {
 // That means, that even if we were to use guard code every sub-step, we would still be just as vulnerable to bit-flips. There is no reason not to make this more efficient by moving the guard code outside of the substep loop.
 
 void Scene::step() {
+	TRACE_SCOPE("Scene::step");
+	threadStats = SceneStats();
+	workerStats.assign(workers.threadCount(), SceneStats());
+
+	switch (engineMode) {
+	case EngineMode::SUB_STEPPING: stepSubStepping(); break;
+	case EngineMode::EVENT_DRIVEN: stepEventDriven(); break;
+	case EngineMode::TILED_EVENT_DRIVEN: stepTiled(); break;
+	}
+
+	lastStepStats = threadStats;
+	for (size_t i = 0; i < workerStats.size(); i++) { lastStepStats += workerStats[i]; }
+	lastStepStats.earlyRejections = lastStepStats.pairTests - lastStepStats.vectorizedPairTests - lastStepStats.quadraticSolves;			// Saves an increment in predictCollision for every pair that gets rejected.
+
+	stepCount++;
+	if (trajectoryWriter != nullptr) { trajectoryWriter->submit(*this); }				// Every engine leaves the particles in sync at the end of the step.
+}
+
+void Scene::stepSubStepping() {
 	currentSubStep = 1;
+	if (broadPhase == BroadPhase::UNIFORM_GRID) { prepareGrid(); }
 	while (true) {
+		COUNT_STAT(threadStats.loopIterations++);
 		lowestT = 1;
 		noCollisions = true;
+		lowestTWasForced = false;
 		invalidatedParticles.clear();
-		for (int i = 0; i < lastParticle - 1; i++) {
-			if (particles[i].lastInteractionWasIntersection) { resolveIntersections(i); recalculateInvalidatedData(i); particles[i].lastInteractionWasIntersection = false; }
-			Vector2f remainingAlphaVel = particles[i].vel * currentSubStep;
-			findWallCollision(i, remainingAlphaVel);
-			for (int j = i + 1; j < particleCount; j++) {				// TODO: For loop does first iteration before checking right? If it doesn't that is unnecessary work here.
-				findCollision(i, j, remainingAlphaVel);									// NOTE: If a weird intersection happens, then lowestT might be zero before we get to the end of these loops. We could do an if statement to exit prematurely in that case, but the chances of it happening are too low. It would be inefficient to waste time checking that case.
-			}
+		collectingEventBatch = simultaneousEventTolerance >= 0;
+		eventBatchToleranceT = simultaneousEventTolerance / currentSubStep;
+		eventBatchCandidates.clear();
+		if (broadPhase == BroadPhase::SWEEP_AND_PRUNE) { sweepAndPrune.update(particles, particleCount, currentSubStep, -1); }			// Every sub-step, since the intervals follow the velocities, which change with every reflection.
+		{
+			TRACE_SCOPE("candidate search");
+			if (workers.threadCount() > 1) { findCollisionsInParallel(); }
+			else { findCollisionsSerially(); }
 		}
-
-			if (particles[lastParticle - 1].lastInteractionWasIntersection) { resolveIntersections(lastParticle - 1); recalculateInvalidatedData(lastParticle - 1); particles[lastParticle - 1].lastInteractionWasIntersection = false; }
-			Vector2f remainingAlphaVel = particles[lastParticle - 1].vel * currentSubStep;
-			findWallCollision(lastParticle - 1, remainingAlphaVel);
-			if (particles[lastParticle].lastInteractionWasIntersection) { resolveIntersections(lastParticle); recalculateInvalidatedData(lastParticle); particles[lastParticle].lastInteractionWasIntersection = false; }
-			else { findCollision(lastParticle - 1, lastParticle, remainingAlphaVel); }									// NOTE: If a weird intersection happens, then lowestT might be zero before we get to the end of these loops. We could do an if statement to exit prematurely in that case, but the chances of it happening are too low. It would be inefficient to waste time checking that case.
-			findWallCollision(lastParticle, particles[lastParticle].vel * currentSubStep);
 		if (noCollisions) { break; }
+		COUNT_STAT(if (lowestT == 0) { threadStats.zeroTimeEvents++; });
 		float subStepProgress = currentSubStep * lowestT;						// Store the fraction of the current substep that every particle can now safely put behind itself.
 
-		for (int i = 0; i < particleCount; i++) {
-			Particle& particle = particles[i];
-			particle.pos += particle.vel * subStepProgress;
+		{
+			TRACE_SCOPE("drift");
+			float* x = particles.x;
+			float* y = particles.y;
+			const float* vx = particles.vx;
+			const float* vy = particles.vy;
+			for (size_t i = 0; i < particleCount; i++) {							// NOTE: Plain loops over the separate arrays, which the compiler can vectorize.
+				x[i] += vx[i] * subStepProgress;
+				y[i] += vy[i] * subStepProgress;
+			}
+			if (broadPhase == BroadPhase::UNIFORM_GRID) { for (size_t i = 0; i < particleCount; i++) { grid.update(i, particles.position(i)); } }
+		}
+		{
+			TRACE_SCOPE("reflectCollision");
+			reflectionTime = 1 - currentSubStep + subStepProgress;
+			if (collectingEventBatch && !lowestTWasForced) { reflectSimultaneousEvents(); }			// Forced collisions don't get batched, they're rare and only happen after something went wrong anyway.
+			else {
+				reflectCollision();
+				reflectedParticles.clear();
+				reflectedParticles.push_back(currentColliderA);
+				if (!boundsCollision) { reflectedParticles.push_back(currentColliderB); }
+			}
 		}
-		reflectCollision();
 
 		currentSubStep -= subStepProgress;										// Set the next substep to be equal to the fraction of the current substep that we haven't traversed yet.
+		if (broadPhase == BroadPhase::UNIFORM_GRID) {
+			for (size_t i = 0; i < reflectedParticles.size(); i++) { updateGridSpeedBound(reflectedParticles[i]); }
+		}
 	}
-	for (int i = 0; i < particleCount; i++) {
-		particles[i].pos += particles[i].vel * currentSubStep;
+	TRACE_SCOPE("drift");
+	for (size_t i = 0; i < particleCount; i++) {
+		particles.x[i] += particles.vx[i] * currentSubStep;
+		particles.y[i] += particles.vy[i] * currentSubStep;
 	}
 }
+
+// State of the event-driven engine. These are thread_local for the same reason as the sub-step search state, the tiled engine runs the event loops of multiple tiles at once (see stepTiled).
+thread_local float eventTime;							// Current time inside of the step.
+thread_local CollisionCalendar* eventCalendar;			// Where predictions go.
+
+// A prediction against a particle that belongs to another tile's queue in the current window of the tiled engine. The other tile might be ahead of or behind the current time,
+// so the prediction can only be made (or thrown away) once both tiles are done with the window. cause is the event after which the prediction was supposed to be made.
+struct DeferredPrediction
+{
+	CollisionEvent cause;
+	size_t a;
+	size_t b;
+	uint32_t countA;
+};
+
+// The state a particle had when the tiled engine first touched it in the current window, so that the window can be undone.
+struct ParticleUndo
+{
+	size_t index;
+	float x;
+	float y;
+	float vx;
+	float vy;
+	float localTime;
+	uint32_t collisionCount;
+	CollisionEvent lastEvent;
+};
+
+struct TileQueue
+{
+	CollisionCalendar calendar;
+	std::vector<DeferredPrediction> deferred;
+	std::vector<ParticleUndo> undo;
+	std::vector<CollisionRecord> collisions;			// Only get logged once the window has worked out, since a failed window gets undone and run again.
+};
+
+thread_local TileQueue* currentTileQueue;				// The queue of the tile that the calling thread is working on, null outside of the tiled engine's windows.
+thread_local float tiledWindowStart;
+
+// Called by LOG_COLLISION, with the velocities from before and after the reflection.
+void Scene::recordCollision(const Vector2f& alphaVel, const Vector2f& alphaPostVel, const Vector2f& betaVel, const Vector2f& betaPostVel) {
+	uint32_t b = boundsCollision ? (currentColliderB ? COLLISION_LOG_WALL_Y : COLLISION_LOG_WALL_X) : (uint32_t)currentColliderB;
+	float impulse = particles.mass[currentColliderA] * (alphaPostVel - alphaVel).getLength();
+	CollisionRecord collision = { (double)stepCount + reflectionTime, (uint32_t)currentColliderA, b, alphaVel.x, alphaVel.y, alphaPostVel.x, alphaPostVel.y, betaVel.x, betaVel.y, betaPostVel.x, betaPostVel.y, impulse };
+	if (currentTileQueue != nullptr) { currentTileQueue->collisions.push_back(collision); }
+	else { collisionLog->record(collision); }
+}
+
+// How many tiles the scene gets split into per thread. More tiles than threads let the threads even out tiles with lots of events against tiles with few, same as the chunks of the parallel search.
+#define TILES_PER_THREAD 4
+// Room on top of the fastest particle's speed for particles that get faster during a window. Going over it fails the window, see runTiledWindow.
+#define TILED_WINDOW_SPEED_SLACK 1.25f
+
+std::vector<TileQueue> tileQueues;
+std::vector<CollisionEvent> windowEvents;					// The events that were handed out to the tiles in the current window, so that they can be put back if the window fails.
+std::vector<float> windowX;									// Every particle's position at the start of the current window.
+std::vector<float> windowY;
+float tiledWindowSpeedBound;
+std::atomic<bool> tiledWindowFailed;
+std::vector<CollisionCalendar> parallelFillCalendars;
+CollisionCalendar deferredCalendar;							// Where the deferred predictions of the current window go before they get checked, see runTiledWindow.
+
+// Records the state of a particle before its first event in the current window. Every particle only belongs to one tile per window, so this never races.
+static void recordTiledUndo(Scene& scene, size_t index) {
+	if (!(scene.lastEvents[index].t < tiledWindowStart)) { return; }				// Every event before the window has a t-value before the window, every event in the window has one inside of it.
+	const ParticleStore& particles = scene.particles;
+	currentTileQueue->undo.push_back({ index, particles.x[index], particles.y[index], particles.vx[index], particles.vy[index], particles.localTime[index], scene.collisionCounts[index], scene.lastEvents[index] });
+}
+
+// Wall counterpart to predictCollision. Unlike findWallCollision, this looks for the earliest wall hit across both axes instead of stopping at the first one it finds, because the calendar can't fix a wrong guess in a later sub-step.
+// The t-value is relative to subStep, same as in predictCollision. Particles that are already out of bounds and still moving outwards get a t-value of 0.
+bool Scene::predictWallCollision(size_t index, float subStep, float& t, bool& yAxis) const {
+	float x = particles.x[index];
+	float y = particles.y[index];
+	float radius = particles.radius[index];
+
+	float paddedWidth = width - radius;
+	float paddedHeight = height - radius;
+	Vector2f remainingVel = particles.velocity(index) * subStep;
+
+	bool found = false;
+	t = 1;
+
+	float candidate = 1;
+	if (remainingVel.x > 0) { candidate = (paddedWidth - x) / remainingVel.x; }
+	else if (remainingVel.x < 0) { candidate = (radius - x) / remainingVel.x; }
+	if (candidate < t) { t = candidate; yAxis = false; found = true; }
+
+	candidate = 1;
+	if (remainingVel.y > 0) { candidate = (paddedHeight - y) / remainingVel.y; }
+	else if (remainingVel.y < 0) { candidate = (radius - y) / remainingVel.y; }
+	if (candidate < t) { t = candidate; yAxis = true; found = true; }
+
+	if (t < 0) { t = 0; }
+	return found;
+}
+
+// The partner doesn't have to be in sync, its position at the current time is calculated on the fly instead.
+// NOTE: Writing that position back into the partner would be just as cheap, but then the rounding of a particle's position would depend on how often it got looked at, and the brute-force and grid broad phases would stop producing the same results.
+void Scene::predictPairEvent(size_t aIndex, size_t bIndex, const Vector2f& remainingAlphaVel, float remainingTime) {
+	if (currentTileQueue != nullptr && tiles.groupOf[bIndex] != tiles.groupOf[aIndex]) { currentTileQueue->deferred.push_back({ lastEvents[aIndex], aIndex, bIndex, collisionCounts[aIndex] }); return; }
+	COUNT_STAT(threadStats.pairTests++);
+	Vector2f betaPos = particles.position(bIndex) + particles.velocity(bIndex) * (eventTime - particles.localTime[bIndex]);
+	float t;
+	switch (predictCollision(aIndex, bIndex, betaPos, remainingAlphaVel, remainingTime, t)) {
+	case CollisionPrediction::NONE: return;
+	case CollisionPrediction::OVERLAPPING: t = 0; break;
+	case CollisionPrediction::COLLISION: if (!(t < 1)) { return; } break;
+	}
+	eventCalendar->push({ eventTime + t * remainingTime, aIndex, bIndex, collisionCounts[aIndex], collisionCounts[bIndex], false });
+}
+
+// Puts every collision that the given particle is going to have in the rest of the step into the calendar. The particle itself has to be in sync, its partners get synced as they are looked at.
+// If allPartners is false, only partners with higher indices are considered, which is used for filling the calendar at the start of the step without predicting every pair twice.
+void Scene::predictEvents(size_t index, bool allPartners) {
+	float remainingTime = 1 - eventTime;
+
+	float t;
+	bool yAxis;
+	if (predictWallCollision(index, remainingTime, t, yAxis)) { eventCalendar->push({ eventTime + t * remainingTime, index, yAxis, collisionCounts[index], collisionCounts[index], true }); }
+
+	Vector2f remainingAlphaVel = particles.velocity(index) * remainingTime;
+	if (broadPhase == BroadPhase::UNIFORM_GRID) {
+		if (allPartners) { grid.gatherNeighbors(index, broadPhaseCandidates); }
+		else { grid.gatherCandidates(index, broadPhaseCandidates); }
+		for (size_t i = 0; i < broadPhaseCandidates.size(); i++) { predictPairEvent(index, broadPhaseCandidates[i], remainingAlphaVel, remainingTime); }
+		return;
+	}
+	if (broadPhase == BroadPhase::SWEEP_AND_PRUNE) {
+		if (allPartners) { sweepAndPrune.gatherNeighbors(index, broadPhaseCandidates); }
+		else { sweepAndPrune.gatherCandidates(index, broadPhaseCandidates); }
+		for (size_t i = 0; i < broadPhaseCandidates.size(); i++) { predictPairEvent(index, broadPhaseCandidates[i], remainingAlphaVel, remainingTime); }
+		return;
+	}
+	for (size_t i = allPartners ? 0 : index + 1; i < particleCount; i++) {
+		if (i == index) { continue; }
+		predictPairEvent(index, i, remainingAlphaVel, remainingTime);
+	}
+}
+
+// The event-driven engine keeps the grid that was built at the start of the step instead of updating it after every event. A particle can't get further away from its cell than the speed bound allows for over the rest of the step,
+// so the cells stay valid as long as nothing gets faster than the bound. If something does, the grid gets rebuilt with bigger cells.
+// NOTE: The rebuild sorts the particles in by the positions they had at their last event instead of syncing them. That's fine because currentSubStep stays at 1 for the whole step in this engine, so the cells cover a particle's movement from any point in the step until the end.
+void Scene::updateEventGridSpeedBound(size_t particleIndex) {
+	float speed = particles.velocity(particleIndex).getLength();
+	if (speed <= gridSpeedBound) { return; }
+	gridSpeedBound = speed;
+	float cellSize = requiredGridCellSize();
+	if (cellSize > grid.cellSize) { grid.rebuild(particles, particleCount, width, height, cellSize); }
+}
+
+// Same as updateEventGridSpeedBound, the intervals are updated from the positions the particles had at their last event, which still covers everything they can reach until the end of the step.
+// The bound gets some room on top, otherwise every collision that speeds a particle up a little would cost a whole update.
+#define SWEEP_SPEED_BOUND_SLACK 1.25f
+
+void Scene::updateEventSweepSpeedBound(size_t particleIndex) {
+	float speed = particles.velocity(particleIndex).getLength();
+	if (speed <= sweepSpeedBound) { return; }
+	sweepSpeedBound = speed * SWEEP_SPEED_BOUND_SLACK;
+	sweepAndPrune.update(particles, particleCount, 1, sweepSpeedBound);
+}
+
+// Everything the event-driven engines do before the first event: intersections, broad phase, and filling the calendar with the collisions of the whole step.
+void Scene::beginEventStep() {
+	eventTime = 0;
+	currentSubStep = 1;
+	eventCalendar = &calendar;
+	currentTileQueue = nullptr;
+	if (broadPhase == BroadPhase::UNIFORM_GRID) { prepareGrid(); }
+
+	intersectionGridCurrent = false;
+	for (size_t i = 0; i < particleCount; i++) {
+		if (particles.hasFlag(i, PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION)) { resolveIntersections(i); }
+	}
+	invalidatedParticles.clear();											// Every prediction gets made from scratch below anyway, so there is nothing to recalculate.
+
+	if (broadPhase == BroadPhase::SWEEP_AND_PRUNE) {
+		float maxSquaredSpeed = 0;
+		for (size_t i = 0; i < particleCount; i++) { float squaredSpeed = particles.velocity(i).getSquareLength(); if (squaredSpeed > maxSquaredSpeed) { maxSquaredSpeed = squaredSpeed; } }
+		sweepSpeedBound = sqrt(maxSquaredSpeed);
+		sweepAndPrune.update(particles, particleCount, 1, sweepSpeedBound);
+	}
+
+	TRACE_SCOPE("candidate search");
+	calendar.clear();
+	if (lastEvents.size() < particleCount) { lastEvents.resize(particleCount); }
+	for (size_t i = 0; i < particleCount; i++) { collisionCounts[i] = 0; particles.localTime[i] = 0; lastEvents[i] = { -1, i, 0, 0, 0, false }; }
+	if (engineMode == EngineMode::TILED_EVENT_DRIVEN && workers.threadCount() > 1) { fillCalendarInParallel(); }
+	else { for (size_t i = 0; i < particleCount; i++) { predictEvents(i, false); } }
+	particlesInSync = false;
+}
+
+// Processes the events in eventCalendar in order until the next one happens at or after until.
+// Inside of a tiled window (currentTileQueue isn't null), the particles' old states get recorded so that the window can be undone, and particles that get faster than the window allows for fail the window instead of growing the broad phase, which isn't safe to touch from multiple threads.
+// NOTE: The events themselves are way too short to get a span each, the whole loop gets one instead.
+void Scene::processEvents(float until) {
+	TRACE_SCOPE("process events");
+	while (!eventCalendar->empty() && eventCalendar->next().t < until) {
+		CollisionEvent event = eventCalendar->pop();
+		COUNT_STAT(threadStats.loopIterations++);
+		if (event.countA != collisionCounts[event.a]) { continue; }
+		if (!event.wall && event.countB != collisionCounts[event.b]) { continue; }
+
+		if (currentTileQueue != nullptr) {
+			if (tiledWindowFailed.load(std::memory_order_relaxed)) { return; }				// The window is going to be undone anyway.
+			recordTiledUndo(*this, event.a);
+			if (!event.wall) { recordTiledUndo(*this, event.b); }
+		}
+
+		COUNT_STAT(if (event.t == eventTime) { threadStats.zeroTimeEvents++; });
+		eventTime = event.t;
+		syncParticle(event.a);
+		if (!event.wall) { syncParticle(event.b); }
+
+		currentColliderA = event.a;
+		currentColliderB = event.b;
+		boundsCollision = event.wall;
+		reflectionTime = eventTime;
+		reflectCollision();
+
+		collisionCounts[event.a]++;
+		lastEvents[event.a] = event;
+		if (!event.wall) { collisionCounts[event.b]++; lastEvents[event.b] = event; }
+
+		if (currentTileQueue != nullptr) {
+			if (particles.velocity(event.a).getLength() > tiledWindowSpeedBound || (!event.wall && particles.velocity(event.b).getLength() > tiledWindowSpeedBound)) { tiledWindowFailed.store(true, std::memory_order_relaxed); return; }
+		}
+		else {
+			if (broadPhase == BroadPhase::UNIFORM_GRID) {
+				updateEventGridSpeedBound(event.a);
+				if (!event.wall) { updateEventGridSpeedBound(event.b); }
+			}
+			if (broadPhase == BroadPhase::SWEEP_AND_PRUNE) {
+				updateEventSweepSpeedBound(event.a);
+				if (!event.wall) { updateEventSweepSpeedBound(event.b); }
+			}
+		}
+		predictEvents(event.a, true);
+		if (!event.wall) { predictEvents(event.b, true); }
+	}
+}
+
+void Scene::endEventStep() {
+	TRACE_SCOPE("drift");
+	eventTime = 1;
+	for (size_t i = 0; i < particleCount; i++) { syncParticle(i); particles.localTime[i] = 0; }
+	eventTime = 0;
+	particlesInSync = true;
+}
+
+// Particles are only moved when they take part in an event (see syncParticle), so the cost of an event doesn't depend on the amount of particles in the scene.
+void Scene::stepEventDriven() {
+	beginEventStep();
+	processEvents(INFINITY);
+	endEventStep();
+}
+
+// The calendar doesn't care about the order in which events get pushed (see CollisionCalendar::happensBefore), so every thread can predict a share of the particles into its own calendar and the calendars get merged at the end.
+void Scene::fillCalendarInParallel() {
+	unsigned int threadCount = workers.threadCount();
+	parallelFillCalendars.resize(threadCount);
+	size_t chunkSize = particleCount / (threadCount * PARALLEL_SEARCH_CHUNKS_PER_THREAD) + 1;
+	std::atomic<size_t> nextChunk(0);
+
+	workers.run([this, &nextChunk, chunkSize](unsigned int workerIndex) {
+		TRACE_SCOPE("search chunks");
+		eventTime = 0;
+		currentTileQueue = nullptr;
+		eventCalendar = &parallelFillCalendars[workerIndex];
+		eventCalendar->clear();
+		while (true) {
+			size_t begin = nextChunk.fetch_add(1, std::memory_order_relaxed) * chunkSize;
+			if (begin >= particleCount) { break; }
+			size_t end = begin + chunkSize < particleCount ? begin + chunkSize : particleCount;
+			for (size_t i = begin; i < end; i++) { predictEvents(i, false); }
+		}
+		addThreadStats(workerIndex);
+	});
+
+	eventCalendar = &calendar;
+	for (unsigned int i = 0; i < threadCount; i++) { calendar.pushAll(parallelFillCalendars[i].events); }
+}
+
+// Runs the events from windowStart up to the returned end of the window. Returns right away if the calendar's next event is later than windowStart, in which case the window starts there instead.
+// The window is short enough that no particle can move more than tileWindowReach times the largest radius. Particles that can't possibly touch each other during the window can't influence each other during the window either,
+// so the particles get split into clusters of particles that might, and every tile runs the events of its clusters on its own calendar (see TileDecomposition). Predictions against particles of other tiles are deferred until all tiles are done.
+// The window gets undone and run serially instead if anything breaks the assumptions it was planned with: A particle getting faster than the planned speed bound, an event between two tiles, or a deferred prediction that lands inside of the window.
+float Scene::runTiledWindow(float windowStart) {
+	TRACE_SCOPE("tiled window");
+	if (calendar.next().t > windowStart) { windowStart = calendar.next().t; }
+
+	float maxRadius = 0;
+	float maxSquaredSpeed = 0;
+	windowX.resize(particleCount);
+	windowY.resize(particleCount);
+	for (size_t i = 0; i < particleCount; i++) {
+		float elapsed = windowStart - particles.localTime[i];
+		windowX[i] = particles.x[i] + particles.vx[i] * elapsed;
+		windowY[i] = particles.y[i] + particles.vy[i] * elapsed;
+		if (particles.radius[i] > maxRadius) { maxRadius = particles.radius[i]; }
+		float squaredSpeed = particles.velocity(i).getSquareLength();
+		if (squaredSpeed > maxSquaredSpeed) { maxSquaredSpeed = squaredSpeed; }
+	}
+	tiledWindowSpeedBound = sqrt(maxSquaredSpeed) * TILED_WINDOW_SPEED_SLACK;
+
+	float windowEnd = tiledWindowSpeedBound > 0 ? windowStart + tileWindowReach * maxRadius / tiledWindowSpeedBound : 1;
+	float until = windowEnd;
+	if (!(windowEnd < 1) || !(windowEnd > windowStart)) { windowEnd = 1; until = INFINITY; }						// The last window has to take everything that's left, events can end up a little past 1 because of rounding.
+
+	// The broad phase has to cover the planned speed bound before the tiles get to it, because they can't grow it themselves.
+	if (broadPhase == BroadPhase::UNIFORM_GRID && gridSpeedBound < tiledWindowSpeedBound) {
+		gridSpeedBound = tiledWindowSpeedBound;
+		float cellSize = requiredGridCellSize();
+		if (cellSize > grid.cellSize) { grid.rebuild(particles, particleCount, width, height, cellSize); }
+	}
+	if (broadPhase == BroadPhase::SWEEP_AND_PRUNE && sweepSpeedBound < tiledWindowSpeedBound) {
+		sweepSpeedBound = tiledWindowSpeedBound * SWEEP_SPEED_BOUND_SLACK;
+		sweepAndPrune.update(particles, particleCount, 1, sweepSpeedBound);
+	}
+
+	tiles.assign(windowX.data(), windowY.data(), particleCount);
+	tiles.mergeReachable(windowX.data(), windowY.data(), particles.radius, particleCount, maxRadius, 2 * tiledWindowSpeedBound * (windowEnd - windowStart) + GRID_CELL_PADDING);
+	tiles.buildGroups();
+	if (tiles.largestCluster * 2 > particleCount) { processEvents(until); return windowEnd; }			// Most of the work would end up on one tile anyway.
+
+	windowEvents.clear();
+	bool crossesTiles = false;
+	tileQueues.resize(tiles.tileCount());
+	for (size_t i = 0; i < tileQueues.size(); i++) { tileQueues[i].calendar.clear(); tileQueues[i].deferred.clear(); tileQueues[i].undo.clear(); tileQueues[i].collisions.clear(); }
+	while (!calendar.empty() && calendar.next().t < until) {
+		CollisionEvent event = calendar.pop();
+		if (event.countA != collisionCounts[event.a]) { continue; }
+		if (!event.wall && event.countB != collisionCounts[event.b]) { continue; }
+		windowEvents.push_back(event);
+		if (!event.wall && tiles.groupOf[event.a] != tiles.groupOf[event.b]) { crossesTiles = true; }
+		tileQueues[tiles.groupOf[event.a]].calendar.push(event);
+	}
+	if (crossesTiles) { calendar.pushAll(windowEvents); processEvents(until); return windowEnd; }
+
+	tiledWindowStart = windowStart;
+	tiledWindowFailed.store(false, std::memory_order_relaxed);
+	std::atomic<size_t> nextTile(0);
+	workers.run([this, &nextTile, until, windowStart](unsigned int workerIndex) {
+		tiledWindowStart = windowStart;
+		while (true) {
+			size_t tile = nextTile.fetch_add(1, std::memory_order_relaxed);
+			if (tile >= tileQueues.size()) { break; }
+			currentTileQueue = &tileQueues[tile];
+			eventCalendar = &currentTileQueue->calendar;
+			processEvents(until);
+		}
+		currentTileQueue = nullptr;
+		eventCalendar = nullptr;
+		addThreadStats(workerIndex);
+	});
+	eventCalendar = &calendar;
+
+	// A deferred prediction would have been made with the partner's state at the time of the cause. If the partner has had an event since then, that state is gone, but so is the prediction, because it would have been stale by now.
+	// Same if the particle itself has collided again since then.
+	if (!tiledWindowFailed.load(std::memory_order_relaxed)) {
+		eventCalendar = &deferredCalendar;
+		deferredCalendar.clear();
+		for (size_t i = 0; i < tileQueues.size(); i++) {
+			const std::vector<DeferredPrediction>& deferred = tileQueues[i].deferred;
+			for (size_t j = 0; j < deferred.size(); j++) {
+				const DeferredPrediction& prediction = deferred[j];
+				if (prediction.countA != collisionCounts[prediction.a]) { continue; }
+				if (!CollisionCalendar::happensBefore(lastEvents[prediction.b], prediction.cause)) { continue; }
+				eventTime = prediction.cause.t;
+				float remainingTime = 1 - eventTime;
+				predictPairEvent(prediction.a, prediction.b, particles.velocity(prediction.a) * remainingTime, remainingTime);
+			}
+		}
+		eventCalendar = &calendar;
+		for (size_t i = 0; i < deferredCalendar.events.size(); i++) {
+			if (deferredCalendar.events[i].t < until) { tiledWindowFailed.store(true, std::memory_order_relaxed); break; }
+		}
+	}
+
+	if (tiledWindowFailed.load(std::memory_order_relaxed)) {
+		for (size_t i = 0; i < tileQueues.size(); i++) {
+			const std::vector<ParticleUndo>& undo = tileQueues[i].undo;
+			for (size_t j = 0; j < undo.size(); j++) {
+				const ParticleUndo& old = undo[j];
+				particles.x[old.index] = old.x;
+				particles.y[old.index] = old.y;
+				particles.vx[old.index] = old.vx;
+				particles.vy[old.index] = old.vy;
+				particles.localTime[old.index] = old.localTime;
+				collisionCounts[old.index] = old.collisionCount;
+				lastEvents[old.index] = old.lastEvent;
+			}
+		}
+		calendar.pushAll(windowEvents);
+		processEvents(until);
+		return windowEnd;
+	}
+
+	if (collisionLog != nullptr) {
+		for (size_t i = 0; i < tileQueues.size(); i++) { for (size_t j = 0; j < tileQueues[i].collisions.size(); j++) { collisionLog->record(tileQueues[i].collisions[j]); } }
+	}
+
+	windowEvents.clear();
+	for (size_t i = 0; i < tileQueues.size(); i++) {
+		const std::vector<CollisionEvent>& events = tileQueues[i].calendar.events;
+		for (size_t j = 0; j < events.size(); j++) {
+			const CollisionEvent& event = events[j];
+			if (event.countA != collisionCounts[event.a]) { continue; }				// Throwing the stale events out here keeps them from piling up in the calendar.
+			if (!event.wall && event.countB != collisionCounts[event.b]) { continue; }
+			windowEvents.push_back(event);
+		}
+	}
+	windowEvents.insert(windowEvents.end(), deferredCalendar.events.begin(), deferredCalendar.events.end());
+	calendar.pushAll(windowEvents);
+	return windowEnd;
+}
+
+// Produces exactly the same results as stepEventDriven: Inside of a window, events only ever interact with events of the same tile, which see each other in calendar order, and every prediction across tiles is made with the same particle states that the serial engine would have used.
+// Windows that can't be split up like that are run serially, so scenes that are too dense (or too fast) for the tiles just fall back to the speed of the serial engine.
+void Scene::stepTiled() {
+	if (workers.threadCount() <= 1) { stepEventDriven(); return; }
+	tiles.layout(width, height, workers.threadCount() * TILES_PER_THREAD);
+	beginEventStep();
+	float windowStart = 0;
+	while (!calendar.empty()) { windowStart = runTiledWindow(windowStart); }
+	endEventStep();
+}
+
+void Scene::syncParticle(size_t index) noexcept {
+	float elapsed = eventTime - particles.localTime[index];
+	particles.x[index] += particles.vx[index] * elapsed;
+	particles.y[index] += particles.vy[index] * elapsed;
+	particles.localTime[index] = eventTime;
+}
+
+void Scene::syncParticles() noexcept {
+	if (particlesInSync) { return; }
+	for (size_t i = 0; i < particleCount; i++) { syncParticle(i); }			// NOTE: This doesn't set particlesInSync, because in the middle of a step, the particles fall behind again as soon as the next event happens.
+}
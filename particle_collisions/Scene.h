@@ -1,47 +1,181 @@
 #pragma once
 
 #include "Particle.h"
+#include "ParticleStore.h"
 #include "Vector2f.h"
+#include "UniformGrid.h"
+#include "SweepAndPrune.h"
+#include "CollisionCalendar.h"
+#include "DirtySet.h"
+#include "ParticleHandles.h"
+#include "TileDecomposition.h"
+#include "WorkerPool.h"
+#include "PairKernel.h"
 #include <vector>
 
+class TrajectoryWriter;
+class CollisionLog;
+
+// Selects how the collision search finds the particle pairs that it runs through findCollision.
+enum class BroadPhase {
+	BRUTE_FORCE,						// Every pair is tested, which is the original behaviour.
+	UNIFORM_GRID,						// Only pairs in neighboring cells of a UniformGrid are tested. Produces exactly the same results as BRUTE_FORCE.
+	SWEEP_AND_PRUNE						// Only pairs whose swept intervals overlap are tested, see SweepAndPrune. Produces exactly the same results as BRUTE_FORCE, and doesn't waste memory on empty space like the grid does.
+};
+
+// Selects the algorithm that Scene::step uses to advance the simulation.
+enum class EngineMode {
+	SUB_STEPPING,						// Searches all pairs for the earliest collision, moves everything up to it, reflects, and repeats until the step is over.
+	EVENT_DRIVEN,						// Keeps every predicted collision in a CollisionCalendar and only re-predicts the collisions of the two particles that just collided.
+	TILED_EVENT_DRIVEN					// Same as EVENT_DRIVEN, but cuts the step into short time windows and processes the events of every window in per-tile queues on all the worker threads. Produces exactly the same results as EVENT_DRIVEN, see stepTiled.
+};
+
+// Result of Scene::predictCollision.
+enum class CollisionPrediction {
+	NONE,								// The two particles don't collide (at least not in the future).
+	COLLISION,							// The two particles collide at the returned t-value.
+	OVERLAPPING							// The two particles are already inside of each other and moving towards each other, which has to be handled as a collision at t = 0.
+};
+
+// Set to 0 to compile the counting out of the hot loops entirely. Scene::stats then always reports zeros.
+#ifndef SCENE_STATS
+#define SCENE_STATS 1
+#endif
+
+// Set to 0 to compile the collision log out of reflectCollision entirely. Scene::collisionLog then never gets anything.
+#ifndef SCENE_COLLISION_LOG
+#define SCENE_COLLISION_LOG 1
+#endif
+
+// Counters of the work that the last step did, see Scene::stats.
+struct SceneStats
+{
+	uint64_t loopIterations = 0;			// Iterations of the engine's main loop. Sub-steps in the sub-step engine, events taken off the calendar (stale ones included) in the event-driven ones.
+	uint64_t events = 0;				// Collisions that got reflected, in every engine.
+	uint64_t wallEvents = 0;			// The part of events that were collisions with the bounds.
+	uint64_t zeroTimeEvents = 0;			// Sub-steps that didn't get any further in time, and events that happened at the same time as the event before them. Lots of these mean that particles are stuck against each other.
+	uint64_t pairTests = 0;				// Particle pairs that got tested for a collision (findCollision calls), one at a time or in the vectorized kernels.
+	uint64_t vectorizedPairTests = 0;		// The part of pairTests that went through the vectorized kernels. Those don't branch per pair, so they don't count towards the next two.
+	uint64_t earlyRejections = 0;			// Pairs that predictCollision threw out because the particles move apart, before setting up the quadratic. Not counted directly, it's the rest of the scalar pair tests after quadraticSolves.
+	uint64_t quadraticSolves = 0;			// Pairs that made it past that and got their quadratic solved.
+	uint64_t intersectionResolutions = 0;		// resolveIntersections calls.
+	uint64_t maxIntersectionDepth = 0;		// The most particles that a single resolveIntersections call worked through.
+	uint64_t intersectionBudgetHits = 0;		// resolveIntersections calls that ran out of visits and left particles for later, which is what hitting STACK_MAX_SIZE used to be.
+	uint64_t maxInvalidatedParticles = 0;		// The biggest invalidatedParticles got before recalculateInvalidatedData worked through it.
+
+	SceneStats& operator+=(const SceneStats& other) noexcept {
+		loopIterations += other.loopIterations; events += other.events; wallEvents += other.wallEvents; zeroTimeEvents += other.zeroTimeEvents;
+		pairTests += other.pairTests; vectorizedPairTests += other.vectorizedPairTests; earlyRejections += other.earlyRejections; quadraticSolves += other.quadraticSolves;
+		intersectionResolutions += other.intersectionResolutions; intersectionBudgetHits += other.intersectionBudgetHits;
+		if (other.maxIntersectionDepth > maxIntersectionDepth) { maxIntersectionDepth = other.maxIntersectionDepth; }				// The maximums stay maximums when steps or threads get added up.
+		if (other.maxInvalidatedParticles > maxInvalidatedParticles) { maxInvalidatedParticles = other.maxInvalidatedParticles; }
+		return *this;
+	}
+};
+
 class Scene
 {
 public:
 	uint32_t width;
 	uint32_t height;
 
-	std::vector<Particle> particles;									// TODO: Write a destructor that handles releasing these even though they do it themselves anyway.
+	ParticleStore particles;									// Structure-of-arrays, see ParticleStore. scene.particles[i] still works like it used to for code outside of the hot loops.
 	std::vector<size_t> lastIntersectionPartners;
 	std::vector<bool> lastIntersectionWasWithWall;
-	size_t particleCount;
-	size_t lastParticle;
+	DirtySet invalidatedParticles;								// Particles that resolveIntersections moved after the collision search had already looked at them, see recalculateInvalidatedData.
+	size_t particleCount = 0;
+	size_t lastParticle = 0;										// particleCount - 1, or 0 without any particles.
+	ParticleHandles handles;									// Stable handles for insert and remove. Every load starts them over.
+
+	BroadPhase broadPhase = BroadPhase::BRUTE_FORCE;
+	UniformGrid grid;
+	float gridSpeedBound;						// The highest particle speed the current grid cell size accounts for. If a collision produces a faster particle, the grid has to be rebuilt with bigger cells.
+	float gridMaxRadius;
+	SweepAndPrune sweepAndPrune;
+	float sweepSpeedBound;						// The highest particle speed the sweep-and-prune intervals of the event-driven engine account for, same as gridSpeedBound. The sub-step engine sweeps along the actual velocities instead.
 
-	size_t currentColliderA;						// TODO: These shouldn't be in here since they are just temporarys that don't get used outside of their steps. Making them global would cause issues with multithreading, but making them thread_local would be the best of both worlds. Do that.
-	size_t currentColliderB;
+	float simultaneousEventTolerance = 1e-6f;			// Collisions that happen at most this long (as a fraction of a step) after the earliest one get reflected in the same sub-step, as long as they don't share particles with earlier ones. Negative turns that off, so that every sub-step handles exactly one collision.
+	SimdLevel simdLevel = detectSimdLevel();				// Instruction set for the pair scans of the sub-step engine. Set to SCALAR to go through findCollision one pair at a time.
+	WorkerPool workers;									// Used by the sub-step engine to search for the next collision on multiple threads. Empty (and unused) by default, see setThreadCount.
 
-	float currentSubStep;						// TODO: This one can also be made thread_local.
-	float lowestT;								// TODO: This one too.
-	bool noCollisions;							// TODO: Same thing.
-	bool boundsCollision;
+	EngineMode engineMode = EngineMode::SUB_STEPPING;
+	CollisionCalendar calendar;
+	std::vector<uint32_t> collisionCounts;				// How often each particle has collided in the current step, used to tell stale events in the calendar apart from valid ones.
+	std::vector<CollisionEvent> lastEvents;				// The last event each particle took part in during the current step, which the tiled engine needs to put events from different tiles back into calendar order. Only sized by the event-driven engines.
+	TileDecomposition tiles;
+	float tileWindowReach = 0.5f;							// How far the fastest particle can get in one window of the tiled engine, in multiples of the largest radius. Longer windows have less overhead, but merge more particles into clusters that one tile has to process alone.
+	bool particlesInSync = true;						// False while the event-driven engine has particles whose pos lags behind eventTime.
+
+	SceneStats lastStepStats;
+	TrajectoryWriter* trajectoryWriter = nullptr;				// If set, every step ends by handing the particles to it, see Trajectory.h.
+	CollisionLog* collisionLog = nullptr;					// If set, every collision gets recorded into it, see CollisionLog.h.
+	uint64_t stepCount = 0;								// Steps taken so far, which the times in the collision log count from.
 
 	void loadSize(unsigned int width, unsigned int height);
 
+	// Sets the amount of threads the collision search runs on, including the thread that calls step. If pinToCores is true, the worker threads get pinned to one core each.
+	void setThreadCount(unsigned int threadCount, bool pinToCores);
+
 	void loadParticles(const std::vector<Particle>& particles, size_t count);
 	void loadParticles(const std::vector<Particle>& particles);
 	void loadParticles(std::vector<Particle>&& particles, size_t count);
 	void loadParticles(std::vector<Particle>&& particles);
 
+	// Adds particles between two steps without reloading the scene: the particle arrays grow like a vector, and the broad phases take the particle in without a rebuild, so it's O(1) amortized.
+	// The batch version reserves room for all of the particles up front and appends their handles to newHandles if it isn't null.
+	ParticleHandle insert(const Particle& particle);
+	void insert(const std::vector<Particle>& newParticles, std::vector<ParticleHandle>* newHandles);
+	// Removes a particle between two steps by moving the last particle into its place, which changes the last particle's index (but not its handle). Returns false if the handle is stale.
+	bool remove(ParticleHandle handle);
+	size_t indexOf(ParticleHandle handle) const noexcept { return handles.indexOf(handle); }				// SIZE_MAX for stale handles.
+	ParticleHandle handleOf(size_t index) const noexcept { return handles.handleOf(index); }
+
+	// Sizes everything that goes along with the particles. Runs on the worker threads, so call setThreadCount first when loading a large scene.
 	void postLoadInit();
 
 	bool resolveIntersectionWithBounds(size_t particleIndex);
 	bool resolveIntersectionWithParticle(size_t aIndex, size_t bIndex);
 	void resolveIntersections(size_t particleIndex);
 
-	void sortInvalidatedParticlesAndRemoveMultiples(size_t currentLoopIndex);
 	void recalculateInvalidatedData(size_t currentLoopIndex);
 
+	float requiredGridCellSize() const noexcept;
+	void prepareGrid();
+	void updateGridSpeedBound(size_t particleIndex);
+	void findCollisionsInGrid(size_t aIndex, const Vector2f& remainingAlphaVel);
+	void findCollisionsInSweep(size_t aIndex, const Vector2f& remainingAlphaVel);
+	void findCollisionsInCandidates(size_t aIndex, const Vector2f& remainingAlphaVel);
+
 	void findWallCollision(size_t index, const Vector2f& remainingVel);
+	CollisionPrediction predictCollision(size_t aIndex, size_t bIndex, const Vector2f& betaPos, const Vector2f& remainingAlphaVel, float subStep, float& t) const;
 	void findCollision(size_t aIndex, size_t bIndex, const Vector2f& remainingAlphaVel);
+	void findCollisionsInRange(size_t aIndex, size_t begin, size_t end, const Vector2f& remainingAlphaVel);
+	void applyPairScanResult(size_t aIndex, size_t bIndex, const PairScanResult& result);
 	void reflectCollision();
+	void recordCollision(const Vector2f& alphaVel, const Vector2f& alphaPostVel, const Vector2f& betaVel, const Vector2f& betaPostVel);
+	void reflectSimultaneousEvents();
+	void findCollisionsSerially();
+	void findCollisionsForParticle(size_t index);
+	void findCollisionsInParallel();
+	void stepSubStepping();
 	void step();
+
+	const SceneStats& stats() const noexcept { return lastStepStats; }			// Snapshot of the counters of the last step, see SceneStats.
+
+	bool predictWallCollision(size_t index, float subStep, float& t, bool& yAxis) const;
+	void predictPairEvent(size_t aIndex, size_t bIndex, const Vector2f& remainingAlphaVel, float remainingTime);
+	void predictEvents(size_t index, bool allPartners);
+	void updateEventGridSpeedBound(size_t particleIndex);
+	void updateEventSweepSpeedBound(size_t particleIndex);
+	void beginEventStep();
+	void processEvents(float until);
+	void endEventStep();
+	void stepEventDriven();
+
+	void fillCalendarInParallel();
+	float runTiledWindow(float windowStart);
+	void stepTiled();
+
+	void syncParticle(size_t index) noexcept;
+	void syncParticles() noexcept;					// Brings every particle's pos up to the current time. Anything that reads positions from outside of step() should call this first.
 };
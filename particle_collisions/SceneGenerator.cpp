@@ -0,0 +1,199 @@
+#include "SceneGenerator.h"
+
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "debugOutput.h"
+
+// SplitMix64, which is good enough for placing particles and, unlike the standard engines, cheap to seed once per block.
+static inline uint64_t nextRandom(uint64_t& state) noexcept {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1), from the top 24 bits so that every value is exactly representable.
+static inline float nextUnit(uint64_t& state) noexcept { return (float)(nextRandom(state) >> 40) * (1.0f / 16777216); }
+
+void generateScene(Scene& scene, const SceneGeneratorSettings& settings) {
+	ParticleStore& particles = scene.particles;
+	size_t particleCount = settings.particleCount;
+	scene.loadSize(settings.width, settings.height);
+	particles.resizeUninitialized(particleCount);
+	scene.particleCount = particleCount;
+	scene.lastParticle = particleCount != 0 ? particleCount - 1 : 0;
+
+	size_t blockCount = (particleCount + SCENE_GENERATOR_BLOCK_SIZE - 1) / SCENE_GENERATOR_BLOCK_SIZE;
+	scene.workers.runRanges(blockCount, [&particles, &settings, particleCount](size_t beginBlock, size_t endBlock) {
+		float radiusRange = settings.maxRadius - settings.minRadius;
+		for (size_t block = beginBlock; block < endBlock; block++) {
+			uint64_t state = settings.seed ^ (block * 0xD1B54A32D192ED03ull);
+			size_t end = (block + 1) * SCENE_GENERATOR_BLOCK_SIZE < particleCount ? (block + 1) * SCENE_GENERATOR_BLOCK_SIZE : particleCount;
+			for (size_t i = block * SCENE_GENERATOR_BLOCK_SIZE; i < end; i++) {
+				float radius = settings.minRadius + radiusRange * nextUnit(state);
+				particles.radius[i] = radius;
+				particles.x[i] = radius + (settings.width - 2 * radius) * nextUnit(state);
+				particles.y[i] = radius + (settings.height - 2 * radius) * nextUnit(state);
+				particles.vx[i] = (nextUnit(state) * 2 - 1) * settings.maxSpeed;
+				particles.vy[i] = (nextUnit(state) * 2 - 1) * settings.maxSpeed;
+				particles.mass[i] = settings.mass;
+				particles.localTime[i] = 0;
+				particles.flags[i] = 0;
+			}
+		}
+	});
+
+	scene.postLoadInit();
+}
+
+#define PACKED_GRID_END 0xFFFFFFFFu
+
+static float drawRadius(const PackedSceneSettings& settings, uint64_t& state) noexcept {
+	float unit = nextUnit(state);
+	if (settings.radiusDistribution == RadiusDistribution::LOG_UNIFORM) { return settings.minRadius * pow(settings.maxRadius / settings.minRadius, unit); }
+	return settings.minRadius + (settings.maxRadius - settings.minRadius) * unit;
+}
+
+static Vector2f drawVelocity(const PackedSceneSettings& settings, uint64_t& state) noexcept {
+	if (settings.velocityDistribution == VelocityDistribution::UNIFORM) { return Vector2f((nextUnit(state) * 2 - 1) * settings.maxSpeed, (nextUnit(state) * 2 - 1) * settings.maxSpeed); }
+	float magnitude = sqrt(-2 * log(1 - nextUnit(state)) * settings.temperature / settings.mass);				// Box-Muller, which gives two independent normally distributed values at once.
+	float angle = 2 * 3.14159265f * nextUnit(state);
+	return Vector2f(magnitude * cos(angle), magnitude * sin(angle));
+}
+
+static bool placeRandomly(ParticleStore& particles, const std::vector<float>& radii, uint32_t width, uint32_t height, const PackedSceneSettings& settings, uint64_t& state) {
+	size_t particleCount = radii.size();
+	std::vector<uint32_t> order(particleCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&radii](uint32_t a, uint32_t b) { return radii[a] > radii[b]; });			// Large particles first, the small ones still find room in the gaps that are left.
+
+	float cellSize = 2 * settings.maxRadius + settings.gap;							// Two particles that are closer than the gap are never more than one cell apart.
+	size_t columns = (size_t)(width / cellSize) + 1;
+	size_t rows = (size_t)(height / cellSize) + 1;
+	std::vector<uint32_t> cellHeads(columns * rows, PACKED_GRID_END);
+	std::vector<uint32_t> cellNext(particleCount);
+
+	for (size_t placed = 0; placed < particleCount; placed++) {
+		uint32_t index = order[placed];
+		float radius = radii[index];
+		float reachToBounds = radius + settings.gap;
+		bool found = false;
+		for (uint32_t attempt = 0; attempt < settings.maxAttempts && !found; attempt++) {
+			float x = reachToBounds + (width - 2 * reachToBounds) * nextUnit(state);
+			float y = reachToBounds + (height - 2 * reachToBounds) * nextUnit(state);
+			size_t column = (size_t)(x / cellSize);
+			size_t row = (size_t)(y / cellSize);
+			found = true;
+			for (size_t neighborRow = row != 0 ? row - 1 : 0; neighborRow <= row + 1 && neighborRow < rows && found; neighborRow++) {
+				for (size_t neighborColumn = column != 0 ? column - 1 : 0; neighborColumn <= column + 1 && neighborColumn < columns && found; neighborColumn++) {
+					for (uint32_t other = cellHeads[neighborRow * columns + neighborColumn]; other != PACKED_GRID_END; other = cellNext[other]) {
+						float dx = particles.x[other] - x;
+						float dy = particles.y[other] - y;
+						float reach = radius + particles.radius[other] + settings.gap;
+						if (dx * dx + dy * dy < reach * reach) { found = false; break; }
+					}
+				}
+			}
+			if (!found) { continue; }
+			particles.x[index] = x;
+			particles.y[index] = y;
+			particles.radius[index] = radius;
+			cellNext[index] = cellHeads[row * columns + column];
+			cellHeads[row * columns + column] = index;
+		}
+		if (!found) {
+			debuglogger::out << debuglogger::error << "packed scene only had room for " << (uint32_t)placed << " of " << (uint32_t)particleCount << " particles, the packing fraction is too high for random placement" << debuglogger::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every particle gets a site of a hexagonal lattice whose spacing leaves room for the largest particle and the gap, and moves away from the site's center by a random amount that keeps it inside of the site.
+// The spacing starts out at what would give exactly one site per particle, and shrinks until the lattice has enough sites. If it has more, randomly chosen ones are left empty.
+static bool placeOnLattice(ParticleStore& particles, const std::vector<float>& radii, uint32_t width, uint32_t height, const PackedSceneSettings& settings, uint64_t& state) {
+	size_t particleCount = radii.size();
+	float minSpacing = 2 * settings.maxRadius + settings.gap;
+	float spacing = (float)sqrt(2.0 * width * height / (sqrt(3.0) * (particleCount != 0 ? particleCount : 1)));
+	float rowSpacing = 0;
+	size_t evenColumns = 0;
+	size_t oddColumns = 0;													// Odd rows are shifted by half of the spacing, so they can have one site less.
+	size_t siteCount = 0;
+	while (true) {
+		if (spacing < minSpacing) { spacing = minSpacing; }
+		rowSpacing = spacing * 0.8660254f;
+		size_t rows = height >= spacing ? (size_t)((height - spacing) / rowSpacing) + 1 : 0;
+		evenColumns = (size_t)(width / spacing);
+		oddColumns = (size_t)(width / spacing - 0.5f);
+		siteCount = (rows + 1) / 2 * evenColumns + rows / 2 * oddColumns;
+		if (siteCount >= particleCount) { break; }
+		if (spacing == minSpacing) {
+			debuglogger::out << debuglogger::error << "packed scene's lattice only has room for " << (uint32_t)siteCount << " of " << (uint32_t)particleCount << " particles, the packing fraction is too high" << debuglogger::endl;
+			return false;
+		}
+		spacing *= 0.99f;
+	}
+
+	std::vector<uint32_t> sites(siteCount);
+	std::iota(sites.begin(), sites.end(), 0);
+	for (size_t i = 0; i < particleCount; i++) { std::swap(sites[i], sites[i + (size_t)(nextUnit(state) * (siteCount - i))]); }			// Only the first particleCount sites get shuffled, the rest stay empty.
+
+	size_t rowPairSites = evenColumns + oddColumns;
+	for (size_t i = 0; i < particleCount; i++) {
+		size_t row = sites[i] / rowPairSites * 2;
+		size_t column = sites[i] % rowPairSites;
+		if (column >= evenColumns) { column -= evenColumns; row++; }
+		float radius = radii[i];
+		float slack = spacing / 2 - radius - settings.gap / 2;						// Two neighbors that both move towards each other by this much still have the gap between them.
+		float jitter = slack * sqrt(nextUnit(state));								// Uniform over the disk the center can move in.
+		float angle = 2 * 3.14159265f * nextUnit(state);
+		particles.x[i] = spacing * (column + (row % 2 == 0 ? 0.5f : 1.0f)) + jitter * cos(angle);
+		particles.y[i] = spacing / 2 + rowSpacing * row + jitter * sin(angle);
+		particles.radius[i] = radius;
+	}
+	return true;
+}
+
+bool generatePackedScene(Scene& scene, const PackedSceneSettings& settings) {
+	size_t particleCount = settings.particleCount;
+	uint64_t state = settings.seed;
+	std::vector<float> radii(particleCount);
+	double area = 0;
+	for (size_t i = 0; i < particleCount; i++) { radii[i] = drawRadius(settings, state); area += 3.14159265 * radii[i] * radii[i]; }
+
+	uint32_t width = settings.width;
+	uint32_t height = settings.height;
+	if (width == 0 && height == 0) {
+		double sizedHeight = sqrt(area / settings.packingFraction / settings.aspectRatio);
+		width = (uint32_t)ceil(sizedHeight * settings.aspectRatio);
+		height = (uint32_t)ceil(sizedHeight);
+	}
+	if (width < 2 * settings.maxRadius + settings.gap || height < 2 * settings.maxRadius + settings.gap) { debuglogger::out << debuglogger::error << "packed scene is too small for its largest particle" << debuglogger::endl; return false; }
+
+	ParticleStore particles;
+	particles.resizeUninitialized(particleCount);
+	if (settings.placement == Placement::LATTICE) {
+		if (!placeOnLattice(particles, radii, width, height, settings, state)) { return false; }
+	}
+	else if (!placeRandomly(particles, radii, width, height, settings, state)) { return false; }
+
+	uint64_t velocityState = settings.seed ^ 0xA0761D6478BD642Full;						// A sequence of their own, so that the velocities don't depend on how many attempts placement took.
+	for (size_t i = 0; i < particleCount; i++) {
+		particles.setVelocity(i, drawVelocity(settings, velocityState));
+		particles.mass[i] = settings.mass;
+		particles.localTime[i] = 0;
+		particles.flags[i] = 0;
+	}
+
+	scene.loadSize(width, height);
+	scene.particles = std::move(particles);
+	scene.particleCount = particleCount;
+	scene.lastParticle = particleCount != 0 ? particleCount - 1 : 0;
+	scene.postLoadInit();
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Scene;
+
+// Procedural scenes that get generated straight into a Scene's ParticleStore on the scene's worker threads, instead of being built up in a std::vector<Particle> one particle at a time and converted afterwards.
+// The particles are generated in blocks of SCENE_GENERATOR_BLOCK_SIZE, and every block has its own random sequence seeded from the seed and the block's index, so the scene only depends on the settings and not on the thread count.
+
+#define SCENE_GENERATOR_BLOCK_SIZE 4096
+
+struct SceneGeneratorSettings
+{
+	size_t particleCount = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	float minRadius = 5;
+	float maxRadius = 25;									// Has to fit into the scene twice in both directions.
+	float maxSpeed = 1;										// Per step, in both axes.
+	float mass = 1;
+	uint64_t seed = 1;
+};
+
+enum class RadiusDistribution {
+	UNIFORM,
+	LOG_UNIFORM							// Equally many particles in every factor of size, so that the small ones aren't drowned out by the big ones.
+};
+
+enum class Placement {
+	RANDOM,								// Uniformly random positions, rejected until one is free. Looks like a gas, but gets stuck at about 0.4 for equal radii (the gap counts as part of the particle), where random placement runs out of room.
+	LATTICE								// Jittered hexagonal lattice with randomly left out sites, sized for the largest particle. Goes up to about 0.8 for equal radii (0.9 without the gap), but looks like a crystal until it melts.
+};
+
+enum class VelocityDistribution {
+	UNIFORM,							// Both components uniform in [-maxSpeed, maxSpeed].
+	MAXWELL_BOLTZMANN					// The equilibrium distribution of an ideal gas at the given temperature: both components normally distributed with a variance of temperature / mass.
+};
+
+struct PackedSceneSettings
+{
+	size_t particleCount = 0;
+	uint32_t width = 0;										// 0 for both sizes the scene so that the particles cover packingFraction of it.
+	uint32_t height = 0;
+	float packingFraction = 0.2f;							// See Placement for how high this can go.
+	Placement placement = Placement::RANDOM;
+	float aspectRatio = 1;									// Width over height, if the scene gets sized from the packing fraction.
+	float minRadius = 5;
+	float maxRadius = 25;
+	RadiusDistribution radiusDistribution = RadiusDistribution::UNIFORM;
+	VelocityDistribution velocityDistribution = VelocityDistribution::MAXWELL_BOLTZMANN;
+	float maxSpeed = 1;										// Only used by VelocityDistribution::UNIFORM.
+	float temperature = 1;									// Only used by VelocityDistribution::MAXWELL_BOLTZMANN. In mass times (units per step) squared.
+	float mass = 1;
+	float gap = 0.5f;										// Smallest distance between two particles, and between a particle and the bounds, so that rounding can't put them inside of each other right away.
+	uint32_t maxAttempts = 1000;							// Random positions that get tried for a particle before giving up.
+	uint64_t seed = 1;
+};
+
+// Replaces the scene's size and particles with uniformly placed particles of uniformly distributed radii and velocities. Particles can end up inside of each other, the same way they can in the window's initial scene.
+// Call setThreadCount before this, the workers touch the particle arrays first (see ParticleStore::resizeUninitialized), and also do postLoadInit.
+void generateScene(Scene& scene, const SceneGeneratorSettings& settings);
+
+// Replaces the scene's size and particles with particles that don't touch each other or the bounds, so that the first steps don't have to untangle them with resolveIntersections.
+// With random placement, the radii get drawn first and the particles get placed from the largest to the smallest, each one at random positions until one is free, which a grid with cells the size of the largest particle checks in constant time.
+// Runs on the calling thread and only depends on the settings. Returns false (after logging why, leaving the scene alone) if a particle didn't fit anywhere within maxAttempts tries, or the lattice doesn't have enough sites.
+bool generatePackedScene(Scene& scene, const PackedSceneSettings& settings);
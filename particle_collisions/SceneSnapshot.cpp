@@ -0,0 +1,33 @@
+#include "SceneSnapshot.h"
+
+#include "Scene.h"
+#include "Trace.h"
+
+#include <cstring>
+
+void SceneSnapshot::take(Scene& scene) {
+	TRACE_SCOPE("SceneSnapshot::take");
+	particleCount = scene.particleCount;
+	if (x.size() < particleCount) {						// Only grows, so a snapshot that gets reused every frame doesn't reallocate when particles get removed and added again.
+		x.resize(particleCount);
+		y.resize(particleCount);
+		radius.resize(particleCount);
+	}
+	const ParticleStore& particles = scene.particles;
+	scene.workers.runRanges(particleCount, [this, &particles](size_t begin, size_t end) {
+		memcpy(x.data() + begin, particles.x + begin, (end - begin) * sizeof(float));
+		memcpy(y.data() + begin, particles.y + begin, (end - begin) * sizeof(float));
+		memcpy(radius.data() + begin, particles.radius + begin, (end - begin) * sizeof(float));
+	});
+	width = scene.width;
+	height = scene.height;
+	stepCount = scene.stepCount;
+}
+
+void SnapshotTripleBuffer::publish() noexcept { back = middle.exchange(back | SNAPSHOT_FRESH, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH; }			// Release makes the snapshot's contents visible to the reader, acquire makes sure the reader is done with the one that comes back.
+
+bool SnapshotTripleBuffer::acquire() noexcept {
+	if ((middle.load(std::memory_order_relaxed) & SNAPSHOT_FRESH) == 0) { return false; }
+	front = middle.exchange(front, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;			// Only the writer can change middle in between, and only by publishing an even newer snapshot, so whatever comes back is fresh.
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Rasterizer.h"
+
+class Scene;
+
+#define SNAPSHOT_FRESH 4u								// Flag in SnapshotTripleBuffer::middle, next to the index.
+
+// Copy of everything drawing a frame needs, so that a scene can be drawn on another thread while it keeps stepping.
+struct SceneSnapshot
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> radius;
+	size_t particleCount = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint64_t stepCount = 0;
+
+	// Copies the positions and radii on the scene's workers, so call it from the thread that steps the scene. The particles have to be in sync (see Scene::syncParticles).
+	void take(Scene& scene);
+
+	RasterizerCircles circles() const noexcept { return { x.data(), y.data(), radius.data(), particleCount }; }
+};
+
+// Hands SceneSnapshots from one writer thread to one reader thread without either of them ever waiting for the other.
+// Of the three snapshots, the writer owns one, the reader owns one, and the third one is in the middle. Publishing swaps the writer's snapshot with the middle one and marks it as new, acquiring swaps the reader's snapshot with the middle one if there is a new one.
+// The reader always gets the latest complete snapshot. Snapshots that get published faster than they get read are skipped, and the reader keeps drawing its current one if nothing new came in.
+class SnapshotTripleBuffer
+{
+public:
+	SceneSnapshot snapshots[3];
+	std::atomic<uint32_t> middle { 1 };					// Index of the middle snapshot, plus SNAPSHOT_FRESH if the reader hasn't seen it yet.
+	uint32_t back = 0;									// Only touched by the writer.
+	uint32_t front = 2;									// Only touched by the reader.
+
+	SceneSnapshot& writeBuffer() noexcept { return snapshots[back]; }
+	void publish() noexcept;
+
+	// Returns true if there was a new snapshot, which readBuffer now returns.
+	bool acquire() noexcept;
+	const SceneSnapshot& readBuffer() const noexcept { return snapshots[front]; }
+};
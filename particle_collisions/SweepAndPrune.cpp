@@ -0,0 +1,139 @@
+#include "SweepAndPrune.h"
+
+#include <algorithm>
+#include <limits>
+
+// Extra space on both ends of every interval, so that floating point error in the t-value calculations can't make a colliding pair's intervals miss each other. Same idea as GRID_CELL_PADDING in Scene.cpp.
+#define SWEEP_AND_PRUNE_PADDING 0.5f
+
+static void sweptInterval(float pos, float vel, float radius, float subStep, float speedBound, float& lower, float& upper) noexcept {
+	if (speedBound < 0) {
+		float end = pos + vel * subStep;
+		lower = (pos < end ? pos : end) - radius - SWEEP_AND_PRUNE_PADDING;
+		upper = (pos < end ? end : pos) + radius + SWEEP_AND_PRUNE_PADDING;
+	} else {
+		float reach = radius + speedBound * subStep + SWEEP_AND_PRUNE_PADDING;
+		lower = pos - reach;
+		upper = pos + reach;
+	}
+	// A particle with a NaN position or velocity (because something went very wrong) can't collide with anything, the t-values always come out as NaN. Its interval would break the sort though, so it gets an empty interval at the very end of the order instead.
+	if (!(lower <= upper)) {
+		lower = std::numeric_limits<float>::infinity();
+		upper = -std::numeric_limits<float>::infinity();
+	}
+}
+
+void SweepAndPrune::markChanged(size_t particleIndex) {
+	if (order.empty()) { return; }												// Nothing to repair yet, the first update sorts from scratch anyway.
+	changed.push_back(particleIndex);
+	if (changed.size() > order.size()) { order.clear(); changed.clear(); }			// Lots of changes without an update in between (the scene doesn't use this broad phase right now), starting over is cheaper by then.
+}
+
+// Takes the changed particles out of the order and merges them back in sorted by their new intervals. The rest of the order stays the way it was, which is close to sorted, so the insertion sort afterwards is cheap again.
+void SweepAndPrune::repairOrder(size_t particleCount) {
+	changedFlags.assign(particleCount, 0);
+	for (size_t i = 0; i < changed.size(); i++) { if (changed[i] < particleCount) { changedFlags[changed[i]] = 1; } }
+	size_t kept = 0;
+	for (size_t i = 0; i < order.size(); i++) {
+		if (order[i] < particleCount && changedFlags[order[i]] == 0) { order[kept++] = order[i]; }
+	}
+	order.resize(kept);
+
+	size_t firstChanged = order.size();
+	for (size_t i = 0; i < changed.size(); i++) {
+		size_t particle = changed[i];
+		if (particle < particleCount && changedFlags[particle] == 1) { order.push_back(particle); changedFlags[particle] = 2; }			// Only once, a particle can get marked several times.
+	}
+	std::sort(order.begin() + firstChanged, order.end(), [this](size_t a, size_t b) { return lower[a] < lower[b]; });
+	mergedOrder.resize(order.size());
+	std::merge(order.begin(), order.begin() + firstChanged, order.begin() + firstChanged, order.end(), mergedOrder.begin(), [this](size_t a, size_t b) { return lower[a] < lower[b]; });
+	order.swap(mergedOrder);
+	changed.clear();
+}
+
+void SweepAndPrune::update(const ParticleStore& particles, size_t particleCount, float subStep, float speedBound) {
+	bool repair = !changed.empty();
+	if (repair) {
+		lower.resize(particleCount);
+		upper.resize(particleCount);
+		crossLower.resize(particleCount);
+		crossUpper.resize(particleCount);
+	}
+	else if (order.size() != particleCount) {
+		// Pick the axis with the bigger spread, so that as few intervals as possible overlap along it.
+		// NOTE: The axis only gets picked again when the amount of particles changes, not when the particles wander off into a different shape. Switching would throw away the nearly sorted order that makes every other update cheap and cost a full sort, and a worse axis only costs some extra pairs that the narrow phase rejects.
+		double meanX = 0, meanY = 0;
+		for (size_t i = 0; i < particleCount; i++) { meanX += particles.x[i]; meanY += particles.y[i]; }
+		if (particleCount != 0) { meanX /= particleCount; meanY /= particleCount; }
+		double spreadX = 0, spreadY = 0;
+		for (size_t i = 0; i < particleCount; i++) {
+			spreadX += (particles.x[i] - meanX) * (particles.x[i] - meanX);
+			spreadY += (particles.y[i] - meanY) * (particles.y[i] - meanY);
+		}
+		yAxis = spreadY > spreadX;
+
+		order.resize(particleCount);
+		for (size_t i = 0; i < particleCount; i++) { order[i] = i; }
+		lower.resize(particleCount);
+		upper.resize(particleCount);
+		crossLower.resize(particleCount);
+		crossUpper.resize(particleCount);
+	}
+
+	const float* sweepPos = yAxis ? particles.y : particles.x;
+	const float* sweepVel = yAxis ? particles.vy : particles.vx;
+	const float* crossPos = yAxis ? particles.x : particles.y;
+	const float* crossVel = yAxis ? particles.vx : particles.vy;
+	for (size_t i = 0; i < particleCount; i++) {
+		sweptInterval(sweepPos[i], sweepVel[i], particles.radius[i], subStep, speedBound, lower[i], upper[i]);
+		sweptInterval(crossPos[i], crossVel[i], particles.radius[i], subStep, speedBound, crossLower[i], crossUpper[i]);
+	}
+
+	if (repair) { repairOrder(particleCount); }
+
+	// Insertion sort, which only costs as much as there are particles that swapped places since the last update.
+	for (size_t i = 1; i < particleCount; i++) {
+		size_t particle = order[i];
+		float key = lower[particle];
+		size_t j = i;
+		for (; j > 0 && lower[order[j - 1]] > key; j--) { order[j] = order[j - 1]; }
+		order[j] = particle;
+	}
+
+	pairs.clear();
+	for (size_t i = 0; i < particleCount; i++) {
+		size_t a = order[i];
+		float end = upper[a];
+		for (size_t j = i + 1; j < particleCount; j++) {
+			size_t b = order[j];
+			if (lower[b] > end) { break; }													// Everything after this starts even later, so nothing after it can overlap with a either.
+			if (crossLower[b] > crossUpper[a] || crossLower[a] > crossUpper[b]) { continue; }
+			pairs.push_back(a);
+			pairs.push_back(b);
+		}
+	}
+
+	// Counting sort of the pairs into the partner lists of both of their particles.
+	partnerOffsets.assign(particleCount + 1, 0);
+	for (size_t i = 0; i < pairs.size(); i++) { partnerOffsets[pairs[i] + 1]++; }
+	for (size_t i = 0; i < particleCount; i++) { partnerOffsets[i + 1] += partnerOffsets[i]; }
+	partners.resize(pairs.size());
+	for (size_t i = 0; i < pairs.size(); i += 2) {
+		partners[partnerOffsets[pairs[i]]++] = pairs[i + 1];
+		partners[partnerOffsets[pairs[i + 1]]++] = pairs[i];
+	}
+	for (size_t i = particleCount; i > 0; i--) { partnerOffsets[i] = partnerOffsets[i - 1]; }			// The fill above moved every offset to the start of the next list, this moves them back.
+	partnerOffsets[0] = 0;
+	for (size_t i = 0; i < particleCount; i++) { std::sort(partners.begin() + partnerOffsets[i], partners.begin() + partnerOffsets[i + 1]); }
+}
+
+void SweepAndPrune::gatherCandidates(size_t particleIndex, std::vector<size_t>& candidates) const {
+	candidates.clear();
+	for (size_t i = partnerOffsets[particleIndex]; i < partnerOffsets[particleIndex + 1]; i++) {
+		if (partners[i] > particleIndex) { candidates.push_back(partners[i]); }
+	}
+}
+
+void SweepAndPrune::gatherNeighbors(size_t particleIndex, std::vector<size_t>& neighbors) const {
+	neighbors.assign(partners.begin() + partnerOffsets[particleIndex], partners.begin() + partnerOffsets[particleIndex + 1]);
+}
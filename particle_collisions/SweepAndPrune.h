@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sweep-and-prune broad phase for the Scene. Alternative to the UniformGrid for scenes where a grid would be mostly empty, like long, thin channels.
+// Every particle gets an interval on both axes that covers everything the particle can touch in the current sub-step. The particles are kept sorted by the start of their interval along the sweep axis,
+// and sweeping through that order finds every pair whose intervals overlap on both axes. Only those pairs can collide, every other pair is skipped.
+// The order is kept from one update to the next and re-sorted with insertion sort. Particles barely change their place in the order between sub-steps, so that's close to linear.
+class SweepAndPrune
+{
+public:
+	bool yAxis = false;											// The sweep axis, which is whichever axis the particles are spread out along the most.
+
+	std::vector<float> lower;									// Interval of every particle along the sweep axis.
+	std::vector<float> upper;
+	std::vector<float> crossLower;								// Interval of every particle along the other axis.
+	std::vector<float> crossUpper;
+
+	std::vector<size_t> order;									// The particles, sorted by lower. Other phases can walk this to visit the particles in the order they appear along the sweep axis.
+
+	// Every pair with overlapping intervals, stored as a list of partners for both particles of the pair. The partners of particle i are partners[partnerOffsets[i]] up to partners[partnerOffsets[i + 1]], in ascending order.
+	std::vector<size_t> partnerOffsets;
+	std::vector<size_t> partners;
+
+	// Particles whose index refers to a different particle than at the last update (or one that's gone, or a new one), see markChanged.
+	std::vector<size_t> changed;
+
+	// Recalculates the intervals, re-sorts and collects the overlapping pairs. If the amount of particles changed since the last update and markChanged didn't say why, the order is started over and the sweep axis is picked again.
+	// If speedBound is negative, the intervals are swept along each particle's velocity over subStep, which is as tight as it gets, but only holds until a velocity changes.
+	// Otherwise, the intervals reach speedBound * subStep in every direction, which holds for any velocity up to speedBound.
+	void update(const ParticleStore& particles, size_t particleCount, float subStep, float speedBound);
+
+	// Called by Scene::insert and Scene::remove for every index that got a different particle. The next update takes those out of the order and merges them back in at the right places, which keeps the rest of the order instead of starting over.
+	void markChanged(size_t particleIndex);
+
+	// Same as UniformGrid::gatherCandidates: All the partners of particleIndex above particleIndex, in ascending order.
+	void gatherCandidates(size_t particleIndex, std::vector<size_t>& candidates) const;
+
+	// Same as UniformGrid::gatherNeighbors: All the partners of particleIndex.
+	void gatherNeighbors(size_t particleIndex, std::vector<size_t>& neighbors) const;
+
+	std::vector<size_t> pairs;									// Scratch space for update, every pair gets collected in here before it's sorted into partners.
+	std::vector<uint8_t> changedFlags;							// Scratch space for repairing the order after markChanged.
+	std::vector<size_t> mergedOrder;
+
+	void repairOrder(size_t particleCount);
+};
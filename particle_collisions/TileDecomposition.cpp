@@ -0,0 +1,109 @@
+#include "TileDecomposition.h"
+
+#include <cmath>
+
+// Same limit as GRID_MAX_CELLS_PER_PARTICLE in the UniformGrid, bigger cells only ever produce more pairs to check, never less.
+#define CLUSTER_MAX_CELLS_PER_PARTICLE 4
+
+void TileDecomposition::layout(uint32_t width, uint32_t height, size_t tileCount) {
+	this->width = width;
+	this->height = height;
+	if (tileCount == 0) { tileCount = 1; }
+	float tileSize = sqrt((float)width * (float)height / (float)tileCount);
+	if (!(tileSize > 0)) { tileSize = 1; }
+	columns = (size_t)round(width / tileSize);
+	rows = (size_t)round(height / tileSize);
+	if (columns == 0) { columns = 1; }
+	if (rows == 0) { rows = 1; }
+	tileWidth = width != 0 ? (float)width / columns : 1;
+	tileHeight = height != 0 ? (float)height / rows : 1;
+}
+
+void TileDecomposition::assign(const float* x, const float* y, size_t particleCount) {
+	tileOf.resize(particleCount);
+	parents.resize(particleCount);
+	for (size_t i = 0; i < particleCount; i++) {
+		// Same clamping as UniformGrid::columnOf, particles outside of the scene (or with NaN positions) end up in the border tiles.
+		size_t column = x[i] >= 0 ? (size_t)(x[i] / tileWidth) : 0;
+		size_t row = y[i] >= 0 ? (size_t)(y[i] / tileHeight) : 0;
+		if (column >= columns) { column = columns - 1; }
+		if (row >= rows) { row = rows - 1; }
+		tileOf[i] = (uint32_t)(row * columns + column);
+		parents[i] = (uint32_t)i;
+	}
+}
+
+uint32_t TileDecomposition::find(uint32_t particleIndex) noexcept {
+	while (parents[particleIndex] != particleIndex) {
+		parents[particleIndex] = parents[parents[particleIndex]];					// Path halving, keeps the trees flat without a second pass.
+		particleIndex = parents[particleIndex];
+	}
+	return particleIndex;
+}
+
+void TileDecomposition::merge(uint32_t a, uint32_t b) noexcept {
+	a = find(a);
+	b = find(b);
+	if (a == b) { return; }
+	if (a < b) { parents[b] = a; }
+	else { parents[a] = b; }
+}
+
+void TileDecomposition::mergeReachable(const float* x, const float* y, const float* radius, size_t particleCount, float maxRadius, float reach) {
+	float cellSize = 2 * maxRadius + reach;
+	float minCellSize = sqrt((float)width * (float)height / (float)(particleCount * CLUSTER_MAX_CELLS_PER_PARTICLE + 1));
+	if (!(cellSize >= minCellSize)) { cellSize = minCellSize; }
+	if (!(cellSize >= 1)) { cellSize = 1; }
+	size_t cellColumns = (size_t)ceil(width / cellSize);
+	size_t cellRows = (size_t)ceil(height / cellSize);
+	if (cellColumns == 0) { cellColumns = 1; }
+	if (cellRows == 0) { cellRows = 1; }
+
+	particleCells.resize(particleCount);
+	cellStarts.assign(cellColumns * cellRows + 1, 0);
+	cellParticles.resize(particleCount);
+	for (size_t i = 0; i < particleCount; i++) {
+		size_t column = x[i] >= 0 ? (size_t)(x[i] / cellSize) : 0;
+		size_t row = y[i] >= 0 ? (size_t)(y[i] / cellSize) : 0;
+		if (column >= cellColumns) { column = cellColumns - 1; }
+		if (row >= cellRows) { row = cellRows - 1; }
+		particleCells[i] = (uint32_t)(row * cellColumns + column);
+		cellStarts[particleCells[i]]++;
+	}
+	for (size_t i = 1; i < cellStarts.size(); i++) { cellStarts[i] += cellStarts[i - 1]; }
+	for (size_t i = 0; i < particleCount; i++) { cellParticles[--cellStarts[particleCells[i]]] = (uint32_t)i; }				// After the prefix sum, every entry points at the end of its cell. Filling the cells from the back moves them to the start.
+
+	for (size_t i = 0; i < particleCount; i++) {
+		size_t column = particleCells[i] % cellColumns;
+		size_t row = particleCells[i] / cellColumns;
+		size_t firstColumn = column != 0 ? column - 1 : 0;
+		size_t lastColumn = column + 1 < cellColumns ? column + 1 : column;
+		size_t firstRow = row != 0 ? row - 1 : 0;
+		size_t lastRow = row + 1 < cellRows ? row + 1 : row;
+		for (size_t neighborRow = firstRow; neighborRow <= lastRow; neighborRow++) {
+			for (size_t neighborColumn = firstColumn; neighborColumn <= lastColumn; neighborColumn++) {
+				size_t cell = neighborRow * cellColumns + neighborColumn;
+				for (uint32_t k = cellStarts[cell]; k < cellStarts[cell + 1]; k++) {
+					uint32_t j = cellParticles[k];
+					if (j <= i) { continue; }								// Every pair only needs to be looked at once.
+					float dx = x[j] - x[i];
+					float dy = y[j] - y[i];
+					float maxDistance = radius[i] + radius[j] + reach;
+					if (dx * dx + dy * dy <= maxDistance * maxDistance) { merge((uint32_t)i, j); }
+				}
+			}
+		}
+	}
+}
+
+void TileDecomposition::buildGroups() {
+	groupOf.resize(parents.size());
+	clusterSizes.assign(parents.size(), 0);
+	largestCluster = 0;
+	for (size_t i = 0; i < parents.size(); i++) {
+		uint32_t root = find((uint32_t)i);
+		groupOf[i] = root == i ? tileOf[i] : groupOf[root];					// The root is the lowest particle of the cluster, so its group is always known by the time the other members come up.
+		clusterSizes[root]++;
+		if (clusterSizes[root] > largestCluster) { largestCluster = clusterSizes[root]; }
+	}
+}
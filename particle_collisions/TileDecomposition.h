@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits the scene into a grid of equally sized tiles for the tiled event-driven engine (see Scene::stepTiled), every tile gets its own event queue.
+// Particles that could reach each other inside of the current time window get merged into one cluster with a union-find. Every cluster is handed to the tile that contains the cluster's lowest particle,
+// which keeps clusters that sit on a tile border together without having to merge the whole tile with its neighbor (in dense scenes, that would merge every tile into one).
+class TileDecomposition
+{
+public:
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t columns = 1;
+	size_t rows = 1;
+	float tileWidth = 1;
+	float tileHeight = 1;
+
+	std::vector<uint32_t> tileOf;								// The tile that contains each particle's center.
+	std::vector<uint32_t> parents;								// Union-find forest over the particles. Roots are always the lowest particle of their cluster.
+	std::vector<uint32_t> groupOf;								// The tile whose event queue each particle belongs to, valid after buildGroups.
+	std::vector<uint32_t> clusterSizes;
+	size_t largestCluster = 0;
+
+	// Scratch space for mergeReachable, which sorts the particles into cells with a counting sort. The particles of cell c are cellParticles[cellStarts[c]] up to cellParticles[cellStarts[c + 1]].
+	std::vector<uint32_t> particleCells;
+	std::vector<uint32_t> cellStarts;
+	std::vector<uint32_t> cellParticles;
+
+	size_t tileCount() const noexcept { return columns * rows; }
+
+	// Picks roughly square tiles so that there are about tileCount of them.
+	void layout(uint32_t width, uint32_t height, size_t tileCount);
+
+	// Sorts the particles into tiles by the given positions and starts over with every particle in its own cluster.
+	void assign(const float* x, const float* y, size_t particleCount);
+
+	uint32_t find(uint32_t particleIndex) noexcept;
+	void merge(uint32_t a, uint32_t b) noexcept;
+
+	// Merges every pair of particles that are at most reach apart (surface to surface) at the given positions. maxRadius has to be at least as big as the biggest radius.
+	void mergeReachable(const float* x, const float* y, const float* radius, size_t particleCount, float maxRadius, float reach);
+
+	void buildGroups();
+};
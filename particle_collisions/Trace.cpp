@@ -0,0 +1,95 @@
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
+
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "debugOutput.h"
+
+// Only ever written by the thread it belongs to. The exporter reads count with acquire, so every span below count is complete by the time it gets read.
+struct TraceBuffer
+{
+	std::vector<TraceSpan> spans;
+	std::atomic<size_t> count;
+	std::atomic<size_t> dropped;
+	uint32_t threadIndex;
+};
+
+std::atomic<bool> traceEnabled(false);
+
+std::mutex traceBuffersMutex;
+std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;					// Never shrinks, so that threads that have exited (and their spans) stay valid until the trace gets written.
+thread_local TraceBuffer* threadTraceBuffer = nullptr;
+std::chrono::steady_clock::time_point traceOrigin = std::chrono::steady_clock::now();
+
+uint64_t traceTimestamp() noexcept { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceOrigin).count(); }
+
+static TraceBuffer* registerThreadTraceBuffer() {
+	std::unique_ptr<TraceBuffer> buffer(new TraceBuffer());
+	buffer->spans.resize(TRACE_BUFFER_CAPACITY);
+	buffer->count.store(0, std::memory_order_relaxed);
+	buffer->dropped.store(0, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(traceBuffersMutex);
+	buffer->threadIndex = (uint32_t)traceBuffers.size();
+	traceBuffers.push_back(std::move(buffer));
+	return traceBuffers.back().get();
+}
+
+void recordTraceSpan(const char* name, uint64_t start, uint64_t end) noexcept {
+	TraceBuffer* buffer = threadTraceBuffer;
+	if (buffer == nullptr) {
+		try { buffer = registerThreadTraceBuffer(); }
+		catch (...) { return; }												// Out of memory, the trace just misses this thread.
+		threadTraceBuffer = buffer;
+	}
+	size_t count = buffer->count.load(std::memory_order_relaxed);
+	if (count == buffer->spans.size()) { buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); return; }
+	buffer->spans[count] = { name, start, end };
+	buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void startTrace() noexcept {
+	std::lock_guard<std::mutex> lock(traceBuffersMutex);
+	for (size_t i = 0; i < traceBuffers.size(); i++) { traceBuffers[i]->count.store(0, std::memory_order_relaxed); traceBuffers[i]->dropped.store(0, std::memory_order_relaxed); }
+	traceOrigin = std::chrono::steady_clock::now();
+	traceEnabled.store(true, std::memory_order_release);
+}
+
+void stopTrace() noexcept { traceEnabled.store(false, std::memory_order_release); }
+
+size_t droppedTraceSpans() noexcept {
+	std::lock_guard<std::mutex> lock(traceBuffersMutex);
+	size_t dropped = 0;
+	for (size_t i = 0; i < traceBuffers.size(); i++) { dropped += traceBuffers[i]->dropped.load(std::memory_order_relaxed); }
+	return dropped;
+}
+
+// Complete events ("ph": "X") with microsecond timestamps, which is what the format expects. Every thread shows up as its own track, named after the order in which the threads started recording.
+// NOTE: Span names get written without escaping, they're all string literals from TRACE_SCOPE.
+bool writeChromeTrace(const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to open trace file " << path << debuglogger::endl; return false; }
+
+	std::lock_guard<std::mutex> lock(traceBuffersMutex);
+	fputs("{\"traceEvents\":[\n", file);
+	bool first = true;
+	for (size_t i = 0; i < traceBuffers.size(); i++) {
+		const TraceBuffer& buffer = *traceBuffers[i];
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}", first ? "" : ",\n", buffer.threadIndex, buffer.threadIndex);
+		first = false;
+		size_t count = buffer.count.load(std::memory_order_acquire);
+		for (size_t j = 0; j < count; j++) {
+			const TraceSpan& span = buffer.spans[j];
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", span.name, buffer.threadIndex, span.start / 1000.0, (span.end - span.start) / 1000.0);
+		}
+	}
+	fputs("\n],\"displayTimeUnit\":\"ns\"}\n", file);
+
+	bool failed = ferror(file) != 0;
+	if (fclose(file) != 0 || failed) { debuglogger::out << debuglogger::error << "failed to write trace file " << path << debuglogger::endl; return false; }
+	return true;
+}
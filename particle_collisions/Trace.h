@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Timeline of where the time inside of a frame goes, exported as Chrome trace JSON, which Perfetto (ui.perfetto.dev) and chrome://tracing can load.
+// Spans get recorded with TRACE_SCOPE into a buffer that belongs to the recording thread, so recording never locks or shares cache lines with other threads. A thread's buffer gets registered (under a lock) the first time it records something.
+// Recording is off by default. While it's off, a TRACE_SCOPE is a single relaxed load of traceEnabled and a branch.
+
+// Spans that every thread can hold per trace. Spans past that get dropped (and counted in droppedTraceSpans), so that recording never allocates.
+#define TRACE_BUFFER_CAPACITY (1 << 18)
+
+struct TraceSpan
+{
+	const char* name;						// Has to be a string literal (or live at least as long as the trace), only the pointer gets stored.
+	uint64_t start;							// Nanoseconds since startTrace.
+	uint64_t end;
+};
+
+extern std::atomic<bool> traceEnabled;
+
+uint64_t traceTimestamp() noexcept;
+void recordTraceSpan(const char* name, uint64_t start, uint64_t end) noexcept;
+
+// Throws away everything that has been recorded so far and turns recording on. Has to be called while no other thread is recording, between steps for example.
+void startTrace() noexcept;
+void stopTrace() noexcept;
+
+size_t droppedTraceSpans() noexcept;
+
+// Writes every span recorded since startTrace into the given file. Returns false (after logging why) if the file couldn't be written.
+bool writeChromeTrace(const char* path);
+
+// Records the time between its construction and its destruction as a span, if recording was on when it was constructed.
+class TraceScope
+{
+public:
+	const char* name;
+	uint64_t start;
+	bool recording;
+
+	TraceScope(const char* name) noexcept : name(name), start(0), recording(traceEnabled.load(std::memory_order_relaxed)) { if (recording) { start = traceTimestamp(); } }
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+	~TraceScope() { if (recording) { recordTraceSpan(name, start, traceTimestamp()); } }
+};
+
+#define TRACE_SCOPE_NAME_CONCAT(name, line) name##line
+#define TRACE_SCOPE_NAME(line) TRACE_SCOPE_NAME_CONCAT(traceScope, line)
+#define TRACE_SCOPE(name) TraceScope TRACE_SCOPE_NAME(__LINE__)(name)
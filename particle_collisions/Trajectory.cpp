@@ -0,0 +1,371 @@
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
+
+#include "Trajectory.h"
+
+#include "Scene.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "debugOutput.h"
+#include "Trace.h"
+
+// Differences (in quanta) bigger than this make the writer fall back to a keyframe, which also takes care of NaNs and infinities.
+#define TRAJECTORY_MAX_DELTA 1e12f
+
+void TrajectoryFrame::resize(size_t count) {
+	this->count = count;
+	x.resize(count);
+	y.resize(count);
+	vx.resize(count);
+	vy.resize(count);
+	radius.resize(count);
+}
+
+static bool seekTrajectoryFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+	return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool trajectoryFileSize(FILE* file, uint64_t& size) {
+#ifdef _WIN32
+	if (_fseeki64(file, 0, SEEK_END) != 0) { return false; }
+	long long position = _ftelli64(file);
+#else
+	if (fseeko(file, 0, SEEK_END) != 0) { return false; }
+	long long position = (long long)ftello(file);
+#endif
+	if (position < 0) { return false; }
+	size = (uint64_t)position;
+	return true;
+}
+
+// The writer and the reader have to reconstruct the exact same floats, so both of them go through these.
+static inline bool quantizeDelta(float value, float predicted, float quantum, int64_t& delta) {
+	float quanta = (value - predicted) / quantum;
+	if (!(fabsf(quanta) < TRAJECTORY_MAX_DELTA)) { return false; }
+	delta = (int64_t)llroundf(quanta);
+	return true;
+}
+
+static inline float applyDelta(float predicted, int64_t delta, float quantum) { return predicted + (float)delta * quantum; }
+
+static inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+static inline int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+static inline void writeVarint(std::vector<uint8_t>& output, uint64_t value) {
+	while (value >= 0x80) { output.push_back((uint8_t)value | 0x80); value >>= 7; }
+	output.push_back((uint8_t)value);
+}
+
+static inline bool readVarint(const uint8_t*& input, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (input == end) { return false; }
+		uint8_t byte = *input++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) { return true; }
+	}
+	return false;
+}
+
+// Delta tokens: a varint that's either (zigzag(delta) << 1) or ((run of zero deltas) << 1 | 1).
+struct DeltaTokenWriter
+{
+	std::vector<uint8_t>& output;
+	uint64_t zeroRun = 0;
+
+	void push(int64_t delta) {
+		if (delta == 0) { zeroRun++; return; }
+		flush();
+		writeVarint(output, zigzag(delta) << 1);
+	}
+	void flush() {
+		if (zeroRun == 0) { return; }
+		writeVarint(output, zeroRun << 1 | 1);
+		zeroRun = 0;
+	}
+};
+
+struct DeltaTokenReader
+{
+	const uint8_t* input;
+	const uint8_t* end;
+	uint64_t zeroRun = 0;
+
+	bool pop(int64_t& delta) {
+		if (zeroRun != 0) { zeroRun--; delta = 0; return true; }
+		uint64_t token;
+		if (!readVarint(input, end, token)) { return false; }
+		if (token & 1) {
+			zeroRun = token >> 1;
+			if (zeroRun == 0) { return false; }
+			zeroRun--;
+			delta = 0;
+			return true;
+		}
+		delta = unzigzag(token >> 1);
+		return true;
+	}
+};
+
+TrajectoryWriter::~TrajectoryWriter() { close(); }
+
+bool TrajectoryWriter::open(const char* path, uint32_t keyframeInterval, float positionQuantum, float velocityQuantum) {
+	close();
+	file = fopen(path, "wb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to create trajectory file " << path << debuglogger::endl; return false; }
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	header.version = TRAJECTORY_VERSION;
+	header.keyframeInterval = keyframeInterval == 0 ? 1 : keyframeInterval;
+	header.positionQuantum = positionQuantum;
+	header.velocityQuantum = velocityQuantum;
+	fileOffset = 0;
+	failed = false;
+	index.clear();
+	reference.resize(0);
+	framesSinceKeyframe = 0;
+	writeBytes(&header, sizeof(header));
+
+	frameBusy[0] = false;
+	frameBusy[1] = false;
+	pendingFrame = nullptr;
+	nextFrame = 0;
+	submittedFrames = 0;
+	stopping = false;
+	thread = std::thread([this]() { encoderLoop(); });
+	return true;
+}
+
+void TrajectoryWriter::submit(const Scene& scene) {
+	if (!thread.joinable()) { return; }
+	TRACE_SCOPE("trajectory submit");
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]() { return !frameBusy[nextFrame] && pendingFrame == nullptr; });
+	}
+
+	// The encoder is done with this buffer and doesn't get it back until it's handed over below, so it gets filled without holding the lock.
+	TrajectoryFrame& frame = frames[nextFrame];
+	const ParticleStore& particles = scene.particles;
+	size_t count = scene.particleCount;
+	frame.frame = submittedFrames++;
+	frame.resize(count);
+	memcpy(frame.x.data(), particles.x, count * sizeof(float));
+	memcpy(frame.y.data(), particles.y, count * sizeof(float));
+	memcpy(frame.vx.data(), particles.vx, count * sizeof(float));
+	memcpy(frame.vy.data(), particles.vy, count * sizeof(float));
+	memcpy(frame.radius.data(), particles.radius, count * sizeof(float));
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frameBusy[nextFrame] = true;
+		pendingFrame = &frame;
+	}
+	condition.notify_all();
+	nextFrame ^= 1;
+}
+
+void TrajectoryWriter::encoderLoop() {
+	while (true) {
+		TrajectoryFrame* frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return pendingFrame != nullptr || stopping; });
+			if (pendingFrame == nullptr) { return; }							// Only stops once everything that got submitted is written.
+			frame = pendingFrame;
+			pendingFrame = nullptr;
+		}
+		encodeFrame(*frame);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			frameBusy[frame - frames] = false;
+		}
+		condition.notify_all();
+	}
+}
+
+void TrajectoryWriter::encodeFrame(const TrajectoryFrame& frame) {
+	TRACE_SCOPE("trajectory encode");
+	bool keyframe = frame.frame == 0 || framesSinceKeyframe + 1 >= header.keyframeInterval || frame.count != reference.count;			// Particles that got added or removed change the indices, so that always needs a keyframe.
+	if (keyframe || !encodeDelta(frame)) { encodeKeyframe(frame); keyframe = true; }
+	framesSinceKeyframe = keyframe ? 0 : framesSinceKeyframe + 1;
+
+	TrajectoryFrameHeader frameHeader = { TRAJECTORY_FRAME_MARKER, keyframe ? 1u : 0u, frame.frame, frame.count, payload.size() };
+	index.push_back({ frame.frame, fileOffset, keyframe ? 1u : 0u });
+	writeBytes(&frameHeader, sizeof(frameHeader));
+	writeBytes(payload.data(), payload.size());
+}
+
+// Fails if a difference is too big to quantize, in which case reference is partly updated already, but the keyframe that replaces it overwrites all of it.
+bool TrajectoryWriter::encodeDelta(const TrajectoryFrame& frame) {
+	payload.clear();
+	DeltaTokenWriter tokens = { payload };
+	float positionQuantum = header.positionQuantum;
+	float velocityQuantum = header.velocityQuantum;
+	for (size_t i = 0; i < frame.count; i++) {
+		float predictedX = reference.x[i] + reference.vx[i];
+		float predictedY = reference.y[i] + reference.vy[i];
+		int64_t deltaX, deltaY, deltaVX, deltaVY;
+		if (!quantizeDelta(frame.x[i], predictedX, positionQuantum, deltaX) || !quantizeDelta(frame.y[i], predictedY, positionQuantum, deltaY)) { return false; }
+		if (!quantizeDelta(frame.vx[i], reference.vx[i], velocityQuantum, deltaVX) || !quantizeDelta(frame.vy[i], reference.vy[i], velocityQuantum, deltaVY)) { return false; }
+		reference.x[i] = applyDelta(predictedX, deltaX, positionQuantum);
+		reference.y[i] = applyDelta(predictedY, deltaY, positionQuantum);
+		reference.vx[i] = applyDelta(reference.vx[i], deltaVX, velocityQuantum);
+		reference.vy[i] = applyDelta(reference.vy[i], deltaVY, velocityQuantum);
+		tokens.push(deltaX);
+		tokens.push(deltaY);
+		tokens.push(deltaVX);
+		tokens.push(deltaVY);
+	}
+	tokens.flush();
+	return true;
+}
+
+void TrajectoryWriter::encodeKeyframe(const TrajectoryFrame& frame) {
+	size_t arraySize = frame.count * sizeof(float);
+	payload.resize(arraySize * 5);
+	const float* arrays[5] = { frame.x.data(), frame.y.data(), frame.vx.data(), frame.vy.data(), frame.radius.data() };
+	for (size_t i = 0; i < 5; i++) { if (arraySize != 0) { memcpy(payload.data() + i * arraySize, arrays[i], arraySize); } }
+	reference.frame = frame.frame;
+	reference.resize(frame.count);
+	reference.x = frame.x;
+	reference.y = frame.y;
+	reference.vx = frame.vx;
+	reference.vy = frame.vy;
+	reference.radius = frame.radius;
+}
+
+void TrajectoryWriter::writeBytes(const void* data, size_t size) {
+	if (failed || size == 0) { return; }
+	if (fwrite(data, 1, size, file) != size) { failed = true; debuglogger::out << debuglogger::error << "failed to write trajectory frame" << debuglogger::endl; return; }			// Frames keep getting encoded, but nothing gets written anymore.
+	fileOffset += size;
+}
+
+bool TrajectoryWriter::close() {
+	if (!thread.joinable()) { return !failed; }
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	thread.join();
+
+	TrajectoryFooter footer = { fileOffset, index.size(), { } };
+	memcpy(footer.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	writeBytes(index.data(), index.size() * sizeof(TrajectoryIndexEntry));
+	writeBytes(&footer, sizeof(footer));
+	if (fclose(file) != 0) { failed = true; }
+	file = nullptr;
+	if (failed) { debuglogger::out << debuglogger::error << "trajectory file is incomplete" << debuglogger::endl; }
+	return !failed;
+}
+
+TrajectoryReader::~TrajectoryReader() { close(); }
+
+bool TrajectoryReader::open(const char* path) {
+	close();
+	file = fopen(path, "rb");
+	if (file == nullptr) { debuglogger::out << debuglogger::error << "failed to open trajectory file " << path << debuglogger::endl; return false; }
+
+	uint64_t fileSize;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 || header.version != TRAJECTORY_VERSION || !trajectoryFileSize(file, fileSize)) {
+		debuglogger::out << debuglogger::error << path << " isn't a trajectory file this version can read" << debuglogger::endl;
+		close();
+		return false;
+	}
+
+	// The index is only there if the writer got to close the file. Without it, the frames get found by walking through their headers.
+	TrajectoryFooter footer;
+	bool indexed = fileSize >= sizeof(header) + sizeof(footer) && seekTrajectoryFile(file, fileSize - sizeof(footer)) && fread(&footer, sizeof(footer), 1, file) == 1 && memcmp(footer.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) == 0
+		&& footer.indexOffset >= sizeof(header) && footer.frameCount <= (fileSize - sizeof(footer) - footer.indexOffset) / sizeof(TrajectoryIndexEntry) && footer.indexOffset + footer.frameCount * sizeof(TrajectoryIndexEntry) + sizeof(footer) == fileSize;
+	if (indexed) {
+		index.resize((size_t)footer.frameCount);
+		indexed = seekTrajectoryFile(file, footer.indexOffset) && (index.empty() || fread(index.data(), sizeof(TrajectoryIndexEntry), index.size(), file) == index.size());
+		for (size_t i = 0; indexed && i < index.size(); i++) { indexed = index[i].frame == i && index[i].offset < footer.indexOffset && (i != 0 || index[i].keyframe); }
+	}
+	if (!indexed) {
+		debuglogger::out << debuglogger::warning << path << " has no index, scanning it for frames" << debuglogger::endl;
+		index.clear();
+		if (!scanFrames(fileSize)) { close(); return false; }
+	}
+	return true;
+}
+
+void TrajectoryReader::close() {
+	if (file != nullptr) { fclose(file); }
+	file = nullptr;
+	index.clear();
+	stateValid = false;
+}
+
+bool TrajectoryReader::scanFrames(uint64_t fileSize) {
+	uint64_t offset = sizeof(header);
+	TrajectoryFrameHeader frameHeader;
+	while (offset + sizeof(frameHeader) <= fileSize) {
+		if (!seekTrajectoryFile(file, offset) || fread(&frameHeader, sizeof(frameHeader), 1, file) != 1) { break; }
+		if (frameHeader.marker != TRAJECTORY_FRAME_MARKER || frameHeader.frame != index.size() || frameHeader.payloadSize > fileSize - offset - sizeof(frameHeader)) { break; }			// The end of what got written, or a frame that only got written halfway.
+		if (index.empty() && !frameHeader.keyframe) { break; }
+		index.push_back({ frameHeader.frame, offset, frameHeader.keyframe });
+		offset += sizeof(frameHeader) + frameHeader.payloadSize;
+	}
+	return true;
+}
+
+bool TrajectoryReader::readFrame(uint64_t frame) {
+	if (frame >= index.size()) { debuglogger::out << debuglogger::error << "trajectory frame " << (uint32_t)frame << " doesn't exist" << debuglogger::endl; return false; }
+	if (stateValid && state.frame == frame) { return true; }
+
+	uint64_t start = frame;
+	while (!index[(size_t)start].keyframe) { start--; }								// Frame 0 is always a keyframe.
+	if (stateValid && state.frame >= start && state.frame < frame) { start = state.frame + 1; }			// Carries on from the frame that's already decoded instead.
+	for (uint64_t i = start; i <= frame; i++) {
+		if (!decodeFrame(index[(size_t)i])) {
+			stateValid = false;
+			debuglogger::out << debuglogger::error << "trajectory frame " << (uint32_t)i << " is damaged" << debuglogger::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TrajectoryReader::decodeFrame(const TrajectoryIndexEntry& entry) {
+	TrajectoryFrameHeader frameHeader;
+	if (!seekTrajectoryFile(file, entry.offset) || fread(&frameHeader, sizeof(frameHeader), 1, file) != 1) { return false; }
+	if (frameHeader.marker != TRAJECTORY_FRAME_MARKER || frameHeader.frame != entry.frame || frameHeader.keyframe != entry.keyframe) { return false; }
+	if (frameHeader.keyframe ? frameHeader.payloadSize != frameHeader.particleCount * 5 * sizeof(float) : frameHeader.particleCount != state.count || !stateValid || state.frame + 1 != frameHeader.frame) { return false; }
+	try { payload.resize((size_t)frameHeader.payloadSize); }
+	catch (...) { return false; }
+	if (!payload.empty() && fread(payload.data(), 1, payload.size(), file) != payload.size()) { return false; }
+
+	size_t count = (size_t)frameHeader.particleCount;
+	stateValid = false;
+	if (frameHeader.keyframe) {
+		state.resize(count);
+		size_t arraySize = count * sizeof(float);
+		float* arrays[5] = { state.x.data(), state.y.data(), state.vx.data(), state.vy.data(), state.radius.data() };
+		for (size_t i = 0; i < 5; i++) { if (arraySize != 0) { memcpy(arrays[i], payload.data() + i * arraySize, arraySize); } }
+	}
+	else {
+		DeltaTokenReader tokens = { payload.data(), payload.data() + payload.size() };
+		float positionQuantum = header.positionQuantum;
+		float velocityQuantum = header.velocityQuantum;
+		for (size_t i = 0; i < count; i++) {
+			int64_t deltaX, deltaY, deltaVX, deltaVY;
+			if (!tokens.pop(deltaX) || !tokens.pop(deltaY) || !tokens.pop(deltaVX) || !tokens.pop(deltaVY)) { return false; }
+			state.x[i] = applyDelta(state.x[i] + state.vx[i], deltaX, positionQuantum);
+			state.y[i] = applyDelta(state.y[i] + state.vy[i], deltaY, positionQuantum);
+			state.vx[i] = applyDelta(state.vx[i], deltaVX, velocityQuantum);
+			state.vy[i] = applyDelta(state.vy[i], deltaVY, velocityQuantum);
+		}
+		if (tokens.zeroRun != 0 || tokens.input != tokens.end) { return false; }
+	}
+	state.frame = frameHeader.frame;
+	stateValid = true;
+	return true;
+}
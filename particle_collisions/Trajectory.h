@@ -0,0 +1,141 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Scene;
+
+// Trajectory files: the position, velocity and radius of every particle after every step, for analysis outside of the simulator.
+// Layout: a TrajectoryFileHeader, the frames one after the other (each a TrajectoryFrameHeader and its payload), then the frame index (a TrajectoryIndexEntry per frame) and a TrajectoryFooter that points to it.
+// Keyframes store the raw floats. Delta frames store, for every particle, how far its position and velocity ended up from the prediction "previous position + previous velocity" (particles move in straight lines between events, so that's usually spot on), quantized to
+// positionQuantum and velocityQuantum. The writer predicts from the decoded values of the previous frame instead of the real ones, so the error never adds up over the frames: every decoded value is within half a quantum of the real one (or one float rounding step, for coordinates so large that floats can't resolve a quantum anymore).
+// The quantized differences are written as varints, with runs of zeros collapsed into a single varint, so a particle that didn't collide costs a fraction of a byte per frame.
+
+#define TRAJECTORY_MAGIC "PCTRAJ1"
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_FRAME_MARKER 0x4D415246u					// "FRAM", lets a reader find the frames of a file that never got its index (because the writer crashed).
+#define TRAJECTORY_DEFAULT_KEYFRAME_INTERVAL 64				// Random access decodes at most this many frames.
+#define TRAJECTORY_DEFAULT_POSITION_QUANTUM (1.0f / 1024)
+#define TRAJECTORY_DEFAULT_VELOCITY_QUANTUM (1.0f / 4096)
+
+struct TrajectoryFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t keyframeInterval;
+	float positionQuantum;
+	float velocityQuantum;
+};
+
+struct TrajectoryFrameHeader
+{
+	uint32_t marker;
+	uint32_t keyframe;
+	uint64_t frame;
+	uint64_t particleCount;
+	uint64_t payloadSize;								// In bytes, without this header.
+};
+
+struct TrajectoryIndexEntry
+{
+	uint64_t frame;
+	uint64_t offset;									// Of the frame's TrajectoryFrameHeader, from the start of the file.
+	uint64_t keyframe;
+};
+
+struct TrajectoryFooter
+{
+	uint64_t indexOffset;
+	uint64_t frameCount;
+	char magic[8];
+};
+
+// What a frame holds, for both the writer's double buffer and the reader's decoded state.
+struct TrajectoryFrame
+{
+	uint64_t frame = 0;
+	size_t count = 0;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<float> radius;
+
+	void resize(size_t count);
+};
+
+// Writes a trajectory file in the background. Set Scene::trajectoryWriter to one and every step submits a frame.
+// submit only copies the particles into the frame buffer that the encoder isn't working on and hands the buffer over, the encoding and writing happen on a thread of its own. If the encoder falls a whole frame behind, submit waits for it instead of dropping frames.
+class TrajectoryWriter
+{
+public:
+	TrajectoryFrame frames[2];
+	bool frameBusy[2] = { false, false };				// Queued or being encoded.
+	TrajectoryFrame* pendingFrame = nullptr;
+	size_t nextFrame = 0;								// The buffer that the next submit fills.
+	uint64_t submittedFrames = 0;
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+
+	// Only touched by the encoder thread.
+	FILE* file = nullptr;
+	uint64_t fileOffset = 0;
+	TrajectoryFileHeader header;
+	TrajectoryFrame reference;							// The previous frame the way the reader is going to decode it, which the delta frames predict from.
+	uint64_t framesSinceKeyframe = 0;
+	std::vector<uint8_t> payload;
+	std::vector<TrajectoryIndexEntry> index;
+	bool failed = false;
+
+	TrajectoryWriter() = default;
+	TrajectoryWriter(const TrajectoryWriter&) = delete;
+	TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+	~TrajectoryWriter();
+
+	// Returns false (after logging why) if the file couldn't be created.
+	bool open(const char* path, uint32_t keyframeInterval = TRAJECTORY_DEFAULT_KEYFRAME_INTERVAL, float positionQuantum = TRAJECTORY_DEFAULT_POSITION_QUANTUM, float velocityQuantum = TRAJECTORY_DEFAULT_VELOCITY_QUANTUM);
+	void submit(const Scene& scene);
+	// Waits for every submitted frame, writes the index and closes the file. Returns false if anything went wrong along the way.
+	bool close();
+
+	void encoderLoop();
+	void encodeFrame(const TrajectoryFrame& frame);
+	bool encodeDelta(const TrajectoryFrame& frame);
+	void encodeKeyframe(const TrajectoryFrame& frame);
+	void writeBytes(const void* data, size_t size);
+};
+
+// Reads any frame of a trajectory file, decoding forward from the keyframe before it. Reading the frames in order only decodes each one once.
+class TrajectoryReader
+{
+public:
+	FILE* file = nullptr;
+	TrajectoryFileHeader header;
+	std::vector<TrajectoryIndexEntry> index;
+	TrajectoryFrame state;								// The last decoded frame.
+	bool stateValid = false;
+	std::vector<uint8_t> payload;
+
+	TrajectoryReader() = default;
+	TrajectoryReader(const TrajectoryReader&) = delete;
+	TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+	~TrajectoryReader();
+
+	// Returns false (after logging why) if the file isn't a trajectory. Files without an index get scanned for their frames instead.
+	bool open(const char* path);
+	void close();
+
+	uint64_t frameCount() const noexcept { return index.size(); }
+	// Decodes the given frame into state. Returns false (after logging why) if the frame doesn't exist or is damaged.
+	bool readFrame(uint64_t frame);
+
+	bool scanFrames(uint64_t fileSize);
+	bool decodeFrame(const TrajectoryIndexEntry& entry);
+};
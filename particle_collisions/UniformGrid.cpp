@@ -0,0 +1,136 @@
+#include "UniformGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Upper bound for the amount of cells per particle. If the requested cell size would create more cells than this, the cells are made bigger, which is always safe because bigger cells only ever produce more candidates, never less.
+#define GRID_MAX_CELLS_PER_PARTICLE 4
+
+void UniformGrid::rebuild(const ParticleStore& particles, size_t particleCount, uint32_t width, uint32_t height, float cellSize) {
+	this->width = width;
+	this->height = height;
+	requestedCellSize = cellSize;
+
+	if (cellSize < 1) { cellSize = 1; }
+	float maxCellCount = (float)(particleCount * GRID_MAX_CELLS_PER_PARTICLE + 1);
+	float minCellSize = sqrt((float)width * (float)height / maxCellCount);
+	if (cellSize < minCellSize) { cellSize = minCellSize; }
+	this->cellSize = cellSize;
+
+	columns = (size_t)ceil(width / cellSize);
+	rows = (size_t)ceil(height / cellSize);
+	if (columns == 0) { columns = 1; }
+	if (rows == 0) { rows = 1; }
+
+	for (size_t i = 0; i < cells.size(); i++) { cells[i].clear(); }					// Clearing instead of reallocating lets the cells keep their capacity across rebuilds.
+	cells.resize(columns * rows);
+
+	rebuildParticleCount = particleCount;
+	particleCells.resize(particleCount);
+	for (size_t i = 0; i < particleCount; i++) {
+		size_t cell = cellIndexOf(particles.position(i));
+		particleCells[i] = cell;
+		cells[cell].push_back(i);
+	}
+}
+
+// NOTE: Particles that are out of bounds (or have NaN positions because something went very wrong) get clamped into the border cells. Clamping never increases the distance between two cells, so no pairs are lost because of it.
+size_t UniformGrid::columnOf(float x) const noexcept {
+	if (!(x >= 0)) { return 0; }
+	size_t column = (size_t)(x / cellSize);
+	return column < columns ? column : columns - 1;
+}
+
+size_t UniformGrid::rowOf(float y) const noexcept {
+	if (!(y >= 0)) { return 0; }
+	size_t row = (size_t)(y / cellSize);
+	return row < rows ? row : rows - 1;
+}
+
+size_t UniformGrid::cellIndexOf(const Vector2f& pos) const noexcept { return rowOf(pos.y) * columns + columnOf(pos.x); }
+
+static void eraseFromCell(std::vector<size_t>& cellContents, size_t particleIndex) noexcept {
+	for (size_t i = 0; i < cellContents.size(); i++) {
+		if (cellContents[i] == particleIndex) { cellContents[i] = cellContents.back(); cellContents.pop_back(); return; }		// Order inside of a cell doesn't matter because the candidates get sorted anyway.
+	}
+}
+
+void UniformGrid::update(size_t particleIndex, const Vector2f& pos) {
+	size_t newCell = cellIndexOf(pos);
+	size_t oldCell = particleCells[particleIndex];
+	if (newCell == oldCell) { return; }
+
+	eraseFromCell(cells[oldCell], particleIndex);
+	cells[newCell].push_back(particleIndex);
+	particleCells[particleIndex] = newCell;
+}
+
+void UniformGrid::insert(size_t particleIndex, const Vector2f& pos) {
+	size_t cell = cellIndexOf(pos);
+	particleCells.push_back(cell);
+	cells[cell].push_back(particleIndex);
+}
+
+void UniformGrid::remove(size_t particleIndex) {
+	size_t lastIndex = particleCells.size() - 1;
+	eraseFromCell(cells[particleCells[particleIndex]], particleIndex);
+	if (lastIndex != particleIndex) {
+		std::vector<size_t>& lastCellContents = cells[particleCells[lastIndex]];
+		for (size_t i = 0; i < lastCellContents.size(); i++) { if (lastCellContents[i] == lastIndex) { lastCellContents[i] = particleIndex; break; } }
+		particleCells[particleIndex] = particleCells[lastIndex];
+	}
+	particleCells.pop_back();
+}
+
+bool UniformGrid::isBorderCell(size_t cell) const noexcept {
+	size_t column = cell % columns;
+	size_t row = cell / columns;
+	// The last row and column can be cut off by the scene bounds, which is why the cell before them also counts as a border cell if the cut-off cell is thinner than a whole cell.
+	if (column == 0 || (column + 2) * cellSize > width) { return true; }
+	if (row == 0 || (row + 2) * cellSize > height) { return true; }
+	return false;
+}
+
+void UniformGrid::gatherCandidates(size_t particleIndex, std::vector<size_t>& candidates) const {
+	candidates.clear();
+	size_t cell = particleCells[particleIndex];
+	size_t column = cell % columns;
+	size_t row = cell / columns;
+
+	size_t firstColumn = column == 0 ? 0 : column - 1;
+	size_t lastColumn = column + 1 < columns ? column + 1 : column;
+	size_t firstRow = row == 0 ? 0 : row - 1;
+	size_t lastRow = row + 1 < rows ? row + 1 : row;
+
+	for (size_t y = firstRow; y <= lastRow; y++) {
+		for (size_t x = firstColumn; x <= lastColumn; x++) {
+			const std::vector<size_t>& cellContents = cells[y * columns + x];
+			for (size_t i = 0; i < cellContents.size(); i++) {
+				if (cellContents[i] > particleIndex) { candidates.push_back(cellContents[i]); }
+			}
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+}
+
+void UniformGrid::gatherNeighbors(size_t particleIndex, std::vector<size_t>& neighbors) const {
+	neighbors.clear();
+	size_t cell = particleCells[particleIndex];
+	size_t column = cell % columns;
+	size_t row = cell / columns;
+
+	size_t firstColumn = column == 0 ? 0 : column - 1;
+	size_t lastColumn = column + 1 < columns ? column + 1 : column;
+	size_t firstRow = row == 0 ? 0 : row - 1;
+	size_t lastRow = row + 1 < rows ? row + 1 : row;
+
+	for (size_t y = firstRow; y <= lastRow; y++) {
+		for (size_t x = firstColumn; x <= lastColumn; x++) {
+			const std::vector<size_t>& cellContents = cells[y * columns + x];
+			for (size_t i = 0; i < cellContents.size(); i++) {
+				if (cellContents[i] != particleIndex) { neighbors.push_back(cellContents[i]); }
+			}
+		}
+	}
+	std::sort(neighbors.begin(), neighbors.end());
+}
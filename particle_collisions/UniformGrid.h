@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include "Vector2f.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Uniform cell grid that the Scene uses as a broad phase for the collision search.
+// Every particle is sorted into the cell that contains its center. As long as the cell size is at least as big as the largest distance two particles can cover
+// while still touching each other at some point in the current sub-step (both radii plus both swept distances), every pair that can possibly collide ends up in neighboring cells.
+class UniformGrid
+{
+public:
+	float cellSize = 0;
+	float requestedCellSize = 0;								// The cell size that was asked for in the last rebuild. The actual cellSize can be bigger than this if the cell count had to be limited.
+	size_t columns = 0;
+	size_t rows = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	std::vector<std::vector<size_t>> cells;
+	std::vector<size_t> particleCells;							// The cell each particle is currently sorted into, so that updating a particle only costs something when it actually changes cells.
+	size_t rebuildParticleCount = 0;							// Particles at the last rebuild, which the cell count limit was based on.
+
+	void rebuild(const ParticleStore& particles, size_t particleCount, uint32_t width, uint32_t height, float cellSize);
+
+	size_t cellIndexOf(const Vector2f& pos) const noexcept;
+	void update(size_t particleIndex, const Vector2f& pos);
+
+	// Keep the grid in step with Scene::insert and Scene::remove, so that a few particles coming and going doesn't cost a rebuild. Only for grids that hold every particle of the scene.
+	void insert(size_t particleIndex, const Vector2f& pos);		// particleIndex has to be the new last particle.
+	void remove(size_t particleIndex);							// The last particle moves into particleIndex, same as in the scene.
+
+	// Returns true if a particle in the given cell could possibly reach one of the walls in the current sub-step. Particles in all other cells can skip the wall check.
+	bool isBorderCell(size_t cell) const noexcept;
+
+	// Fills candidates with the indices of all particles above particleIndex that are sorted into the 3x3 block of cells around particleIndex's cell.
+	// The result is sorted in ascending order, so that the collision search visits pairs in exactly the same order as the brute-force loop does. That keeps ties between equal t-values resolving the same way.
+	void gatherCandidates(size_t particleIndex, std::vector<size_t>& candidates) const;
+
+	// Same as gatherCandidates, except that particles below particleIndex are included as well. Also sorted, so that resolveIntersections pushes a cluster apart in the same order no matter how the cells are laid out, which differs between broad phases and between thread counts.
+	void gatherNeighbors(size_t particleIndex, std::vector<size_t>& neighbors) const;
+
+	size_t columnOf(float x) const noexcept;
+	size_t rowOf(float y) const noexcept;
+};
@@ -0,0 +1,100 @@
+#include "WorkerPool.h"
+
+#include "debugOutput.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool pinCurrentThreadToCore(unsigned int core) {
+	unsigned int coreCount = std::thread::hardware_concurrency();
+	if (coreCount != 0) { core %= coreCount; }
+#ifdef _WIN32
+	if (core >= sizeof(DWORD_PTR) * 8) { return false; }						// Cores past the first processor group can't be reached through a simple affinity mask.
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#else
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(core, &cores);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) == 0;
+#endif
+}
+
+WorkerPool::~WorkerPool() { stop(); }
+
+void WorkerPool::start(unsigned int threadCount, bool pinToCores) {
+	stop();
+	unsigned long long startGeneration = generation;
+	for (unsigned int i = 1; i < threadCount; i++) {
+		threads.push_back(std::thread([this, i, pinToCores, startGeneration]() {
+			if (pinToCores && !pinCurrentThreadToCore(i)) { debuglogger::out << debuglogger::error << "failed to pin worker thread to core" << debuglogger::endl; }
+			workerLoop(i, startGeneration);
+		}));
+	}
+}
+
+void WorkerPool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+	for (size_t i = 0; i < threads.size(); i++) { threads[i].join(); }
+	threads.clear();
+	stopping = false;
+}
+
+unsigned int WorkerPool::threadCount() const noexcept { return (unsigned int)threads.size() + 1; }
+
+void WorkerPool::run(const std::function<void(unsigned int)>& task) {
+	if (threads.empty()) { task(0); return; }
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentTask = &task;
+		unfinishedWorkers = (unsigned int)threads.size();
+		generation++;
+	}
+	taskAvailable.notify_all();
+
+	task(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	taskFinished.wait(lock, [this]() { return unfinishedWorkers == 0; });
+	currentTask = nullptr;
+}
+
+void WorkerPool::runRanges(size_t count, const std::function<void(size_t, size_t)>& task) {
+	size_t workerCount = threadCount();
+	run([count, workerCount, &task](unsigned int workerIndex) {
+		size_t begin = count * workerIndex / workerCount;
+		size_t end = count * (workerIndex + 1) / workerCount;
+		if (begin != end) { task(begin, end); }
+	});
+}
+
+void WorkerPool::workerLoop(unsigned int workerIndex, unsigned long long lastGeneration) {
+	while (true) {
+		const std::function<void(unsigned int)>* task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this, lastGeneration]() { return stopping || generation != lastGeneration; });
+			if (stopping) { return; }
+			lastGeneration = generation;
+			task = currentTask;
+		}
+
+		(*task)(workerIndex);
+
+		bool lastOneDone;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			lastOneDone = --unfinishedWorkers == 0;
+		}
+		if (lastOneDone) { taskFinished.notify_one(); }
+	}
+}
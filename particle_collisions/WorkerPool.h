@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Set of persistent worker threads that can all be handed the same task at once.
+// The threads get created once and then sleep between tasks, which is way cheaper than creating new threads for every sub-step (of which there can be thousands per step).
+class WorkerPool
+{
+public:
+	WorkerPool() = default;
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool();
+
+	// Starts the pool with the given amount of threads, counting the thread that calls run, which always takes part as worker 0. A thread count of 1 (or 0) doesn't create any threads.
+	// If pinToCores is true, worker n gets pinned to logical core n (modulo the core count). The calling thread is left alone.
+	void start(unsigned int threadCount, bool pinToCores);
+	void stop();
+
+	unsigned int threadCount() const noexcept;
+
+	// Runs task on every worker, passing each one its worker index, and returns once all of them are done.
+	void run(const std::function<void(unsigned int)>& task);
+	// Splits [0, count) into one contiguous range per worker and runs task(begin, end) on every range. Worker n always gets the nth range, so memory that gets touched for the first time in here ends up on the NUMA node of the worker that's going to use it in later calls with the same count.
+	void runRanges(size_t count, const std::function<void(size_t, size_t)>& task);
+
+	std::vector<std::thread> threads;
+	const std::function<void(unsigned int)>* currentTask = nullptr;
+
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	std::condition_variable taskFinished;
+	unsigned long long generation = 0;						// Incremented for every task, so that sleeping workers can tell a new task apart from a spurious wake-up.
+	unsigned int unfinishedWorkers = 0;
+	bool stopping = false;
+
+	void workerLoop(unsigned int workerIndex, unsigned long long lastGeneration);
+};
+
+// Pins the calling thread to the given logical core. Returns false if the OS refused.
+bool pinCurrentThreadToCore(unsigned int core);
@@ -1,63 +1,297 @@
-#define _CRT_SECURE_NO_WARNINGS																						// Disables warnings for functions that are deemed insecure by the standard. It's only for _itoa, which I am using safely, so I can turn of the warnings.
+#define _CRT_SECURE_NO_WARNINGS																						// For fopen, which is used safely here.
 
 #include "debugOutput.h"
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#endif
 
-#include <cstdint>
-#include <cstdlib>																									// This is included because we need access to _itoa.
-#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-DebugOutput& DebugOutput::operator<<(const char* input) {
-#ifndef _DEBUG
-	return *this;
+// Single-producer single-consumer byte ring. The logging thread is the only one that writes, the background thread (or whoever is flushing, under outputMutex) is the only one that reads.
+// written and read only ever go up, their difference is the amount of unread bytes.
+struct LogRing
+{
+	std::vector<uint8_t> bytes;
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> read;
+	std::atomic<uint64_t> dropped;					// Records that didn't fit into the ring.
+	std::atomic<uint64_t> suppressed;				// Records that went over the rate limit.
+	uint64_t reportedDropped = 0;
+	uint64_t reportedSuppressed = 0;
+	uint64_t lastReport = 0;							// When the dropped and suppressed records were last reported, so that a thread that keeps going over the limit doesn't spam the output with reports instead.
+	uint32_t threadIndex;
+};
+
+// Nanoseconds between two reports of dropped records for the same thread.
+#define LOG_DROP_REPORT_INTERVAL 1000000000ull
+
+// Record layout: uint32_t size (of the whole record), uint8_t level, uint64_t timestamp, then the items, each of which is a tag followed by its data.
+#define LOG_RECORD_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint64_t))
+#define LOG_ITEM_STRING 's'							// uint16_t length, then the characters without a terminator.
+#define LOG_ITEM_CHAR 'c'
+#define LOG_ITEM_INT32 'i'
+#define LOG_ITEM_UINT32 'u'
+
+// The record the calling thread is in the middle of, plus its rate limit state.
+struct LogThreadState
+{
+	LogRing* ring = nullptr;
+	uint8_t record[LOG_MAX_RECORD_SIZE];
+	size_t size = 0;
+	bool open = false;
+	bool accepted = false;
+	double tokens = LOG_RATE_BURST;
+	uint64_t lastRefill = 0;
+};
+
+thread_local LogThreadState logThreadState;
+
+#ifdef _DEBUG
+std::atomic<uint8_t> minimumLevel((uint8_t)LogLevel::LOG_DEBUG);
+#else
+std::atomic<uint8_t> minimumLevel((uint8_t)LogLevel::LOG_INFO);
 #endif
-	OutputDebugStringA(input);
-	return *this;
+
+std::chrono::steady_clock::time_point logOrigin = std::chrono::steady_clock::now();
+
+static uint64_t logTimestamp() noexcept { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - logOrigin).count(); }
+
+// Owns the rings and the background thread. Its destructor runs at exit and writes whatever is left.
+class LogBackend
+{
+public:
+	std::mutex ringsMutex;
+	std::vector<std::unique_ptr<LogRing>> rings;			// Never shrinks, threads that have exited can still have records waiting in theirs.
+	std::mutex outputMutex;								// Held by whoever is reading the rings and writing the output.
+	FILE* outputFile = nullptr;
+	std::string line;
+
+	std::once_flag started;
+	std::thread thread;
+	std::atomic<bool> stopping;
+
+	LogBackend() : stopping(false) { }
+	~LogBackend() {
+		stopping.store(true, std::memory_order_relaxed);
+		if (thread.joinable()) { thread.join(); }
+		drain(true);
+		if (outputFile != nullptr) { fclose(outputFile); }
+	}
+
+	LogRing* registerRing();
+	void start();
+	void run();
+	bool drain(bool final);
+	void formatRecord(const LogRing& ring, const uint8_t* record, size_t size);
+	void write(const char* text);
+};
+
+LogBackend logBackend;
+
+LogRing* LogBackend::registerRing() {
+	std::unique_ptr<LogRing> ring(new LogRing());
+	ring->bytes.resize(LOG_RING_CAPACITY);
+	ring->written.store(0, std::memory_order_relaxed);
+	ring->read.store(0, std::memory_order_relaxed);
+	ring->dropped.store(0, std::memory_order_relaxed);
+	ring->suppressed.store(0, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	ring->threadIndex = (uint32_t)rings.size();
+	rings.push_back(std::move(ring));
+	return rings.back().get();
 }
 
-DebugOutput& DebugOutput::operator<<(char* input) {
-#ifndef _DEBUG
-	return *this;
-#endif
-	OutputDebugStringA(input);
-	return *this;
+void LogBackend::start() { std::call_once(started, [this]() { thread = std::thread(&LogBackend::run, this); }); }
+
+// Polls instead of waiting on a condition variable, so that logging never has to take a lock to wake it up.
+void LogBackend::run() {
+	while (!stopping.load(std::memory_order_relaxed)) {
+		if (!drain(false)) { std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+	}
 }
 
-DebugOutput& DebugOutput::operator<<(char input) {
-#ifndef _DEBUG
-	return *this;
-#endif
-	char buffer[] = { input, '\0' };																				// List initialization of basic types is apparently just as efficient as doing it per hand, contrary to custom types and such. Use equal sign because that makes it compatible with C.
-	OutputDebugStringA(buffer);
-	return *this;
+static void copyOutOfRing(const LogRing& ring, uint64_t position, uint8_t* destination, size_t size) noexcept {
+	size_t offset = (size_t)(position % ring.bytes.size());
+	size_t first = ring.bytes.size() - offset < size ? ring.bytes.size() - offset : size;
+	memcpy(destination, ring.bytes.data() + offset, first);
+	memcpy(destination + first, ring.bytes.data(), size - first);
 }
 
-DebugOutput& DebugOutput::operator<<(std::string& input) {
-#ifndef _DEBUG
-	return *this;
-#endif
-	OutputDebugStringA(input.c_str());
-	return *this;
+// Returns false if there was nothing to write. Drops only get reported every LOG_DROP_REPORT_INTERVAL, unless final is true.
+bool LogBackend::drain(bool final) {
+	std::lock_guard<std::mutex> outputLock(outputMutex);
+	size_t ringCount;
+	{ std::lock_guard<std::mutex> lock(ringsMutex); ringCount = rings.size(); }
+
+	bool wroteSomething = false;
+	uint8_t record[LOG_MAX_RECORD_SIZE];
+	for (size_t i = 0; i < ringCount; i++) {
+		LogRing* ring;
+		{ std::lock_guard<std::mutex> lock(ringsMutex); ring = rings[i].get(); }
+		uint64_t written = ring->written.load(std::memory_order_acquire);
+		uint64_t read = ring->read.load(std::memory_order_relaxed);
+		while (read != written) {
+			uint32_t size;
+			copyOutOfRing(*ring, read, (uint8_t*)&size, sizeof(size));
+			copyOutOfRing(*ring, read, record, size);
+			formatRecord(*ring, record, size);
+			read += size;
+			wroteSomething = true;
+		}
+		ring->read.store(read, std::memory_order_release);
+
+		uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+		uint64_t suppressed = ring->suppressed.load(std::memory_order_relaxed);
+		if (dropped == ring->reportedDropped && suppressed == ring->reportedSuppressed) { continue; }
+		uint64_t now = logTimestamp();
+		if (!final && now - ring->lastReport < LOG_DROP_REPORT_INTERVAL) { continue; }
+		char note[160];
+		snprintf(note, sizeof(note), "[%.6f thread %u] WARNING: %llu log records didn't fit into the ring and %llu went over the rate limit\n", now / 1e9, ring->threadIndex, (unsigned long long)(dropped - ring->reportedDropped), (unsigned long long)(suppressed - ring->reportedSuppressed));
+		write(note);
+		ring->lastReport = now;
+		ring->reportedDropped = dropped;
+		ring->reportedSuppressed = suppressed;
+		wroteSomething = true;
+	}
+	if (wroteSomething && outputFile != nullptr) { fflush(outputFile); }
+	return wroteSomething;
 }
 
-DebugOutput& DebugOutput::operator<<(int32_t input) {
-#ifndef _DEBUG
-	return *this;
-#endif
-	char buffer[12];
-	_itoa(input, buffer, 10);
-	OutputDebugStringA(buffer);
-	return *this;
+void LogBackend::formatRecord(const LogRing& ring, const uint8_t* record, size_t size) {
+	static const char* levelNames[] = { "DEBUG: ", "", "WARNING: ", "ERROR: " };
+	uint8_t level = record[sizeof(uint32_t)];
+	uint64_t timestamp;
+	memcpy(&timestamp, record + sizeof(uint32_t) + sizeof(uint8_t), sizeof(timestamp));
+
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "[%.6f thread %u] ", timestamp / 1e9, ring.threadIndex);
+	line.assign(buffer);
+	line.append(levelNames[level]);
+	for (size_t position = LOG_RECORD_HEADER_SIZE; position < size;) {
+		uint8_t tag = record[position++];
+		switch (tag) {
+		case LOG_ITEM_STRING: {
+			uint16_t length;
+			memcpy(&length, record + position, sizeof(length));
+			line.append((const char*)record + position + sizeof(length), length);
+			position += sizeof(length) + length;
+			break;
+		}
+		case LOG_ITEM_CHAR: line.push_back((char)record[position++]); break;
+		case LOG_ITEM_INT32: { int32_t value; memcpy(&value, record + position, sizeof(value)); snprintf(buffer, sizeof(buffer), "%d", (int)value); line.append(buffer); position += sizeof(value); break; }
+		case LOG_ITEM_UINT32: { uint32_t value; memcpy(&value, record + position, sizeof(value)); snprintf(buffer, sizeof(buffer), "%u", (unsigned int)value); line.append(buffer); position += sizeof(value); break; }
+		default: position = size; break;
+		}
+	}
+	line.push_back('\n');
+	write(line.c_str());
 }
 
-DebugOutput& DebugOutput::operator<<(uint32_t input) {
-#ifndef _DEBUG
-	return *this;
+void LogBackend::write(const char* text) {
+	if (outputFile != nullptr) { fputs(text, outputFile); return; }
+#ifdef _WIN32
+	OutputDebugStringA(text);
+#else
+	fputs(text, stderr);
 #endif
-	char buffer[11];
-	_itoa(input, buffer, 10);
-	OutputDebugStringA(buffer);
+}
+
+static void openRecord(LogThreadState& state, LogLevel level) noexcept {
+	state.open = true;
+	state.accepted = (uint8_t)level >= minimumLevel.load(std::memory_order_relaxed);
+	state.size = LOG_RECORD_HEADER_SIZE;
+	state.record[sizeof(uint32_t)] = (uint8_t)level;
+}
+
+// Items that don't fit anymore get left out, along with everything after them.
+static inline void appendItem(uint8_t tag, const void* data, size_t size) noexcept {
+	LogThreadState& state = logThreadState;
+	if (!state.open) { openRecord(state, LogLevel::LOG_INFO); }
+	if (!state.accepted || state.size + 1 + size > LOG_MAX_RECORD_SIZE) { return; }
+	state.record[state.size] = tag;
+	memcpy(state.record + state.size + 1, data, size);
+	state.size += 1 + size;
+}
+
+static void appendString(const char* input, size_t length) noexcept {
+	LogThreadState& state = logThreadState;
+	if (!state.open) { openRecord(state, LogLevel::LOG_INFO); }
+	if (!state.accepted) { return; }
+	size_t room = LOG_MAX_RECORD_SIZE - state.size;
+	if (room <= 1 + sizeof(uint16_t)) { return; }
+	if (length > room - 1 - sizeof(uint16_t)) { length = room - 1 - sizeof(uint16_t); }
+	uint16_t storedLength = (uint16_t)length;
+	state.record[state.size] = LOG_ITEM_STRING;
+	memcpy(state.record + state.size + 1, &storedLength, sizeof(storedLength));
+	memcpy(state.record + state.size + 1 + sizeof(storedLength), input, length);
+	state.size += 1 + sizeof(storedLength) + length;
+}
+
+static void commitRecord() noexcept {
+	LogThreadState& state = logThreadState;
+	if (!state.open) { openRecord(state, LogLevel::LOG_INFO); }
+	state.open = false;
+	if (!state.accepted) { return; }
+
+	if (state.ring == nullptr) {
+		try { state.ring = logBackend.registerRing(); logBackend.start(); }
+		catch (...) { return; }												// Out of memory or out of threads, this thread just can't log.
+	}
+	LogRing& ring = *state.ring;
+
+	uint64_t now = logTimestamp();
+	state.tokens += (now - state.lastRefill) * (LOG_RATE_LIMIT_PER_SECOND / 1e9);
+	if (state.tokens > LOG_RATE_BURST) { state.tokens = LOG_RATE_BURST; }
+	state.lastRefill = now;
+	if (state.tokens < 1) { ring.suppressed.store(ring.suppressed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); return; }
+	state.tokens--;
+
+	uint32_t size = (uint32_t)state.size;
+	memcpy(state.record, &size, sizeof(size));
+	memcpy(state.record + sizeof(uint32_t) + sizeof(uint8_t), &now, sizeof(now));
+
+	uint64_t written = ring.written.load(std::memory_order_relaxed);
+	if (ring.bytes.size() - (written - ring.read.load(std::memory_order_acquire)) < size) { ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); return; }
+	size_t offset = (size_t)(written % ring.bytes.size());
+	size_t first = ring.bytes.size() - offset < size ? ring.bytes.size() - offset : size;
+	memcpy(ring.bytes.data() + offset, state.record, first);
+	memcpy(ring.bytes.data(), state.record + first, size - first);
+	ring.written.store(written + size, std::memory_order_release);
+}
+
+DebugOutput& DebugOutput::operator<<(const char* input) { appendString(input, strlen(input)); return *this; }
+DebugOutput& DebugOutput::operator<<(char* input) { appendString(input, strlen(input)); return *this; }
+DebugOutput& DebugOutput::operator<<(char input) { appendItem(LOG_ITEM_CHAR, &input, sizeof(input)); return *this; }
+DebugOutput& DebugOutput::operator<<(std::string& input) { appendString(input.c_str(), input.size()); return *this; }
+DebugOutput& DebugOutput::operator<<(int32_t input) { appendItem(LOG_ITEM_INT32, &input, sizeof(input)); return *this; }
+DebugOutput& DebugOutput::operator<<(uint32_t input) { appendItem(LOG_ITEM_UINT32, &input, sizeof(input)); return *this; }
+
+DebugOutput& DebugOutput::operator<<(LogLevel level) {
+	LogThreadState& state = logThreadState;
+	if (!state.open || state.size == LOG_RECORD_HEADER_SIZE) { openRecord(state, level); }
 	return *this;
-}
\ No newline at end of file
+}
+
+DebugOutput& DebugOutput::operator<<(LogEnd) { commitRecord(); return *this; }
+
+void debuglogger::setLevel(LogLevel level) noexcept { minimumLevel.store((uint8_t)level, std::memory_order_relaxed); }
+
+bool debuglogger::setOutputFile(const char* path) {
+	FILE* file = fopen(path, "ab");
+	if (file == nullptr) { return false; }
+	std::lock_guard<std::mutex> lock(logBackend.outputMutex);
+	if (logBackend.outputFile != nullptr) { fclose(logBackend.outputFile); }
+	logBackend.outputFile = file;
+	return true;
+}
+
+void debuglogger::flush() { logBackend.drain(true); }
@@ -1,8 +1,30 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
+// Logging without blocking the thread that logs. Every "debuglogger::out << ... << debuglogger::endl" chain gets packed into a binary record (strings get copied, numbers stay numbers) and put into a ring buffer that belongs to the logging thread.
+// A background thread takes the records out of every thread's ring, formats them and writes them to the output, which is the debugger output window on Windows and stderr everywhere else, unless setOutputFile is called.
+// If a ring is full, or a thread logs faster than LOG_RATE_LIMIT_PER_SECOND, records get dropped instead of waiting, and the background thread reports how many.
+
+// Bytes per thread for records that haven't been written yet.
+#define LOG_RING_CAPACITY (1 << 16)
+// Bytes a single record can hold. Everything after that gets cut off.
+#define LOG_MAX_RECORD_SIZE 512
+// Records a thread can log per second before the rest of them get dropped, with LOG_RATE_BURST of them allowed at once.
+#define LOG_RATE_LIMIT_PER_SECOND 1000
+#define LOG_RATE_BURST 100
+
+enum class LogLevel : uint8_t {
+	LOG_DEBUG,							// Prefixed, because Windows.h defines ERROR (and some builds define DEBUG) as macros.
+	LOG_INFO,
+	LOG_WARNING,
+	LOG_ERROR
+};
+
+struct LogEnd { };
+
 class DebugOutput {
 public:
 	DebugOutput& operator<<(const char* input);
@@ -13,11 +35,26 @@ public:
 
 	DebugOutput& operator<<(int32_t input);
 	DebugOutput& operator<<(uint32_t input);
+
+	DebugOutput& operator<<(LogLevel level);				// Only has an effect at the start of a record, records without one are INFO.
+	DebugOutput& operator<<(LogEnd);						// Finishes the record and hands it to the background thread.
 };
 
 namespace debuglogger {
 	static DebugOutput out;
 
-	static const char* endl = "\n";
-	static const char* error = "ERROR: ";
+	static const LogEnd endl = { };
+	static const LogLevel debug = LogLevel::LOG_DEBUG;
+	static const LogLevel info = LogLevel::LOG_INFO;
+	static const LogLevel warning = LogLevel::LOG_WARNING;
+	static const LogLevel error = LogLevel::LOG_ERROR;
+
+	// Records below the given level get thrown away before anything gets copied. The default is DEBUG in debug builds and INFO otherwise.
+	void setLevel(LogLevel level) noexcept;
+
+	// Writes to the given file (appending) instead of the default output. Returns false if the file couldn't be opened, in which case the output stays the same.
+	bool setOutputFile(const char* path);
+
+	// Blocks until everything that the calling thread has logged so far has been written. Needed before _exit and similar, which don't give the background thread a chance to finish.
+	void flush();
 }
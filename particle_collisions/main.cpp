@@ -13,6 +13,19 @@
 
 #include "Renderer.h"
 
+#include "Trace.h"
+
+#include "Checkpoint.h"
+#include "Trajectory.h"
+#include "CollisionLog.h"
+#include "InputJournal.h"
+#include "SceneGenerator.h"
+#include "SceneSnapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 // NOTE: Remember the -ffast-math flag for future use. It makes your math faster by having it lose precision in some places, which isn't a problem for a lot of use cases. We probably don't want it here because we want accurate physics simulation, but just keep it in mind for future use.
 // NOTE: -ffast-math is the gcc flag I believe. It's probably called something else for MSVC. You can almost definitely check some sort of box in the configuration menu for this project or something.
 // TODO: Also, research all of the optimizations that fast math does and understand them because those might be interesting.
@@ -89,79 +102,174 @@ void setWindow(int newPosX, int newPosY, unsigned int newWidth, unsigned int new
 	setWindowSize(newWidth, newHeight);
 }
 
-int mouseX;
-int mouseY;
-bool addParticle = false;
+// Pipelined mode steps the scene on its own thread and draws the latest snapshot of it (see SceneSnapshot.h) on this one, so a slow step doesn't hold up drawing and a slow draw doesn't hold up stepping.
+// Without it, every frame draws the scene and then steps it, one after the other.
+#define PIPELINED_RENDERING true
+// Workers that draw the snapshots in pipelined mode. The scene keeps its own workers for stepping, so these come on top.
+#define RENDER_THREAD_COUNT 2
+// How long the drawing thread sleeps when no new snapshot came in since its last frame.
+#define RENDER_IDLE_SLEEP_MICROSECONDS 500
+// Cap on the simulation thread in pipelined mode, which would otherwise step a small scene far faster than anyone can watch it, since it no longer waits for drawing. 0 doesn't cap it.
+#define MAX_SIMULATION_STEPS_PER_SECOND 1000
+
+FrameInputChannel input;
+// Set by the window's thread, taken with exchange by whichever thread acts on them.
+std::atomic<bool> toggleTrace(false);
+std::atomic<bool> saveScene(false);
+std::atomic<bool> loadScene(false);
+std::atomic<bool> toggleTrajectory(false);
+std::atomic<bool> toggleCollisionLog(false);
 LRESULT CALLBACK windowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 	switch (uMsg) {
 	case WM_MOUSEMOVE:
-		mouseX = GET_X_LPARAM(lParam);
-		mouseY = GET_Y_LPARAM(lParam);
+		input.moveMouse(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
 		return 0;
 	case WM_LBUTTONDOWN:
-		addParticle = true;
+		input.addParticle();
 		return 0;
+	case WM_KEYDOWN:
+		if (lParam & (1 << 30)) { break; }			// Bit 30 is set for auto-repeats of a held down key.
+		if (wParam == 'T') { toggleTrace.store(true); return 0; }
+		if (wParam == VK_F5) { saveScene.store(true); return 0; }
+		if (wParam == VK_F9) { loadScene.store(true); return 0; }
+		if (wParam == 'R') { toggleTrajectory.store(true); return 0; }
+		if (wParam == 'C') { toggleCollisionLog.store(true); return 0; }
+		break;
 	}
 	if (listenForExitAttempts(uMsg, wParam, lParam)) { return 0; }
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
 
-HDC g;
-
-void graphicsLoop() {			// TODO: Just expose this g stuff in the library so we don't have to do this boilerplate every time. Good idea or no?
+void graphicsLoop() {
 
 	HDC finalG = GetDC(hWnd);
-	g = CreateCompatibleDC(finalG);
-	HBITMAP bmp = CreateCompatibleBitmap(finalG, windowWidth, windowHeight);
-	SelectObject(g, bmp);
-
-	HPEN particlePen = CreatePen(PS_SOLID, 1, RGB(0, 255, 0));
-	HBRUSH particleBrush = CreateSolidBrush(RGB(0, 255, 0));
 
-	HPEN bgPen = CreatePen(PS_SOLID, 1, RGB(0, 0, 0));
-	HBRUSH bgBrush = CreateSolidBrush(RGB(0, 0, 0));
-
-	std::vector<Particle> particles;
-	for (int i = 0; i < 100; i++) {
-		particles.push_back(Particle(Vector2f((rand() % (windowWidth - 200)) + 100, (rand() % (windowHeight - 200)) + 100), Vector2f(0.1f, 0), rand() % 20 + 5, 1));
-	}
-	//particles.push_back(Particle(Vector2f(100, 100), Vector2f(0, 0), 20, 1));
-	//particles.push_back(Particle(Vector2f(200, 100), Vector2f(0, 0), 20, 1));
-	//particles.push_back(Particle(Vector2f(300, 100), Vector2f(0, 0), 20, 1));
+	unsigned int seed = 1;
+	PackedSceneSettings initialScene;				// Same amount and sizes of particles as the scene used to have, but without any of them starting out inside of each other.
+	initialScene.particleCount = 100;
+	initialScene.width = windowWidth;
+	initialScene.height = windowHeight;
+	initialScene.minRadius = 5;
+	initialScene.maxRadius = 24;
+	initialScene.temperature = 0.01f;					// Speeds of about 0.1, like the sideways drift that every particle used to start out with.
+	initialScene.seed = seed;
 	Scene scene;
-	scene.loadParticles(particles);
-	scene.loadSize(windowWidth, windowHeight);
-	scene.postLoadInit();
+	scene.setThreadCount(std::thread::hardware_concurrency(), false);
+	if (!generatePackedScene(scene, initialScene)) { return; }					// Only if the window is too small for 100 particles.
+	scene.broadPhase = BroadPhase::UNIFORM_GRID;
 
-	Renderer renderer(g);
+	Renderer renderer(finalG, windowWidth, windowHeight);			// Draws into its own framebuffer, which replaces the memory DC that the particles used to get drawn into with GDI.
+	CheckpointWriter checkpointWriter;
+	TrajectoryWriter trajectoryWriter;
+	CollisionLog collisionLog;
+	InputJournal journal;						// Records everything the window does to the scene to journal.bin, which particle_collisions_replay can play back to reproduce a run exactly.
+	journal.open("journal.bin", seed, scene);
 
-	mouseX = windowWidth / 2;
-	mouseY = windowHeight / 2;
+	input.moveMouse(windowWidth / 2, windowHeight / 2);
 
-	while (isAlive) {
-		SelectObject(g, bgPen);
-		SelectObject(g, bgBrush);
-		Rectangle(g, 0, 0, windowWidth, windowHeight);
-		SelectObject(g, particlePen);
-		SelectObject(g, particleBrush);
-		renderer.render(scene);
-		BitBlt(finalG, 0, 0, windowWidth, windowHeight, g, 0, 0, SRCCOPY);
+	// Everything a frame does to the scene besides drawing it. In pipelined mode, this runs on the simulation thread, which is also the only one that touches the scene.
+	auto stepFrame = [&]() {
 		scene.step();
-		for (int i = 0; i < scene.particleCount; i++) {
-			Vector2f diff = Vector2f(mouseX, mouseY) - scene.particles[i].pos;
-			float length = diff.getLength();
-			if (length < 0.001f) { continue; }
-			scene.particles[i].vel += diff / length * 0.01f;
-			scene.particles[i].vel *= 0.995f;
+		JournalFrameInput frameInput = input.take();
+		applyFrameInput(scene, frameInput);
+		journal.recordFrame(frameInput, scene);
+
+		if (saveScene.exchange(false)) {		// F5 saves the scene to scene.chkpt in the background, F9 loads it back.
+			checkpointWriter.start(scene, "scene.chkpt");
+		}
+		if (loadScene.exchange(false)) {
+			checkpointWriter.finish();
+			if (loadCheckpoint(scene, "scene.chkpt")) { journal.recordScene(scene); debuglogger::out << "loaded scene.chkpt" << debuglogger::endl; }
+		}
+
+		if (toggleTrajectory.exchange(false)) {					// R starts recording the trajectories of every particle to trajectory.bin, and pressing it again finishes the file.
+			if (scene.trajectoryWriter != nullptr) {
+				scene.trajectoryWriter = nullptr;
+				if (trajectoryWriter.close()) { debuglogger::out << "wrote trajectory.bin" << debuglogger::endl; }
+			}
+			else if (trajectoryWriter.open("trajectory.bin")) { scene.trajectoryWriter = &trajectoryWriter; }
+		}
+
+		if (toggleCollisionLog.exchange(false)) {				// C starts logging every collision to collisions.bin, and pressing it again finishes the file.
+			if (scene.collisionLog != nullptr) {
+				scene.collisionLog = nullptr;
+				if (collisionLog.close()) { debuglogger::out << "wrote collisions.bin" << debuglogger::endl; }
+			}
+			else if (collisionLog.open("collisions.bin")) { scene.collisionLog = &collisionLog; }
+		}
+	};
+
+	// T starts recording a trace, and pressing it again writes everything since then to trace.json, which can be opened in ui.perfetto.dev.
+	// Starting and stopping a trace is only safe while no other thread is recording (see startTrace), so the pipelined mode pauses the simulation thread around it.
+	auto toggleTracing = []() {
+		if (traceEnabled.load(std::memory_order_relaxed)) {
+			stopTrace();
+			if (writeChromeTrace("trace.json")) { debuglogger::out << "wrote trace.json" << debuglogger::endl; }
+		}
+		else { startTrace(); }
+	};
+
+	if (!PIPELINED_RENDERING) {
+		while (isAlive) {
+			TRACE_SCOPE("frame");
+			scene.syncParticles();
+			renderer.render(scene, scene.workers);
+			{
+				TRACE_SCOPE("present");
+				renderer.present();
+			}
+			stepFrame();
+			if (toggleTrace.exchange(false)) { toggleTracing(); }
+		}
+		return;
+	}
+
+	SnapshotTripleBuffer snapshots;
+	std::atomic<bool> simulating(true);
+	std::atomic<bool> pauseRequested(false);						// The drawing thread asks the simulation thread to wait between frames, which it confirms with paused.
+	std::atomic<bool> paused(false);
+	std::thread simulationThread([&]() {
+		std::chrono::steady_clock::time_point nextStep = std::chrono::steady_clock::now();
+		while (simulating.load(std::memory_order_relaxed)) {
+			if (pauseRequested.load(std::memory_order_acquire)) {
+				paused.store(true, std::memory_order_release);
+				while (pauseRequested.load(std::memory_order_acquire)) { std::this_thread::sleep_for(std::chrono::microseconds(RENDER_IDLE_SLEEP_MICROSECONDS)); }
+				paused.store(false, std::memory_order_relaxed);
+				nextStep = std::chrono::steady_clock::now();
+			}
+			{
+				TRACE_SCOPE("simulation frame");
+				scene.syncParticles();
+				snapshots.writeBuffer().take(scene);
+				snapshots.publish();
+				stepFrame();
+			}
+			if (MAX_SIMULATION_STEPS_PER_SECOND != 0) {
+				nextStep += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / MAX_SIMULATION_STEPS_PER_SECOND));
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				if (nextStep > now) { std::this_thread::sleep_until(nextStep); }
+				else { nextStep = now; }						// Steps that take longer than the cap allows don't get made up for with a burst of steps later.
+			}
 		}
+	});
 
-		if (addParticle) {
-			scene.particles.push_back(Particle(Vector2f(mouseX, mouseY), Vector2f(0, 0), 20, 1));
-			scene.particleCount++;
-			scene.lastParticle++;
-			scene.particles[scene.lastParticle].lastInteractionWasIntersection = true;
-			scene.postLoadInit();
-			addParticle = false;
+	WorkerPool renderWorkers;
+	renderWorkers.start(RENDER_THREAD_COUNT, false);
+	while (isAlive) {
+		if (toggleTrace.exchange(false)) {					// Outside of this thread's spans, with the render workers idle.
+			pauseRequested.store(true, std::memory_order_release);
+			while (!paused.load(std::memory_order_acquire)) { std::this_thread::sleep_for(std::chrono::microseconds(RENDER_IDLE_SLEEP_MICROSECONDS)); }
+			toggleTracing();
+			pauseRequested.store(false, std::memory_order_release);
+		}
+		if (!snapshots.acquire()) { std::this_thread::sleep_for(std::chrono::microseconds(RENDER_IDLE_SLEEP_MICROSECONDS)); continue; }
+		TRACE_SCOPE("frame");
+		renderer.render(snapshots.readBuffer(), renderWorkers);
+		{
+			TRACE_SCOPE("present");
+			renderer.present();
 		}
 	}
+	simulating.store(false, std::memory_order_relaxed);
+	simulationThread.join();
 }
\ No newline at end of file
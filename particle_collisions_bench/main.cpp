@@ -0,0 +1,201 @@
+// Headless benchmark for Scene::step. Doesn't need a window, so it runs on build and perf machines without a display. Build it with something like:
+// g++ -std=c++17 -O2 -pthread -I../particle_collisions main.cpp ../particle_collisions/{Scene,ParticleStore,Particle,Vector2f,UniformGrid,SweepAndPrune,CollisionCalendar,DirtySet,ParticleHandles,TileDecomposition,Trace,Trajectory,CollisionLog,WorkerPool,PairKernel,PairKernelSSE2,debugOutput}.cpp
+//     ../particle_collisions/PairKernelAVX2.cpp ../particle_collisions/PairKernelAVX512.cpp (the last two need their own -mavx2 and -mavx512f flags, compile them separately) -o particle_collisions_bench
+//
+// Usage: particle_collisions_bench [--scenario name] [--frames n] [--warmup n] [--engine substep|event|tiled] [--broad-phase brute|grid|sweep] [--threads n] [--max-particles n] [--seed n] [--trace path]
+// Runs every scenario (or only the given one) and prints the results as JSON on stdout. Scenarios with more particles than --max-particles are skipped.
+// --trace records the timed frames of every scenario as a Chrome trace (see Trace.h) and writes it to the given file at the end.
+
+#include "Scene.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct BenchmarkOptions
+{
+	const char* scenario = nullptr;
+	uint32_t frames = 100;
+	uint32_t warmupFrames = 2;
+	EngineMode engineMode = EngineMode::EVENT_DRIVEN;				// The sub-step engine is what the window uses, but it's way too slow for the large scenarios.
+	BroadPhase broadPhase = BroadPhase::UNIFORM_GRID;
+	unsigned int threadCount = 1;
+	size_t maxParticles = 1000000;
+	uint32_t seed = 1;
+	const char* tracePath = nullptr;
+};
+
+// A scene to benchmark. Particles get placed on a jittered grid with room between them, so no scenario starts out with intersections.
+struct Scenario
+{
+	const char* name;
+	size_t particleCount;
+	float packingFraction;				// Fraction of the scene's area that the particles cover.
+	float minRadius;
+	float maxRadius;
+	float speed;						// Highest starting speed, in units per frame.
+	float attraction;					// Pulls every particle towards the center of the scene every frame by this much, same as the mouse in graphicsLoop (which uses 0.01). 0 turns it off.
+};
+
+static const Scenario scenarios[] = {
+	{ "dilute_gas", 10000, 0.02f, 5, 5, 5, 0 },
+	{ "dense_pack", 10000, 0.45f, 5, 5, 1, 0 },
+	{ "attractor_collapse", 2000, 0.3f, 5, 25, 0.1f, 0.2f },				// Way stronger than the mouse, so that the collapse happens within the default amount of frames.
+	{ "polydisperse", 10000, 0.15f, 1, 20, 2, 0 },
+	{ "large_n_1k", 1000, 0.1f, 5, 5, 2, 0 },
+	{ "large_n_10k", 10000, 0.1f, 5, 5, 2, 0 },
+	{ "large_n_100k", 100000, 0.1f, 5, 5, 2, 0 },
+	{ "large_n_1m", 1000000, 0.1f, 5, 5, 2, 0 },
+};
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const char* value = argv[i + 1];
+		if (strcmp(argv[i], "--scenario") == 0) { options.scenario = value; }
+		else if (strcmp(argv[i], "--frames") == 0) { options.frames = (uint32_t)strtoul(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--warmup") == 0) { options.warmupFrames = (uint32_t)strtoul(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--threads") == 0) { options.threadCount = (unsigned int)strtoul(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--max-particles") == 0) { options.maxParticles = (size_t)strtoull(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--seed") == 0) { options.seed = (uint32_t)strtoul(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--trace") == 0) { options.tracePath = value; }
+		else if (strcmp(argv[i], "--engine") == 0) {
+			if (strcmp(value, "substep") == 0) { options.engineMode = EngineMode::SUB_STEPPING; }
+			else if (strcmp(value, "event") == 0) { options.engineMode = EngineMode::EVENT_DRIVEN; }
+			else if (strcmp(value, "tiled") == 0) { options.engineMode = EngineMode::TILED_EVENT_DRIVEN; }
+			else { return false; }
+		}
+		else if (strcmp(argv[i], "--broad-phase") == 0) {
+			if (strcmp(value, "brute") == 0) { options.broadPhase = BroadPhase::BRUTE_FORCE; }
+			else if (strcmp(value, "grid") == 0) { options.broadPhase = BroadPhase::UNIFORM_GRID; }
+			else if (strcmp(value, "sweep") == 0) { options.broadPhase = BroadPhase::SWEEP_AND_PRUNE; }
+			else { return false; }
+		}
+		else { return false; }
+	}
+	return argc % 2 == 1 && options.frames != 0;
+}
+
+static const char* engineName(EngineMode engineMode) noexcept {
+	switch (engineMode) {
+	case EngineMode::SUB_STEPPING: return "substep";
+	case EngineMode::EVENT_DRIVEN: return "event";
+	case EngineMode::TILED_EVENT_DRIVEN: return "tiled";
+	}
+	return "unknown";
+}
+
+static const char* broadPhaseName(BroadPhase broadPhase) noexcept {
+	switch (broadPhase) {
+	case BroadPhase::BRUTE_FORCE: return "brute";
+	case BroadPhase::UNIFORM_GRID: return "grid";
+	case BroadPhase::SWEEP_AND_PRUNE: return "sweep";
+	}
+	return "unknown";
+}
+
+// The scene is square and just big enough to hit the packing fraction. Every particle gets its own grid cell, which is sized for the biggest radius, so the packing fraction is only reached if all radii are the same.
+static std::vector<Particle> generateParticles(const Scenario& scenario, uint32_t seed, uint32_t& size) {
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0, 1);
+
+	float meanArea = 3.14159265f * (scenario.minRadius * scenario.minRadius + scenario.minRadius * scenario.maxRadius + scenario.maxRadius * scenario.maxRadius) / 3;
+	float side = sqrt(scenario.particleCount * meanArea / scenario.packingFraction);
+	size_t columns = (size_t)ceil(sqrt((double)scenario.particleCount));
+	float cellSize = side / columns;
+	if (cellSize < 2 * scenario.maxRadius + 1) { cellSize = 2 * scenario.maxRadius + 1; }
+	size = (uint32_t)ceil(cellSize * columns);
+
+	std::vector<Particle> particles;
+	particles.reserve(scenario.particleCount);
+	for (size_t i = 0; i < scenario.particleCount; i++) {
+		float radius = scenario.minRadius * pow(scenario.maxRadius / scenario.minRadius, unit(random));				// Log-uniform, so that small particles aren't drowned out by big ones.
+		float slack = cellSize / 2 - radius;
+		Vector2f pos(cellSize * ((i % columns) + 0.5f) + slack * (unit(random) * 2 - 1), cellSize * ((i / columns) + 0.5f) + slack * (unit(random) * 2 - 1));
+		Vector2f vel((unit(random) * 2 - 1) * scenario.speed, (unit(random) * 2 - 1) * scenario.speed);
+		particles.push_back(Particle(pos, vel, radius, 1));
+	}
+	return particles;
+}
+
+static void applyAttractor(Scene& scene, float attraction) {
+	Vector2f center(scene.width / 2.0f, scene.height / 2.0f);
+	for (size_t i = 0; i < scene.particleCount; i++) {
+		Vector2f diff = center - scene.particles[i].pos;
+		float length = diff.getLength();
+		if (length < 0.001f) { continue; }
+		scene.particles[i].vel += diff / length * attraction;
+		scene.particles[i].vel *= 0.995f;
+	}
+}
+
+static void runScenario(const Scenario& scenario, const BenchmarkOptions& options, bool first) {
+	auto setupStart = std::chrono::steady_clock::now();
+	uint32_t size;
+	std::vector<Particle> particles = generateParticles(scenario, options.seed, size);
+	Scene scene;
+	scene.setThreadCount(options.threadCount, false);
+	scene.loadSize(size, size);
+	scene.loadParticles(particles);
+	scene.postLoadInit();
+	scene.engineMode = options.engineMode;
+	scene.broadPhase = options.broadPhase;
+	double setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();			// Generating and loading the scene, which is what large scenes spend their startup on.
+
+	for (uint32_t i = 0; i < options.warmupFrames; i++) {
+		scene.step();
+		if (scenario.attraction != 0) { applyAttractor(scene, scenario.attraction); }
+	}
+
+	SceneStats total;
+	double seconds = 0;
+	if (options.tracePath != nullptr) { traceEnabled.store(true, std::memory_order_relaxed); }
+	for (uint32_t i = 0; i < options.frames; i++) {
+		auto start = std::chrono::steady_clock::now();
+		scene.step();
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		total += scene.stats();
+		if (scenario.attraction != 0) { applyAttractor(scene, scenario.attraction); }						// Outside of the timing, it stands in for user input.
+	}
+	traceEnabled.store(false, std::memory_order_relaxed);
+
+	double frames = options.frames;
+	printf("%s\n\t\t{ \"name\": \"%s\", \"particles\": %zu, \"size\": %u, \"frames\": %u, \"setup_seconds\": %.6f, \"seconds\": %.6f, \"events_per_second\": %.1f, \"events_per_frame\": %.1f, \"wall_events_per_frame\": %.1f, \"zero_time_events_per_frame\": %.1f, "
+		"\"loop_iterations_per_frame\": %.1f, \"pair_tests_per_frame\": %.1f, \"early_rejections_per_frame\": %.1f, \"quadratic_solves_per_frame\": %.1f, \"intersection_resolutions\": %llu, \"max_intersection_depth\": %llu, "
+		"\"intersection_budget_hits\": %llu, \"max_invalidated_particles\": %llu, \"ns_per_particle_per_frame\": %.3f }",
+		first ? "" : ",", scenario.name, scenario.particleCount, size, options.frames, setupSeconds, seconds, seconds > 0 ? total.events / seconds : 0, total.events / frames, total.wallEvents / frames, total.zeroTimeEvents / frames,
+		total.loopIterations / frames, total.pairTests / frames, total.earlyRejections / frames, total.quadraticSolves / frames, (unsigned long long)total.intersectionResolutions, (unsigned long long)total.maxIntersectionDepth,
+		(unsigned long long)total.intersectionBudgetHits, (unsigned long long)total.maxInvalidatedParticles, scenario.particleCount != 0 ? seconds * 1e9 / (frames * scenario.particleCount) : 0);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: %s [--scenario name] [--frames n] [--warmup n] [--engine substep|event|tiled] [--broad-phase brute|grid|sweep] [--threads n] [--max-particles n] [--seed n] [--trace path]\n", argv[0]);
+		return 2;
+	}
+
+	if (options.tracePath != nullptr) { startTrace(); stopTrace(); }					// Only to set the trace's origin, recording gets turned on for the timed frames only.
+	printf("{\n\t\"engine\": \"%s\", \"broad_phase\": \"%s\", \"threads\": %u, \"simd\": \"%s\",\n\t\"scenarios\": [", engineName(options.engineMode), broadPhaseName(options.broadPhase), options.threadCount, simdLevelName(detectSimdLevel()));
+	bool first = true;
+	bool found = false;
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		if (options.scenario != nullptr && strcmp(options.scenario, scenarios[i].name) != 0) { continue; }
+		found = true;
+		if (scenarios[i].particleCount > options.maxParticles) { continue; }
+		runScenario(scenarios[i], options, first);
+		first = false;
+	}
+	printf("\n\t]\n}\n");
+	if (!found) { fprintf(stderr, "unknown scenario %s\n", options.scenario); return 2; }
+	if (options.tracePath != nullptr) {
+		if (!writeChromeTrace(options.tracePath)) { fprintf(stderr, "failed to write trace %s\n", options.tracePath); return 1; }
+		if (droppedTraceSpans() != 0) { fprintf(stderr, "trace buffers ran full, %zu spans were dropped\n", droppedTraceSpans()); }
+	}
+	return 0;
+}
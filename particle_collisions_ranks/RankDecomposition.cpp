@@ -0,0 +1,291 @@
+#include "RankDecomposition.h"
+
+#include "debugOutput.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Room on top of the fastest particle's speed for particles that get faster during the step, same idea as SWEEP_SPEED_BOUND_SLACK in the Scene.
+#define RANK_SPEED_BOUND_SLACK 1.25f
+// Extra halo width on top of what the speed bound requires, so that floating point error can't make a pair slip through. Same as GRID_CELL_PADDING in the Scene.
+#define RANK_HALO_PADDING 1.0f
+
+// Every part of the segment starts on its own cache line, so that the ring counters of different ranks don't bounce the same line back and forth.
+static size_t alignToCacheLine(size_t size) noexcept { return (size + 63) & ~(size_t)63; }
+
+static float floatFromBits(uint32_t bits) noexcept { float value; memcpy(&value, &bits, sizeof(value)); return value; }
+
+RankSegment::~RankSegment() { close(); }
+
+size_t RankSegment::requiredSize(uint32_t rankCount, size_t particleCount, size_t ringCapacity) noexcept {
+	size_t ringCount = rankCount > 1 ? 2 * (rankCount - 1) : 0;
+	return alignToCacheLine(sizeof(RankControl)) + ringCount * alignToCacheLine(ShmRing::requiredSize(ringCapacity)) + particleCount * sizeof(RankParticle);
+}
+
+bool RankSegment::create(const char* name, uint32_t rankCount, size_t particleCount, size_t ringCapacity, uint32_t width, uint32_t height) {
+	size = requiredSize(rankCount, particleCount, ringCapacity);
+	int file = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (file == -1) { debuglogger::out << debuglogger::error << "failed to create shared memory segment" << debuglogger::endl; return false; }
+	if (ftruncate(file, (off_t)size) != 0) { debuglogger::out << debuglogger::error << "failed to size shared memory segment" << debuglogger::endl; ::close(file); shm_unlink(name); return false; }
+	memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	::close(file);
+	if (memory == MAP_FAILED) { memory = nullptr; debuglogger::out << debuglogger::error << "failed to map shared memory segment" << debuglogger::endl; shm_unlink(name); return false; }
+
+	control = new (memory) RankControl;
+	control->rankCount = rankCount;
+	control->width = width;
+	control->height = height;
+	control->particleCount = particleCount;
+	control->ringCapacity = ringCapacity;
+	control->barrierArrivals.store(0, std::memory_order_relaxed);
+	control->barrierGeneration.store(0, std::memory_order_relaxed);
+	control->maxSpeedBits.store(0, std::memory_order_relaxed);
+	control->maxRadiusBits.store(0, std::memory_order_relaxed);
+	control->redoStep.store(0, std::memory_order_relaxed);
+
+	mapRings();
+	uint8_t* ringMemory = (uint8_t*)memory + alignToCacheLine(sizeof(RankControl));
+	for (size_t i = 0; i < rings.size(); i++) { rings[i].create(ringMemory + i * alignToCacheLine(ShmRing::requiredSize(ringCapacity)), ringCapacity); }
+	return true;
+}
+
+bool RankSegment::open(const char* name) {
+	int file = shm_open(name, O_RDWR, 0600);
+	if (file == -1) { debuglogger::out << debuglogger::error << "failed to open shared memory segment" << debuglogger::endl; return false; }
+	struct stat fileInfo;
+	if (fstat(file, &fileInfo) != 0) { debuglogger::out << debuglogger::error << "failed to read size of shared memory segment" << debuglogger::endl; ::close(file); return false; }
+	size = (size_t)fileInfo.st_size;
+	memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	::close(file);
+	if (memory == MAP_FAILED) { memory = nullptr; debuglogger::out << debuglogger::error << "failed to map shared memory segment" << debuglogger::endl; return false; }
+	control = (RankControl*)memory;
+	mapRings();
+	return true;
+}
+
+void RankSegment::mapRings() noexcept {
+	uint32_t rankCount = control->rankCount;
+	size_t ringSize = alignToCacheLine(ShmRing::requiredSize(control->ringCapacity));
+	rings.resize(rankCount > 1 ? 2 * (rankCount - 1) : 0);
+	uint8_t* ringMemory = (uint8_t*)memory + alignToCacheLine(sizeof(RankControl));
+	for (size_t i = 0; i < rings.size(); i++) { rings[i].attach(ringMemory + i * ringSize); }
+	states = (RankParticle*)(ringMemory + rings.size() * ringSize);
+}
+
+void RankSegment::close() noexcept {
+	if (memory != nullptr) { munmap(memory, size); }
+	memory = nullptr;
+	control = nullptr;
+	states = nullptr;
+	rings.clear();
+}
+
+void RankSegment::unlink(const char* name) noexcept { shm_unlink(name); }
+
+// The last rank to arrive starts the next generation, which lets everyone else through. The arrival counter gets reset before that, so ranks that race ahead into the next barrier count towards the right one.
+void RankSegment::barrier() noexcept {
+	uint32_t generation = control->barrierGeneration.load(std::memory_order_acquire);
+	if (control->barrierArrivals.fetch_add(1, std::memory_order_acq_rel) + 1 == control->rankCount) {
+		control->barrierArrivals.store(0, std::memory_order_relaxed);
+		control->barrierGeneration.fetch_add(1, std::memory_order_release);
+		return;
+	}
+	while (control->barrierGeneration.load(std::memory_order_acquire) == generation) { sched_yield(); }
+}
+
+void RankSegment::raiseMax(std::atomic<uint32_t>& maxBits, float value) noexcept {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t current = maxBits.load(std::memory_order_relaxed);
+	while (bits > current && !maxBits.compare_exchange_weak(current, bits, std::memory_order_relaxed)) { }
+}
+
+// Messages are a particle count followed by the particles.
+static void sendParticles(ShmRing& ring, const std::vector<RankParticle>& particles) {
+	uint64_t count = particles.size();
+	ring.write(&count, sizeof(count));
+	ring.write(particles.data(), particles.size() * sizeof(RankParticle));
+}
+
+static void receiveParticles(ShmRing& ring, std::vector<RankParticle>& particles) {
+	uint64_t count;
+	ring.read(&count, sizeof(count));
+	particles.resize(count);
+	ring.read(particles.data(), count * sizeof(RankParticle));
+}
+
+// Bitwise, so that even NaNs compare equal as long as both ranks ended up with the same ones.
+static bool sameState(const RankParticle& a, const RankParticle& b) noexcept {
+	return memcmp(&a.x, &b.x, 4 * sizeof(float)) == 0 && a.collisionCount == b.collisionCount && a.flags == b.flags;
+}
+
+RankWorker::RankWorker(RankSegment& segment, uint32_t rank) : segment(segment), rank(rank) {
+	stripWidth = (float)segment.control->width / segment.control->rankCount;
+	scene.loadSize(segment.control->width, segment.control->height);
+	scene.engineMode = EngineMode::EVENT_DRIVEN;					// NOTE: Not the tiled engine, the halo check relies on gridSpeedBound being the highest speed any particle actually had in the step, which the tiled engine overshoots on purpose.
+	scene.broadPhase = BroadPhase::UNIFORM_GRID;
+}
+
+// Same clamping as the UniformGrid, particles outside of the scene (or with NaN positions) belong to the border strips.
+uint32_t RankWorker::ownerOf(float x) const noexcept {
+	if (!(x >= 0)) { return 0; }
+	uint32_t owner = (uint32_t)(x / stripWidth);
+	return owner < segment.control->rankCount ? owner : segment.control->rankCount - 1;
+}
+
+void RankWorker::loadOwned() {
+	owned.clear();
+	float localMaxRadius = 0;
+	for (size_t i = 0; i < segment.control->particleCount; i++) {
+		const RankParticle& particle = segment.states[i];
+		if (ownerOf(particle.x) != rank) { continue; }
+		owned.push_back(particle);
+		if (particle.radius > localMaxRadius) { localMaxRadius = particle.radius; }
+	}
+	segment.raiseMax(segment.control->maxRadiusBits, localMaxRadius);
+	segment.barrier();
+	maxRadius = floatFromBits(segment.control->maxRadiusBits.load(std::memory_order_relaxed));
+	segment.barrier();												// Nobody can write their particles back into the table before everyone is done reading it.
+}
+
+// Two sweeps, first from left to right, then from right to left. Every rank passes on everything that reaches into the next strip, including what it got from the other side, so halos can span more than one strip.
+// Particles that crossed into another strip go along with the sweep in their direction until they reach their new owner. Particles that moved right come back as halo in the second sweep, particles that moved left are kept as halo right away.
+void RankWorker::exchangeHalos(float haloWidth) {
+	uint32_t rankCount = segment.control->rankCount;
+	float stripStart = rank * stripWidth;
+	float stripEnd = stripStart + stripWidth;
+	ghosts.clear();
+
+	incoming.clear();
+	if (rank > 0) { receiveParticles(segment.rightRing(rank - 1), incoming); }
+	for (size_t i = 0; i < incoming.size(); i++) {
+		uint32_t owner = ownerOf(incoming[i].x);
+		if (owner == rank) { owned.push_back(incoming[i]); }
+		else if (owner < rank) { ghosts.push_back(incoming[i]); }
+	}
+	if (rank + 1 < rankCount) {
+		outgoing.clear();
+		float reach = stripEnd - haloWidth;
+		for (size_t i = 0; i < owned.size(); i++) { if (owned[i].x >= reach || ownerOf(owned[i].x) > rank) { outgoing.push_back(owned[i]); } }
+		for (size_t i = 0; i < incoming.size(); i++) {
+			uint32_t owner = ownerOf(incoming[i].x);
+			if (owner != rank && (incoming[i].x >= reach || owner > rank)) { outgoing.push_back(incoming[i]); }
+		}
+		sendParticles(segment.rightRing(rank), outgoing);
+		size_t kept = 0;
+		for (size_t i = 0; i < owned.size(); i++) { if (ownerOf(owned[i].x) <= rank) { owned[kept++] = owned[i]; } }
+		owned.resize(kept);
+	}
+
+	incoming.clear();
+	if (rank + 1 < rankCount) { receiveParticles(segment.leftRing(rank + 1), incoming); }
+	for (size_t i = 0; i < incoming.size(); i++) {
+		if (ownerOf(incoming[i].x) == rank) { owned.push_back(incoming[i]); }
+		else { ghosts.push_back(incoming[i]); }
+	}
+	if (rank > 0) {
+		outgoing.clear();
+		float reach = stripStart + haloWidth;
+		for (size_t i = 0; i < owned.size(); i++) { if (owned[i].x < reach || ownerOf(owned[i].x) < rank) { outgoing.push_back(owned[i]); } }
+		for (size_t i = 0; i < incoming.size(); i++) {
+			uint32_t owner = ownerOf(incoming[i].x);
+			if (owner != rank && (incoming[i].x < reach || owner < rank)) { outgoing.push_back(incoming[i]); }
+		}
+		sendParticles(segment.leftRing(rank), outgoing);
+		size_t kept = 0;
+		for (size_t i = 0; i < owned.size(); i++) {
+			if (ownerOf(owned[i].x) == rank) { owned[kept++] = owned[i]; }
+			else { ghosts.push_back(owned[i]); }
+		}
+		owned.resize(kept);
+	}
+}
+
+static bool comesFirst(const RankParticle& a, const RankParticle& b) noexcept { return a.id < b.id; }
+
+// Steps the owned particles together with the halo. Returns false if a particle got faster than the halo accounts for.
+bool RankWorker::stepLocal(float speedBound) {
+	std::sort(owned.begin(), owned.end(), comesFirst);
+	std::sort(ghosts.begin(), ghosts.end(), comesFirst);
+	local.resize(owned.size() + ghosts.size());
+	std::merge(owned.begin(), owned.end(), ghosts.begin(), ghosts.end(), local.begin(), comesFirst);
+	if (local.empty()) { return true; }
+
+	sceneParticles.resize(local.size());
+	for (size_t i = 0; i < local.size(); i++) {
+		const RankParticle& particle = local[i];
+		sceneParticles[i] = Particle(Vector2f(particle.x, particle.y), Vector2f(particle.vx, particle.vy), particle.radius, particle.mass);
+		sceneParticles[i].lastInteractionWasIntersection = (particle.flags & PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION) != 0;
+	}
+	scene.loadParticles(sceneParticles);
+	scene.postLoadInit();
+	scene.step();
+
+	// Both lists are sorted by id and local is the merge of them, so walking all three in order puts every result back where it came from.
+	size_t ownedIndex = 0;
+	size_t ghostIndex = 0;
+	for (size_t i = 0; i < local.size(); i++) {
+		RankParticle& particle = ownedIndex < owned.size() && owned[ownedIndex].id == local[i].id ? owned[ownedIndex++] : ghosts[ghostIndex++];
+		particle.x = scene.particles.x[i];
+		particle.y = scene.particles.y[i];
+		particle.vx = scene.particles.vx[i];
+		particle.vy = scene.particles.vy[i];
+		particle.flags = scene.particles.flags[i];
+		particle.collisionCount = scene.collisionCounts[i];
+	}
+	return scene.gridSpeedBound <= speedBound;
+}
+
+void RankWorker::storeOwned() { for (size_t i = 0; i < owned.size(); i++) { segment.states[owned[i].id] = owned[i]; } }
+
+void RankWorker::step() {
+	std::vector<RankParticle> stepStart = owned;
+
+	float localMaxSquaredSpeed = 0;
+	for (size_t i = 0; i < owned.size(); i++) {
+		float squaredSpeed = owned[i].vx * owned[i].vx + owned[i].vy * owned[i].vy;
+		if (squaredSpeed > localMaxSquaredSpeed) { localMaxSquaredSpeed = squaredSpeed; }
+	}
+	segment.raiseMax(segment.control->maxSpeedBits, sqrt(localMaxSquaredSpeed));
+	segment.barrier();
+	float maxSpeed = floatFromBits(segment.control->maxSpeedBits.load(std::memory_order_relaxed));
+	segment.barrier();
+	if (rank == 0) { segment.control->maxSpeedBits.store(0, std::memory_order_relaxed); }			// Nobody raises it again before the next step's first barrier.
+
+	while (true) {
+		float speedBound = maxSpeed * RANK_SPEED_BOUND_SLACK * haloScale;
+		exchangeHalos((2 * (maxRadius + maxSpeed * RANK_SPEED_BOUND_SLACK) + RANK_HALO_PADDING) * haloScale);			// Scaling the radius and the padding as well makes the halo grow even if nothing is moving.
+		bool valid = stepLocal(speedBound);
+		storeOwned();
+		segment.barrier();
+
+		for (size_t i = 0; i < ghosts.size() && valid; i++) { valid = sameState(ghosts[i], segment.states[ghosts[i].id]); }
+		if (!valid) { segment.control->redoStep.store(1, std::memory_order_relaxed); }
+		segment.barrier();
+		bool redo = segment.control->redoStep.load(std::memory_order_relaxed) != 0;
+		segment.barrier();
+		if (rank == 0) { segment.control->redoStep.store(0, std::memory_order_relaxed); }
+
+		if (!redo) { return; }
+		owned = stepStart;
+		haloScale *= 2;													// Stays up for the following steps as well, whatever made this step need a wider halo is probably still around.
+	}
+}
+
+bool runRank(const char* segmentName, uint32_t rank, uint32_t steps) {
+	RankSegment segment;
+	if (!segment.open(segmentName)) { return false; }
+	if (rank >= segment.control->rankCount) { debuglogger::out << debuglogger::error << "rank is out of range" << debuglogger::endl; return false; }
+
+	RankWorker worker(segment, rank);
+	worker.loadOwned();
+	for (uint32_t i = 0; i < steps; i++) { worker.step(); }
+	return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "ShmRing.h"
+
+#include "Scene.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Runs one scene split over several processes on the same host. Every process (rank) owns the particles in one vertical strip of the scene and simulates them with its own Scene.
+// Before every step, the ranks pass the particles near their borders (the halo) and the particles that crossed a border to their neighbors through ShmRings, and every rank steps its own particles together with its halo.
+// Collisions across a border get simulated by both ranks, so no events have to be exchanged in the middle of the step. Instead, every rank checks its halo particles against the results of their owners after the step.
+// If anything doesn't match (or a particle got faster than the halo accounts for), the halo was too small, and all ranks redo the step with a wider one. That makes the result exactly the same as a single Scene's.
+
+// A particle as it gets passed between ranks and stored in the state table of the RankSegment.
+struct RankParticle
+{
+	uint32_t id;							// Index of the particle in the whole scene. The ranks keep their particles sorted by id, so that ties between events resolve the same way as in a single Scene.
+	uint32_t collisionCount;				// How often the particle collided in the last step, only used to check halos.
+	float x;
+	float y;
+	float vx;
+	float vy;
+	float radius;
+	float mass;
+	uint8_t flags;
+};
+
+// Shared state of all ranks, at the start of the shared memory segment.
+struct RankControl
+{
+	uint32_t rankCount;
+	uint32_t width;
+	uint32_t height;
+	uint64_t particleCount;
+	uint64_t ringCapacity;
+
+	std::atomic<uint32_t> barrierArrivals;
+	std::atomic<uint32_t> barrierGeneration;
+	std::atomic<uint32_t> maxSpeedBits;				// Speeds are never negative, so the float bits compare the same way as the floats themselves.
+	std::atomic<uint32_t> maxRadiusBits;
+	std::atomic<uint32_t> redoStep;
+};
+
+// The POSIX shared memory segment that the ranks communicate through. The layout is the RankControl, a ring from every rank to each of its neighbors, and the state table, which holds every particle at its index.
+// The launcher fills the table with the starting state, the ranks write their particles back into it after every step, and at the end it holds the merged state of the whole scene.
+class RankSegment
+{
+public:
+	RankControl* control = nullptr;
+	std::vector<ShmRing> rings;					// Rightward rings first (rank r to r + 1 is ring r), then leftward rings (rank r + 1 to r is ring rankCount - 1 + r).
+	RankParticle* states = nullptr;
+
+	void* memory = nullptr;
+	size_t size = 0;
+
+	RankSegment() = default;
+	RankSegment(const RankSegment&) = delete;
+	RankSegment& operator=(const RankSegment&) = delete;
+	~RankSegment();
+
+	static size_t requiredSize(uint32_t rankCount, size_t particleCount, size_t ringCapacity) noexcept;
+
+	// Returns false (after logging why) if the segment couldn't be created or opened.
+	bool create(const char* name, uint32_t rankCount, size_t particleCount, size_t ringCapacity, uint32_t width, uint32_t height);
+	bool open(const char* name);
+	void close() noexcept;
+	static void unlink(const char* name) noexcept;
+
+	ShmRing& rightRing(uint32_t rank) noexcept { return rings[rank]; }							// From rank to rank + 1.
+	ShmRing& leftRing(uint32_t rank) noexcept { return rings[control->rankCount - 1 + rank - 1]; }		// From rank to rank - 1.
+
+	void barrier() noexcept;
+	void raiseMax(std::atomic<uint32_t>& maxBits, float value) noexcept;
+
+	void mapRings() noexcept;
+};
+
+// One rank's side of the decomposition.
+class RankWorker
+{
+public:
+	RankSegment& segment;
+	uint32_t rank;
+
+	float stripWidth;
+	float maxRadius = 0;
+	float haloScale = 1;						// Doubles the halo (and the speed bound it's planned for) every time a step has to be redone, so that the halo keeps growing until it's big enough.
+	std::vector<RankParticle> owned;
+	std::vector<RankParticle> ghosts;			// The halo of the current step, owned by other ranks.
+	Scene scene;
+
+	// Temporaries of exchangeHalos and stepLocal.
+	std::vector<RankParticle> incoming;
+	std::vector<RankParticle> outgoing;
+	std::vector<RankParticle> local;
+	std::vector<Particle> sceneParticles;
+
+	RankWorker(RankSegment& segment, uint32_t rank);
+
+	uint32_t ownerOf(float x) const noexcept;
+
+	void loadOwned();
+	void exchangeHalos(float haloWidth);
+	bool stepLocal(float speedBound);
+	void step();
+	void storeOwned();
+};
+
+// Entry point of a rank process. Opens the segment, runs the given amount of steps, and leaves its particles in the state table.
+bool runRank(const char* segmentName, uint32_t rank, uint32_t steps);
@@ -0,0 +1,59 @@
+#include "ShmRing.h"
+
+#include <cstring>
+#include <new>
+#include <sched.h>
+
+size_t ShmRing::requiredSize(size_t capacity) noexcept { return sizeof(ShmRingHeader) + capacity; }
+
+void ShmRing::create(void* memory, size_t capacity) noexcept {
+	header = new (memory) ShmRingHeader;
+	header->written.store(0, std::memory_order_relaxed);
+	header->read.store(0, std::memory_order_relaxed);
+	header->capacity = capacity;
+	data = (uint8_t*)memory + sizeof(ShmRingHeader);
+}
+
+void ShmRing::attach(void* memory) noexcept {
+	header = (ShmRingHeader*)memory;
+	data = (uint8_t*)memory + sizeof(ShmRingHeader);
+}
+
+// NOTE: Waiting yields instead of spinning, ranks can end up sharing cores with each other (or with the launcher), in which case spinning would keep the other side from ever making progress.
+void ShmRing::write(const void* source, size_t size) noexcept {
+	const uint8_t* bytes = (const uint8_t*)source;
+	uint64_t capacity = header->capacity;
+	uint64_t written = header->written.load(std::memory_order_relaxed);
+	while (size != 0) {
+		uint64_t space = capacity - (written - header->read.load(std::memory_order_acquire));
+		if (space == 0) { sched_yield(); continue; }
+		uint64_t offset = written % capacity;
+		size_t chunk = size;
+		if (chunk > space) { chunk = space; }
+		if (chunk > capacity - offset) { chunk = capacity - offset; }
+		memcpy(data + offset, bytes, chunk);
+		bytes += chunk;
+		size -= chunk;
+		written += chunk;
+		header->written.store(written, std::memory_order_release);
+	}
+}
+
+void ShmRing::read(void* destination, size_t size) noexcept {
+	uint8_t* bytes = (uint8_t*)destination;
+	uint64_t capacity = header->capacity;
+	uint64_t read = header->read.load(std::memory_order_relaxed);
+	while (size != 0) {
+		uint64_t available = header->written.load(std::memory_order_acquire) - read;
+		if (available == 0) { sched_yield(); continue; }
+		uint64_t offset = read % capacity;
+		size_t chunk = size;
+		if (chunk > available) { chunk = available; }
+		if (chunk > capacity - offset) { chunk = capacity - offset; }
+		memcpy(bytes, data + offset, chunk);
+		bytes += chunk;
+		size -= chunk;
+		read += chunk;
+		header->read.store(read, std::memory_order_release);
+	}
+}
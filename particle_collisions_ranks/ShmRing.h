@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Control data of a ShmRing. Lives at the start of the ring's memory, so both processes see the same counters.
+// The counters only ever go up, the position in the ring is the counter modulo the capacity. That way, a full ring and an empty ring can be told apart without wasting a byte.
+struct ShmRingHeader
+{
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> read;
+	uint64_t capacity;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring counters are shared between processes, which only works if the atomics don't need a lock");
+
+// Single-producer single-consumer byte ring inside of a piece of shared memory, used to pass particles between neighboring ranks (see RankSegment).
+// Reads and writes block until they're done and can be way bigger than the ring, the data just streams through while the other side keeps up.
+class ShmRing
+{
+public:
+	ShmRingHeader* header = nullptr;
+	uint8_t* data = nullptr;
+
+	static size_t requiredSize(size_t capacity) noexcept;
+
+	// Sets up a new, empty ring in memory, which has to be requiredSize(capacity) bytes big. Only one of the processes does this, the others attach.
+	void create(void* memory, size_t capacity) noexcept;
+	void attach(void* memory) noexcept;
+
+	void write(const void* source, size_t size) noexcept;
+	void read(void* destination, size_t size) noexcept;
+};
@@ -0,0 +1,146 @@
+// Launcher for the multi-process mode (see RankDecomposition.h). POSIX only, so it isn't part of the Visual Studio solution. Build it with something like:
+// g++ -std=c++17 -O2 -pthread -I../particle_collisions *.cpp ../particle_collisions/{Scene,ParticleStore,Particle,Vector2f,UniformGrid,SweepAndPrune,CollisionCalendar,DirtySet,ParticleHandles,TileDecomposition,Trace,Trajectory,CollisionLog,WorkerPool,PairKernel,PairKernelSSE2,debugOutput}.cpp
+//     ../particle_collisions/PairKernelAVX2.cpp ../particle_collisions/PairKernelAVX512.cpp (the last two need their own -mavx2 and -mavx512f flags, compile them separately) -lrt -o particle_collisions_ranks
+//
+// Usage: particle_collisions_ranks [--ranks n] [--particles n] [--steps n] [--width n] [--height n] [--seed n] [--pin] [--verify]
+// Generates a random scene, runs it on the given amount of rank processes and prints how long that took. --pin spreads the ranks evenly over the cores (one rank per NUMA socket if the rank count matches the socket count).
+// --verify runs the same scene in a single Scene afterwards and checks that every particle ended up exactly the same.
+
+#include "RankDecomposition.h"
+
+#include "debugOutput.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#define RING_CAPACITY (1 << 20)
+
+struct LaunchOptions
+{
+	uint32_t rankCount = 4;
+	size_t particleCount = 10000;
+	uint32_t steps = 100;
+	uint32_t width = 4000;
+	uint32_t height = 4000;
+	uint32_t seed = 1;
+	bool pin = false;
+	bool verify = false;
+};
+
+static bool parseOptions(int argc, char** argv, LaunchOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--pin") == 0) { options.pin = true; continue; }
+		if (strcmp(argv[i], "--verify") == 0) { options.verify = true; continue; }
+		if (i + 1 >= argc) { return false; }
+		unsigned long long value = strtoull(argv[i + 1], nullptr, 10);
+		if (strcmp(argv[i], "--ranks") == 0) { options.rankCount = (uint32_t)value; }
+		else if (strcmp(argv[i], "--particles") == 0) { options.particleCount = (size_t)value; }
+		else if (strcmp(argv[i], "--steps") == 0) { options.steps = (uint32_t)value; }
+		else if (strcmp(argv[i], "--width") == 0) { options.width = (uint32_t)value; }
+		else if (strcmp(argv[i], "--height") == 0) { options.height = (uint32_t)value; }
+		else if (strcmp(argv[i], "--seed") == 0) { options.seed = (uint32_t)value; }
+		else { return false; }
+		i++;
+	}
+	return options.rankCount != 0 && options.width != 0 && options.height != 0;
+}
+
+// Particles on a jittered grid that leaves room between them, so that the scene starts without intersections, with random velocities and radii.
+static std::vector<Particle> generateParticles(const LaunchOptions& options) {
+	std::mt19937 random(options.seed);
+	std::uniform_real_distribution<float> unit(0, 1);
+	size_t columns = (size_t)ceil(sqrt((double)options.particleCount * options.width / options.height));
+	if (columns == 0) { columns = 1; }
+	size_t rows = (options.particleCount + columns - 1) / columns;
+	float spacingX = (float)options.width / columns;
+	float spacingY = rows != 0 ? (float)options.height / rows : 0;
+	float maxRadius = (spacingX < spacingY ? spacingX : spacingY) * 0.3f;
+
+	std::vector<Particle> particles;
+	particles.reserve(options.particleCount);
+	for (size_t i = 0; i < options.particleCount; i++) {
+		float radius = maxRadius * (0.5f + 0.5f * unit(random));
+		float slackX = spacingX / 2 - radius;
+		float slackY = spacingY / 2 - radius;
+		Vector2f pos(spacingX * ((i % columns) + 0.5f) + slackX * (unit(random) * 2 - 1), spacingY * ((i / columns) + 0.5f) + slackY * (unit(random) * 2 - 1));
+		Vector2f vel((unit(random) * 2 - 1) * maxRadius, (unit(random) * 2 - 1) * maxRadius);
+		particles.push_back(Particle(pos, vel, radius, 1));
+	}
+	return particles;
+}
+
+int main(int argc, char** argv) {
+	LaunchOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: %s [--ranks n] [--particles n] [--steps n] [--width n] [--height n] [--seed n] [--pin] [--verify]\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<Particle> particles = generateParticles(options);
+
+	char segmentName[64];
+	snprintf(segmentName, sizeof(segmentName), "/particle_collisions_%d", (int)getpid());
+	RankSegment segment;
+	if (!segment.create(segmentName, options.rankCount, particles.size(), RING_CAPACITY, options.width, options.height)) { fprintf(stderr, "failed to create shared memory segment %s\n", segmentName); return 1; }
+	for (size_t i = 0; i < particles.size(); i++) {
+		const Particle& particle = particles[i];
+		segment.states[i] = { (uint32_t)i, 0, particle.pos.x, particle.pos.y, particle.vel.x, particle.vel.y, particle.radius, particle.mass, (uint8_t)(particle.lastInteractionWasIntersection ? PARTICLE_FLAG_LAST_INTERACTION_WAS_INTERSECTION : 0) };
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<pid_t> ranks;
+	for (uint32_t rank = 0; rank < options.rankCount; rank++) {
+		pid_t pid = fork();
+		if (pid == -1) { fprintf(stderr, "failed to start rank %u\n", rank); break; }
+		if (pid == 0) {
+			if (options.pin) {
+				unsigned int coreCount = std::thread::hardware_concurrency();
+				if (coreCount != 0) { pinCurrentThreadToCore((unsigned int)((unsigned long long)rank * coreCount / options.rankCount)); }
+			}
+			bool succeeded = runRank(segmentName, rank, options.steps);
+			debuglogger::flush();						// _exit doesn't run destructors, so the logger wouldn't get to write what's left.
+			_exit(succeeded ? 0 : 1);
+		}
+		ranks.push_back(pid);
+	}
+	bool ranksSucceeded = ranks.size() == options.rankCount;
+	if (!ranksSucceeded) { for (size_t i = 0; i < ranks.size(); i++) { kill(ranks[i], SIGKILL); } }			// The ones that did start would wait for the missing ones forever.
+	for (size_t i = 0; i < ranks.size(); i++) {
+		int status;
+		if (waitpid(ranks[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) { ranksSucceeded = false; }
+	}
+	double rankSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	RankSegment::unlink(segmentName);						// The mapping stays valid until it's closed, the name just isn't needed anymore.
+	if (!ranksSucceeded) { fprintf(stderr, "a rank failed\n"); return 1; }
+	printf("ranks: %u, particles: %zu, steps: %u, time: %.3fs\n", options.rankCount, particles.size(), options.steps, rankSeconds);
+
+	if (!options.verify) { return 0; }
+
+	Scene scene;
+	scene.loadSize(options.width, options.height);
+	scene.loadParticles(particles);
+	scene.postLoadInit();
+	scene.engineMode = EngineMode::EVENT_DRIVEN;
+	scene.broadPhase = BroadPhase::UNIFORM_GRID;
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < options.steps; i++) { scene.step(); }
+	double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < particles.size(); i++) {
+		const RankParticle& merged = segment.states[i];
+		float expected[4] = { scene.particles.x[i], scene.particles.y[i], scene.particles.vx[i], scene.particles.vy[i] };
+		if (memcmp(&merged.x, expected, sizeof(expected)) != 0) {
+			if (mismatches == 0) { fprintf(stderr, "particle %zu: (%f, %f, %f, %f) instead of (%f, %f, %f, %f)\n", i, merged.x, merged.y, merged.vx, merged.vy, expected[0], expected[1], expected[2], expected[3]); }
+			mismatches++;
+		}
+	}
+	printf("single process time: %.3fs, mismatching particles: %zu\n", singleSeconds, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+// Headless replayer for the input journals that the window records (see InputJournal.h), so that a run with a frame time spike can be reproduced and profiled without a display. Build it with something like:
+// g++ -std=c++17 -O2 -pthread -I../particle_collisions main.cpp ../particle_collisions/{Scene,ParticleStore,Particle,Vector2f,UniformGrid,SweepAndPrune,CollisionCalendar,DirtySet,ParticleHandles,TileDecomposition,Trace,Trajectory,CollisionLog,Checkpoint,InputJournal,Rasterizer,WorkerPool,PairKernel,PairKernelSSE2,debugOutput}.cpp
+//     ../particle_collisions/PairKernelAVX2.cpp ../particle_collisions/PairKernelAVX512.cpp (the last two need their own -mavx2 and -mavx512f flags, compile them separately) -o particle_collisions_replay
+// Use the same compiler and flags as the window, otherwise the floating point results (and with them the checksums) can differ.
+//
+// Usage: particle_collisions_replay --journal path [--frames n] [--threads n] [--broad-phase brute|grid|sweep] [--slowest n] [--trace path] [--trace-frame n] [--ppm path]
+// Replays the journal (or its first n frames), checks every frame against the checksum that got recorded with it and prints the timings of the slowest frames as JSON on stdout.
+// --broad-phase replaces the recorded broad phase. All of them give the same results, and the window's journals have particles added into each other, so replaying one with brute checks that the others still do with overlaps too.
+// --trace records a Chrome trace (see Trace.h) of every frame, or only of the frame given with --trace-frame, and writes it to the given file at the end.
+// --ppm draws the scene as it is after the last replayed frame (see Rasterizer.h) and writes the picture to the given file.
+
+#include "Scene.h"
+#include "InputJournal.h"
+#include "Rasterizer.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct ReplayOptions
+{
+	const char* journalPath = nullptr;
+	uint64_t frames = UINT64_MAX;
+	unsigned int threadCount = 0;						// 0 uses the recorded thread count. Others can change the results of the sub-step engine, see applySceneSettings.
+	bool overrideBroadPhase = false;
+	BroadPhase broadPhase = BroadPhase::UNIFORM_GRID;
+	size_t slowest = 10;
+	const char* tracePath = nullptr;
+	uint64_t traceFrame = UINT64_MAX;					// UINT64_MAX traces every frame.
+	const char* ppmPath = nullptr;
+};
+
+struct FrameTiming
+{
+	uint64_t frame;
+	double seconds;
+	size_t particles;
+	SceneStats stats;
+};
+
+static bool parseOptions(int argc, char** argv, ReplayOptions& options) {
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const char* value = argv[i + 1];
+		if (strcmp(argv[i], "--journal") == 0) { options.journalPath = value; }
+		else if (strcmp(argv[i], "--frames") == 0) { options.frames = strtoull(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--threads") == 0) { options.threadCount = (unsigned int)strtoul(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--broad-phase") == 0) {
+			options.overrideBroadPhase = true;
+			if (strcmp(value, "brute") == 0) { options.broadPhase = BroadPhase::BRUTE_FORCE; }
+			else if (strcmp(value, "grid") == 0) { options.broadPhase = BroadPhase::UNIFORM_GRID; }
+			else if (strcmp(value, "sweep") == 0) { options.broadPhase = BroadPhase::SWEEP_AND_PRUNE; }
+			else { return false; }
+		}
+		else if (strcmp(argv[i], "--slowest") == 0) { options.slowest = (size_t)strtoull(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--trace") == 0) { options.tracePath = value; }
+		else if (strcmp(argv[i], "--trace-frame") == 0) { options.traceFrame = strtoull(value, nullptr, 10); }
+		else if (strcmp(argv[i], "--ppm") == 0) { options.ppmPath = value; }
+		else { return false; }
+	}
+	return argc % 2 == 1 && options.journalPath != nullptr;
+}
+
+int main(int argc, char** argv) {
+	ReplayOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: %s --journal path [--frames n] [--threads n] [--broad-phase brute|grid|sweep] [--slowest n] [--trace path] [--trace-frame n] [--ppm path]\n", argv[0]);
+		return 2;
+	}
+
+	JournalReader journal;
+	journal.threadCount = options.threadCount;
+	if (!journal.open(options.journalPath)) { return 1; }
+
+	Scene scene;
+	std::vector<FrameTiming> timings;
+	uint64_t frame = 0;
+	uint64_t scenes = 0;
+	uint64_t mismatches = 0;
+	uint64_t firstMismatch = UINT64_MAX;
+	double seconds = 0;
+	if (options.tracePath != nullptr) { startTrace(); stopTrace(); }
+	JournalRecordType type;
+	JournalFrameInput input;
+	while (frame < options.frames && journal.next(scene, type, input)) {
+		if (type == JournalRecordType::SCENE) {
+			if (options.overrideBroadPhase) { scene.broadPhase = options.broadPhase; }
+			scenes++;
+			continue;
+		}
+		if (scenes == 0) { fprintf(stderr, "journal doesn't start with a scene\n"); return 1; }
+
+		bool tracing = options.tracePath != nullptr && (options.traceFrame == UINT64_MAX || options.traceFrame == frame);
+		if (tracing) { traceEnabled.store(true, std::memory_order_relaxed); }
+		auto start = std::chrono::steady_clock::now();
+		scene.step();
+		applyFrameInput(scene, input);
+		double frameSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (tracing) { traceEnabled.store(false, std::memory_order_relaxed); }
+		seconds += frameSeconds;
+		timings.push_back({ frame, frameSeconds, scene.particleCount, scene.stats() });
+
+		if (input.checksum != 0 && input.checksum != sceneChecksum(scene)) {
+			if (mismatches == 0) { firstMismatch = frame; }
+			mismatches++;
+		}
+		frame++;
+	}
+
+	size_t slowest = std::min(options.slowest, timings.size());
+	std::partial_sort(timings.begin(), timings.begin() + slowest, timings.end(), [](const FrameTiming& a, const FrameTiming& b) { return a.seconds > b.seconds; });
+	printf("{\n\t\"journal\": \"%s\", \"seed\": %u, \"scenes\": %llu, \"frames\": %llu, \"seconds\": %.6f, \"checksum_mismatches\": %llu, \"first_mismatch\": %lld,\n\t\"slowest_frames\": [",
+		options.journalPath, journal.header.seed, (unsigned long long)scenes, (unsigned long long)frame, seconds, (unsigned long long)mismatches, firstMismatch == UINT64_MAX ? -1ll : (long long)firstMismatch);
+	for (size_t i = 0; i < slowest; i++) {
+		const FrameTiming& timing = timings[i];
+		printf("%s\n\t\t{ \"frame\": %llu, \"seconds\": %.6f, \"particles\": %zu, \"events\": %llu, \"loop_iterations\": %llu, \"pair_tests\": %llu, \"intersection_resolutions\": %llu, \"max_intersection_depth\": %llu }",
+			i == 0 ? "" : ",", (unsigned long long)timing.frame, timing.seconds, timing.particles, (unsigned long long)timing.stats.events, (unsigned long long)timing.stats.loopIterations, (unsigned long long)timing.stats.pairTests,
+			(unsigned long long)timing.stats.intersectionResolutions, (unsigned long long)timing.stats.maxIntersectionDepth);
+	}
+	printf("\n\t]\n}\n");
+
+	if (options.ppmPath != nullptr && scenes != 0) {
+		Rasterizer rasterizer;
+		rasterizer.resize(scene.width, scene.height);
+		scene.syncParticles();
+		rasterizer.render(scene, scene.workers);
+		if (!rasterizer.writePPM(options.ppmPath)) { return 1; }
+	}
+	if (options.tracePath != nullptr && !writeChromeTrace(options.tracePath)) { fprintf(stderr, "failed to write trace %s\n", options.tracePath); return 1; }
+	if (mismatches != 0) { fprintf(stderr, "replay diverged from the recording at frame %llu\n", (unsigned long long)firstMismatch); return 1; }
+	return 0;
+}